@@ -9,8 +9,16 @@ ifndef CONFIG_ESP_RMAKER_SELF_CLAIM
 endif
 endif
 
+ifndef CONFIG_ESP_RMAKER_PARAM_PERSIST_SNAPSHOT
+COMPONENT_OBJEXCLUDE += src/core/esp_rmaker_param_snapshot.o
+endif
+
 ifndef CONFIG_ESP_RMAKER_LOCAL_CTRL_ENABLE
 COMPONENT_OBJEXCLUDE += src/core/esp_rmaker_local_ctrl.o
 endif
 
+ifndef CONFIG_ESP_RMAKER_MQTT_LOOPBACK
+COMPONENT_OBJEXCLUDE += src/mqtt/esp_rmaker_mqtt_loopback.o
+endif
+
 COMPONENT_EMBED_TXTFILES := server_certs/rmaker_mqtt_server.crt server_certs/rmaker_claim_service_server.crt server_certs/rmaker_ota_server.crt
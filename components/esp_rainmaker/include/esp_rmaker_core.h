@@ -180,6 +180,42 @@ typedef struct {
     esp_rmaker_req_src_t src;
 } esp_rmaker_read_ctx_t;
 
+/** Heap allocation statistics for string/object/array parameter values */
+typedef struct {
+    /** Number of times a new buffer had to be allocated for a parameter value */
+    uint32_t value_allocs;
+    /** Number of times a parameter value was written into its existing buffer */
+    uint32_t value_reuses;
+    /** Number of times a buffer had to be allocated for a value received in a set params request */
+    uint32_t scratch_allocs;
+    /** Number of times the scratch buffer was reused for a value received in a set params request */
+    uint32_t scratch_reuses;
+} esp_rmaker_param_alloc_stats_t;
+
+/** Statistics for storing of persistent parameters (PROP_FLAG_PERSIST) */
+typedef struct {
+    /** Number of updates to persistent parameters */
+    uint32_t requests;
+    /** Number of updates which were merged with a value still waiting to be written */
+    uint32_t coalesced;
+    /** Number of values actually written to NVS */
+    uint32_t writes;
+} esp_rmaker_param_persist_stats_t;
+
+/** Statistics of parameter report transactions */
+typedef struct {
+    /** Number of transactions committed */
+    uint32_t count;
+    /** Number of parameter reports deferred till the end of a transaction of the reporting task */
+    uint32_t deferred_reports;
+    /** Time from begin till commit of the last transaction, in microseconds */
+    uint32_t last_apply_us;
+    /** Maximum time from begin till commit of a transaction, in microseconds */
+    uint32_t max_apply_us;
+    /** Time taken to generate and publish the report at the end of the last transaction, in microseconds */
+    uint32_t last_report_us;
+} esp_rmaker_param_report_txn_stats_t;
+
 /** System service configuration */
 typedef struct {
     /** Logical OR of system service flags (SYSTEM_SERV_FLAG_REBOOT,
@@ -223,13 +259,42 @@ typedef struct {
 typedef esp_err_t (*esp_rmaker_device_write_cb_t)(const esp_rmaker_device_t *device, const esp_rmaker_param_t *param,
         const esp_rmaker_param_val_t val, void *priv_data, esp_rmaker_write_ctx_t *ctx);
 
+/** Parameter write request, as passed to the bulk write callback */
+typedef struct {
+    /** Parameter handle */
+    const esp_rmaker_param_t *param;
+    /** New value of the parameter */
+    esp_rmaker_param_val_t val;
+} esp_rmaker_param_write_req_t;
+
+/** Callback for bulk parameter value write requests.
+ *
+ * This is like \ref esp_rmaker_device_write_cb_t, but gets invoked once with all the parameters of the
+ * device received in a single request, rather than once for each parameter. This allows applying
+ * the new values to the hardware together. The callback should call esp_rmaker_param_update() for the
+ * parameters to be set, followed by esp_rmaker_param_report_flush() to report them in a single message.
+ *
+ * @param[in] device Device handle.
+ * @param[in] write_req Array of parameter write requests.
+ * @param[in] count Number of elements in write_req.
+ * @param[in] priv_data Pointer to the private data paassed while creating the device.
+ * @param[in] ctx Context associated with the request.
+ *
+ * @return ESP_OK on success.
+ * @return error in case of failure.
+ */
+typedef esp_err_t (*esp_rmaker_device_bulk_write_cb_t)(const esp_rmaker_device_t *device,
+        const esp_rmaker_param_write_req_t write_req[], uint8_t count, void *priv_data, esp_rmaker_write_ctx_t *ctx);
+
 /** Callback for parameter value changes
  *
  * The callback should call the esp_rmaker_param_update_and_report() API if the new value is to be set
  * and reported back.
  *
- * @note Currently, the read callback never gets invoked as the communication between clients (mobile phones, CLI, etc.)
- * and node is asynchronous. So, the read request does not reach the node. This callback will however be used in future.
+ * @note Currently, the read callback gets invoked only for parameters marked as read-through using
+ * esp_rmaker_param_set_read_through(), when the parameters are read over local control. For such parameters,
+ * the callback should get the latest value (Eg. sample the sensor) and set it using esp_rmaker_param_update().
+ * A value set from within the callback is only returned for the read and is not reported to the cloud.
  *
  * @param[in] device Device handle.
  * @param[in] param Parameter handle.
@@ -523,6 +588,23 @@ esp_err_t esp_rmaker_device_delete(const esp_rmaker_device_t *device);
  */
 esp_err_t esp_rmaker_device_add_cb(const esp_rmaker_device_t *device, esp_rmaker_device_write_cb_t write_cb, esp_rmaker_device_read_cb_t read_cb);
 
+/**
+ * Add bulk callbacks for a device/service
+ *
+ * Same as esp_rmaker_device_add_cb(), except that the write callback gets all the parameters of the device
+ * received in a single request together. If a bulk write callback is added, the write callback added using
+ * esp_rmaker_device_add_cb() will not be invoked.
+ *
+ * @param[in] device Device handle.
+ * @param[in] write_cb Bulk write callback.
+ * @param[in] read_cb Read callback.
+ *
+ * @return ESP_OK on success.
+ * @return error in case of failure.
+ */
+esp_err_t esp_rmaker_device_add_bulk_cb(const esp_rmaker_device_t *device, esp_rmaker_device_bulk_write_cb_t write_cb,
+        esp_rmaker_device_read_cb_t read_cb);
+
 /**
  * Add a device to a node
  *
@@ -707,6 +789,22 @@ esp_rmaker_param_t *esp_rmaker_param_create(const char *param_name, const char *
  */
 esp_err_t esp_rmaker_param_add_ui_type(const esp_rmaker_param_t *param, const char *ui_type);
 
+/**
+ * Mark a parameter as read-through
+ *
+ * The value of a read-through parameter is fetched on demand, by invoking the read callback of the device
+ * (registered using esp_rmaker_device_add_cb()) when the parameters are read over local control, rather than
+ * the application updating it periodically. The callback is invoked only if the value was last fetched more
+ * than ttl_ms milliseconds earlier, so that frequent reads do not keep sampling the hardware.
+ *
+ * @param[in] param Parameter handle.
+ * @param[in] ttl_ms Time in milliseconds for which a fetched value remains valid. 0 to fetch it on every read.
+ *
+ * @return ESP_OK on success.
+ * @return error in case of failure.
+ */
+esp_err_t esp_rmaker_param_set_read_through(const esp_rmaker_param_t *param, uint32_t ttl_ms);
+
 /**
  * Add bounds for an integer/float parameter
  *
@@ -820,6 +918,63 @@ esp_err_t esp_rmaker_param_update_and_report(const esp_rmaker_param_t *param, es
  */
 esp_err_t esp_rmaker_param_update_and_notify(const esp_rmaker_param_t *param, esp_rmaker_param_val_t val);
 
+/** Report all pending parameter updates
+ *
+ * This reports all the parameters which have been updated, but not yet reported, in a single message.
+ * This is useful when CONFIG_ESP_RMAKER_PARAM_REPORT_COALESCE is enabled and the application wants the
+ * pending updates to be reported right away, rather than at the end of the coalescing window.
+ *
+ * @return ESP_OK on success.
+ * @return error in case of failure.
+ */
+esp_err_t esp_rmaker_param_report_flush(void);
+
+/** Begin a parameter report transaction
+ *
+ * Parameter reports (Eg. from esp_rmaker_param_update_and_report()) are deferred till the transaction
+ * is committed using esp_rmaker_param_report_txn_commit(), so that all the parameters updated in between
+ * get reported in a single message. This is used internally for scene activation and schedule triggers,
+ * which may update parameters of several devices.
+ *
+ * @note Transactions can be nested. The report is sent when the outermost transaction is committed.
+ * Only the reports from the task which began the transaction get deferred, and the transaction should be
+ * committed from the same task. Up to 4 tasks can have transactions open at a time.
+ *
+ * @return ESP_OK on success.
+ * @return error in case of failure.
+ */
+esp_err_t esp_rmaker_param_report_txn_begin(void);
+
+/** Commit a parameter report transaction
+ *
+ * This ends the transaction started using esp_rmaker_param_report_txn_begin() and reports all the parameters
+ * whose reports were deferred, in a single message.
+ *
+ * @return ESP_OK on success.
+ * @return error in case of failure.
+ */
+esp_err_t esp_rmaker_param_report_txn_commit(void);
+
+/** Get statistics of parameter report transactions
+ *
+ * @param[out] stats Pointer to a structure which will be filled with the statistics.
+ *
+ * @return ESP_OK on success.
+ * @return error in case of failure.
+ */
+esp_err_t esp_rmaker_param_get_report_txn_stats(esp_rmaker_param_report_txn_stats_t *stats);
+
+/** Report all buffered time series records
+ *
+ * This reports the time series records of all the parameters with PROP_FLAG_TIME_SERIES, buffered
+ * when CONFIG_ESP_RMAKER_TS_BATCHING is enabled, in a single message, rather than waiting for the
+ * configured record count or age.
+ *
+ * @return ESP_OK on success.
+ * @return error in case of failure.
+ */
+esp_err_t esp_rmaker_param_time_series_flush(void);
+
 /** Trigger an alert on the phone app
  *
  * This API will trigger a notification alert on the phone apps (if enabled) using the formatted text
@@ -870,6 +1025,43 @@ char *esp_rmaker_param_get_type(const esp_rmaker_param_t *param);
  */
 esp_rmaker_param_val_t *esp_rmaker_param_get_val(esp_rmaker_param_t *param);
 
+/** Get heap allocation statistics for parameter values
+ *
+ * Buffers for string/object/array parameter values are reused for new values which fit
+ * in them. These statistics can be used to check that steady state updates do not
+ * allocate memory.
+ *
+ * @param[out] stats Pointer to a structure which will be filled with the statistics.
+ *
+ * @return ESP_OK on success.
+ * @return error in case of failure.
+ */
+esp_err_t esp_rmaker_param_get_alloc_stats(esp_rmaker_param_alloc_stats_t *stats);
+
+/** Store all pending persistent parameter values
+ *
+ * This writes the values of all the parameters with PROP_FLAG_PERSIST which have been updated,
+ * but not yet written to NVS. This is useful when CONFIG_ESP_RMAKER_PARAM_PERSIST_WRITE_BEHIND
+ * is enabled and the application wants the values to be stored right away, Eg. before
+ * powering down. Pending values are anyways stored on esp_restart().
+ *
+ * @return ESP_OK on success.
+ * @return error in case of failure.
+ */
+esp_err_t esp_rmaker_param_persist_flush(void);
+
+/** Get statistics for storing of persistent parameters
+ *
+ * The number of flash writes saved by CONFIG_ESP_RMAKER_PARAM_PERSIST_WRITE_BEHIND
+ * can be found from these.
+ *
+ * @param[out] stats Pointer to a structure which will be filled with the statistics.
+ *
+ * @return ESP_OK on success.
+ * @return error in case of failure.
+ */
+esp_err_t esp_rmaker_param_get_persist_stats(esp_rmaker_param_persist_stats_t *stats);
+
 /** Report the node details to the cloud
  *
  * This API reports node details i.e. the node configuration and values of all the parameters to the ESP RainMaker cloud.
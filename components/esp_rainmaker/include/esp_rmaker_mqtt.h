@@ -111,6 +111,57 @@ void esp_rmaker_create_mqtt_topic(char *buf, size_t buf_size, const char *topic_
  */
 bool esp_rmaker_mqtt_is_budget_available(void);
 
+/** MQTT budget classes, in the order of priority */
+typedef enum {
+    /** Alerts, OTA status, command responses and user mapping */
+    ESP_RMAKER_MQTT_BUDGET_CLASS_CONTROL = 0,
+    /** Param reports, node config and any messages not belonging to the other classes */
+    ESP_RMAKER_MQTT_BUDGET_CLASS_STATE,
+    /** Time series data and diagnostics */
+    ESP_RMAKER_MQTT_BUDGET_CLASS_TELEMETRY,
+    /** This will always be the last value */
+    ESP_RMAKER_MQTT_BUDGET_CLASS_MAX,
+} esp_rmaker_mqtt_budget_class_t;
+
+/** MQTT budget statistics of a class */
+typedef struct {
+    /** Number of messages published */
+    uint32_t granted;
+    /** Number of messages denied due to budget being exhausted */
+    uint32_t denied;
+    /** Current budget of the class. Same for all classes if CONFIG_ESP_RMAKER_MQTT_BUDGET_CLASSES is disabled */
+    int16_t budget;
+} esp_rmaker_mqtt_budget_stats_t;
+
+/** Get the budget class of an MQTT topic
+ *
+ * @param[in] topic The MQTT topic.
+ *
+ * @return The budget class to which messages on the topic belong.
+ */
+esp_rmaker_mqtt_budget_class_t esp_rmaker_mqtt_get_budget_class(const char *topic);
+
+/**
+ * @brief Check if budget is available to publish an mqtt message of the given class
+ *
+ * @param[in] budget_class The budget class of the message.
+ *
+ * @return true if budget is available
+ * @return false if budget is exhausted
+ */
+bool esp_rmaker_mqtt_is_class_budget_available(esp_rmaker_mqtt_budget_class_t budget_class);
+
+/** Get MQTT budget statistics of a class
+ *
+ * @param[in] budget_class The budget class.
+ * @param[out] stats Pointer to a structure which will be filled with the statistics.
+ *
+ * @return ESP_OK on success.
+ * @return error in case of failure.
+ */
+esp_err_t esp_rmaker_mqtt_get_budget_stats(esp_rmaker_mqtt_budget_class_t budget_class,
+        esp_rmaker_mqtt_budget_stats_t *stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,133 @@
+/*
+ * SPDX-FileCopyrightText: 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <esp_err.h>
+#include <esp_rmaker_mqtt_glue.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/** Maximum length of the topic saved in a publish record. Longer topics get truncated. */
+#define ESP_RMAKER_MQTT_LOOPBACK_TOPIC_LEN  100
+
+/** Record of a message published by the node */
+typedef struct {
+    /** Time of the publish, in microseconds since boot */
+    int64_t timestamp_us;
+    /** Length of the payload */
+    size_t data_len;
+    /** QoS of the message */
+    uint8_t qos;
+    /** Topic of the message */
+    char topic[ESP_RMAKER_MQTT_LOOPBACK_TOPIC_LEN];
+} esp_rmaker_mqtt_loopback_record_t;
+
+/** Loopback MQTT statistics */
+typedef struct {
+    /** Number of messages published by the node */
+    uint32_t publish_count;
+    /** Total payload size of the messages published by the node */
+    uint64_t publish_bytes;
+    /** Number of messages delivered to the node's subscriptions */
+    uint32_t delivered_count;
+    /** Number of injected messages which did not match any subscription */
+    uint32_t unmatched_count;
+} esp_rmaker_mqtt_loopback_stats_t;
+
+/** Callback invoked for every message published by the node
+ *
+ * @param[in] topic Topic of the message.
+ * @param[in] data Payload of the message.
+ * @param[in] data_len Length of the payload.
+ * @param[in] priv_data Private data passed to esp_rmaker_mqtt_loopback_setup().
+ */
+typedef void (*esp_rmaker_mqtt_loopback_publish_cb_t)(const char *topic, const void *data, size_t data_len, void *priv_data);
+
+/** Use the loopback MQTT implementation
+ *
+ * This registers an in-process stand-in for the MQTT broker, using esp_rmaker_mqtt_setup().
+ * Messages published by the node are recorded (and delivered to the node's own subscriptions, if any
+ * match) instead of being sent out, and messages can be injected into the node's subscriptions
+ * using esp_rmaker_mqtt_loopback_inject(). This is meant for testing and benchmarking without any
+ * network connection or cloud account.
+ *
+ * @note This should be called before esp_rmaker_node_init().
+ *
+ * @param[in] publish_cb Optional callback to be invoked for every message published by the node.
+ * @param[in] priv_data Private data to be passed to the callback.
+ *
+ * @return ESP_OK on success.
+ * @return error in case of failure.
+ */
+esp_err_t esp_rmaker_mqtt_loopback_setup(esp_rmaker_mqtt_loopback_publish_cb_t publish_cb, void *priv_data);
+
+/** Inject a message
+ *
+ * The message gets delivered asynchronously to the subscriptions matching the topic,
+ * like a message received from the MQTT broker.
+ *
+ * @param[in] topic Topic of the message. Eg. node/<node_id>/params/remote
+ * @param[in] data Payload of the message.
+ * @param[in] data_len Length of the payload.
+ *
+ * @return ESP_OK on success.
+ * @return error in case of failure.
+ */
+esp_err_t esp_rmaker_mqtt_loopback_inject(const char *topic, const void *data, size_t data_len);
+
+/** Inject a message periodically
+ *
+ * Any periodic injection started earlier gets stopped.
+ *
+ * @param[in] topic Topic of the message.
+ * @param[in] data Payload of the message.
+ * @param[in] data_len Length of the payload.
+ * @param[in] period_ms Period of the injection, in milliseconds.
+ * @param[in] count Number of times the message should be injected. 0 for no limit.
+ *
+ * @return ESP_OK on success.
+ * @return error in case of failure.
+ */
+esp_err_t esp_rmaker_mqtt_loopback_start_injection(const char *topic, const void *data, size_t data_len,
+        uint32_t period_ms, uint32_t count);
+
+/** Stop the periodic injection started using esp_rmaker_mqtt_loopback_start_injection()
+ *
+ * @return ESP_OK on success.
+ * @return error in case of failure.
+ */
+esp_err_t esp_rmaker_mqtt_loopback_stop_injection(void);
+
+/** Get the loopback MQTT statistics
+ *
+ * @param[out] stats Pointer to the structure to be filled.
+ *
+ * @return ESP_OK on success.
+ * @return error in case of failure.
+ */
+esp_err_t esp_rmaker_mqtt_loopback_get_stats(esp_rmaker_mqtt_loopback_stats_t *stats);
+
+/** Get the records of the latest messages published by the node
+ *
+ * Up to CONFIG_ESP_RMAKER_MQTT_LOOPBACK_RECORDS records are maintained.
+ *
+ * @param[out] records Array to be filled with the records, oldest first.
+ * @param[in] max_records Size of the records array.
+ *
+ * @return Number of records filled.
+ */
+size_t esp_rmaker_mqtt_loopback_get_records(esp_rmaker_mqtt_loopback_record_t *records, size_t max_records);
+
+/** Clear the publish records and the statistics */
+void esp_rmaker_mqtt_loopback_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -74,9 +74,7 @@ static void esp_rmaker_cmd_callback(const char *topic, void *payload, size_t pay
      */
     if (esp_rmaker_cmd_response_handler(payload, payload_len, &output, &output_len) == ESP_OK) {
         if (output) {
-            char publish_topic[MQTT_TOPIC_BUFFER_SIZE];
-            esp_rmaker_create_mqtt_topic(publish_topic, sizeof(publish_topic), CMD_RESP_TOPIC_SUFFIX, CMD_RESP_TOPIC_RULE);
-            if (esp_rmaker_mqtt_publish(publish_topic, output, output_len, RMAKER_MQTT_QOS1, NULL) != ESP_OK) {
+            if (esp_rmaker_mqtt_publish(esp_rmaker_mqtt_get_topic(ESP_RMAKER_MQTT_TOPIC_CMD_RESP), output, output_len, RMAKER_MQTT_QOS1, NULL) != ESP_OK) {
                 ESP_LOGE(TAG, "Failed to publish reponse.");
             }
             free(output);
@@ -31,6 +31,7 @@
 #include <esp_rmaker_utils.h>
 #include "esp_rmaker_internal.h"
 #include "esp_rmaker_mqtt.h"
+#include "esp_rmaker_mqtt_topics.h"
 #include "esp_rmaker_claim.h"
 #include "esp_rmaker_client_data.h"
 
@@ -130,6 +131,11 @@ esp_err_t esp_rmaker_change_node_id(char *node_id, size_t len)
         esp_rmaker_priv_data->node_id = new_node_id;
         _esp_rmaker_node_t *node = (_esp_rmaker_node_t *)esp_rmaker_get_node();
         node->node_id = new_node_id;
+        esp_err_t err = esp_rmaker_mqtt_topics_build(new_node_id);
+        if (err != ESP_OK) {
+            return err;
+        }
+        esp_rmaker_node_config_changed();
         ESP_LOGI(TAG, "New Node ID ----- %s", new_node_id);
         return ESP_OK;
     }
@@ -187,6 +193,7 @@ static esp_err_t esp_rmaker_deinit_priv_data(esp_rmaker_priv_data_t *rmaker_priv
     if (rmaker_priv_data->node_id) {
         free(rmaker_priv_data->node_id);
     }
+    esp_rmaker_mqtt_topics_free();
     free(rmaker_priv_data);
     return ESP_OK;
 }
@@ -204,6 +211,12 @@ esp_err_t esp_rmaker_node_deinit(const esp_rmaker_node_t *node)
     }
     esp_rmaker_node_delete(node);
     esp_rmaker_priv_data->node = NULL;
+#ifdef CONFIG_ESP_RMAKER_PARAM_PERSIST_SNAPSHOT
+    /* Devices may be added after esp_rmaker_start() and so, the snapshot is kept till now, unless
+     * a newer snapshot had values of all of them.
+     */
+    esp_rmaker_param_snapshot_release();
+#endif /* CONFIG_ESP_RMAKER_PARAM_PERSIST_SNAPSHOT */
     esp_rmaker_deinit_priv_data(esp_rmaker_priv_data);
     esp_rmaker_priv_data = NULL;
     return ESP_OK;
@@ -314,7 +327,7 @@ static void esp_rmaker_task(void *data)
 #endif
 #ifdef ESP_RMAKER_CLAIM_ENABLED
     if (esp_rmaker_priv_data->need_claim) {
-        esp_rmaker_priv_data->mqtt_conn_params = esp_rmaker_get_mqtt_conn_params();
+        esp_rmaker_priv_data->mqtt_conn_params = esp_rmaker_mqtt_get_conn_params();
         if (!esp_rmaker_priv_data->mqtt_conn_params) {
             ESP_LOGE(TAG, "Failed to initialise MQTT Config after claiming. Aborting");
             err = ESP_FAIL;
@@ -345,6 +358,13 @@ static void esp_rmaker_task(void *data)
     esp_event_handler_unregister(RMAKER_COMMON_EVENT, RMAKER_MQTT_EVENT_CONNECTED, &esp_rmaker_event_handler);
     esp_rmaker_priv_data->mqtt_connected = true;
     esp_rmaker_priv_data->state = ESP_RMAKER_STATE_STARTED;
+#ifdef CONFIG_ESP_RMAKER_NODE_CONFIG_FINGERPRINT
+    err = esp_rmaker_node_config_fingerprint_init();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Aborting!!!");
+        goto rmaker_end;
+    }
+#endif /* CONFIG_ESP_RMAKER_NODE_CONFIG_FINGERPRINT */
     err = esp_rmaker_report_node_config();
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "Aborting!!!");
@@ -405,7 +425,7 @@ rmaker_end:
 
 static esp_err_t esp_rmaker_mqtt_conn_params_init(esp_rmaker_priv_data_t *rmaker_priv_data, bool use_claiming)
 {
-    rmaker_priv_data->mqtt_conn_params = esp_rmaker_get_mqtt_conn_params();
+    rmaker_priv_data->mqtt_conn_params = esp_rmaker_mqtt_get_conn_params();
     if (rmaker_priv_data->mqtt_conn_params) {
         return ESP_OK;
     }
@@ -456,6 +476,11 @@ static esp_err_t esp_rmaker_init(const esp_rmaker_config_t *config, bool use_cla
         ESP_LOGE(TAG, "Failed to initialise Node Id. Please perform \"claiming\" using RainMaker CLI.");
         return ESP_ERR_NO_MEM;
     }
+    if (esp_rmaker_mqtt_topics_build(esp_rmaker_priv_data->node_id) != ESP_OK) {
+        esp_rmaker_deinit_priv_data(esp_rmaker_priv_data);
+        esp_rmaker_priv_data = NULL;
+        return ESP_ERR_NO_MEM;
+    }
 
     if (esp_rmaker_work_queue_init() != ESP_OK) {
         esp_rmaker_deinit_priv_data(esp_rmaker_priv_data);
@@ -37,12 +37,15 @@ esp_err_t esp_rmaker_device_delete(const esp_rmaker_device_t *device)
             esp_rmaker_attribute_delete(attr);
             attr = next_attr;
         }
+        /* Write out any values still queued for the device's params, before deleting them */
+        esp_rmaker_device_persist_deinit(_device);
         _esp_rmaker_param_t *param = _device->params;
         while (param) {
             _esp_rmaker_param_t *next_param = param->next;
             esp_rmaker_param_delete((esp_rmaker_param_t *)param);
             param = next_param;
         }
+        esp_rmaker_hash_deinit(&_device->param_index);
         if (_device->subtype) {
             free(_device->subtype);
         }
@@ -111,24 +114,25 @@ esp_err_t esp_rmaker_device_add_param(const esp_rmaker_device_t *device, const e
     _esp_rmaker_device_t *_device = (_esp_rmaker_device_t *)device;
     _esp_rmaker_param_t *_new_param = (_esp_rmaker_param_t *)param;
 
-    _esp_rmaker_param_t *_param = _device->params;
-    while(_param) {
-        if (strcmp(_param->name, _new_param->name) == 0) {
-            ESP_LOGE(TAG, "Parameter with name %s already exists in Device %s", _new_param->name, _device->name);
-            return ESP_ERR_INVALID_ARG;
-        }
-        if (_param->next) {
-            _param = _param->next;
-        } else {
-            break;
-        }
+    if (esp_rmaker_hash_get(&_device->param_index, _new_param->name, strlen(_new_param->name))) {
+        ESP_LOGE(TAG, "Parameter with name %s already exists in Device %s", _new_param->name, _device->name);
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (esp_rmaker_hash_add(&_device->param_index, _new_param->name, _new_param) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to index Parameter %s in Device %s", _new_param->name, _device->name);
+        return ESP_ERR_NO_MEM;
     }
     _new_param->parent = _device;
-    if (_param) {
-        _param->next = _new_param;
+    if (_device->params_tail) {
+        _device->params_tail->next = _new_param;
     } else {
         _device->params = _new_param;
     }
+    _device->params_tail = _new_param;
+    /* The param may have been updated before being added to the device */
+    esp_rmaker_param_track_dirty(_new_param);
+    /* So that the param is included in the local control params delta */
+    esp_rmaker_param_mark_changed(_new_param);
     /* We check the stored value here, and not during param creation, because a parameter
      * in itself isn't unique. However, it is unique within a given device and hence can
      * be uniquely represented in storage only when added to a device.
@@ -144,10 +148,17 @@ esp_err_t esp_rmaker_device_add_param(const esp_rmaker_device_t *device, const e
                 }
             }
             _new_param->val = stored_val;
+            _new_param->val_buf_size = 0;
+            if ((stored_val.type == RMAKER_VAL_TYPE_STRING) || (stored_val.type == RMAKER_VAL_TYPE_OBJECT)
+                    || (stored_val.type == RMAKER_VAL_TYPE_ARRAY)) {
+                if (stored_val.val.s) {
+                    _new_param->val_buf_size = strlen(stored_val.val.s) + 1;
+                }
+            }
             /* The device callback should be invoked once with the stored value, so
              * that applications can do initialisations as required.
              */
-            if (_device->write_cb) {
+            if (_device->write_cb || _device->bulk_write_cb) {
                 /* However, the callback should be invoked, only if the parameter is not
                  * of type ESP_RMAKER_PARAM_NAME, as it has special handling internally.
                  */
@@ -155,14 +166,23 @@ esp_err_t esp_rmaker_device_add_param(const esp_rmaker_device_t *device, const e
                     esp_rmaker_write_ctx_t ctx = {
                         .src = ESP_RMAKER_REQ_SRC_INIT,
                     };
-                    _device->write_cb(device, param, stored_val, _device->priv_data, &ctx);
+                    if (_device->bulk_write_cb) {
+                        esp_rmaker_param_write_req_t write_req = {
+                            .param = param,
+                            .val = stored_val,
+                        };
+                        _device->bulk_write_cb(device, &write_req, 1, _device->priv_data, &ctx);
+                    } else {
+                        _device->write_cb(device, param, stored_val, _device->priv_data, &ctx);
+                    }
                 }
             }
         } else {
-            esp_rmaker_param_store_value(_new_param);
+            esp_rmaker_param_persist(_new_param);
         }
     }
     ESP_LOGD(TAG, "Param %s added in %s", _new_param->name, _device->name);
+    esp_rmaker_node_config_changed();
     return ESP_OK;
 }
 
@@ -204,6 +224,7 @@ esp_err_t esp_rmaker_device_add_attribute(const esp_rmaker_device_t *device, con
         _device->attributes = new_attr;
     }
     ESP_LOGD(TAG, "Device attribute %s.%s added", _device->name, attr_name);
+    esp_rmaker_node_config_changed();
     return ESP_OK;
 }
 
@@ -219,6 +240,7 @@ esp_err_t esp_rmaker_device_add_subtype(const esp_rmaker_device_t *device, const
         free(_device->subtype);
     }
     if ((_device->subtype = strdup(subtype)) != NULL ){
+        esp_rmaker_node_config_changed();
         return ESP_OK;
     } else {
         ESP_LOGE(TAG, "Failed to allocate memory for device subtype");
@@ -238,6 +260,7 @@ esp_err_t esp_rmaker_device_add_model(const esp_rmaker_device_t *device, const c
         free(_device->model);
     }
     if ((_device->model = strdup(model)) != NULL ){
+        esp_rmaker_node_config_changed();
         return ESP_OK;
     } else {
         ESP_LOGE(TAG, "Failed to allocate memory for device model");
@@ -252,6 +275,7 @@ esp_err_t esp_rmaker_device_assign_primary_param(const esp_rmaker_device_t *devi
         return ESP_ERR_INVALID_ARG;
     }
     ((_esp_rmaker_device_t *)device)->primary = (_esp_rmaker_param_t *)param;
+    esp_rmaker_node_config_changed();
     return ESP_OK;
 }
 
@@ -267,6 +291,19 @@ esp_err_t esp_rmaker_device_add_cb(const esp_rmaker_device_t *device, esp_rmaker
     return ESP_OK;
 }
 
+esp_err_t esp_rmaker_device_add_bulk_cb(const esp_rmaker_device_t *device, esp_rmaker_device_bulk_write_cb_t write_cb,
+        esp_rmaker_device_read_cb_t read_cb)
+{
+    if (!device) {
+        ESP_LOGE(TAG, "Device handle cannot be NULL");
+        return ESP_ERR_INVALID_ARG;
+    }
+    _esp_rmaker_device_t *_device = (_esp_rmaker_device_t *)device;
+    _device->bulk_write_cb = write_cb;
+    _device->read_cb = read_cb;
+    return ESP_OK;
+}
+
 char *esp_rmaker_device_get_name(const esp_rmaker_device_t *device)
 {
     if (!device) {
@@ -307,12 +344,6 @@ esp_rmaker_param_t *esp_rmaker_device_get_param_by_name(const esp_rmaker_device_
         ESP_LOGE(TAG, "Device handle or param name cannot be NULL");
         return NULL;
     }
-    _esp_rmaker_param_t *param = ((_esp_rmaker_device_t *)device)->params;
-    while(param) {
-        if (strcmp(param->name, param_name) == 0) {
-            break;
-        }
-        param = param->next;
-    }
-    return (esp_rmaker_param_t *)param;
+    return (esp_rmaker_param_t *)esp_rmaker_hash_get(&((_esp_rmaker_device_t *)device)->param_index,
+            param_name, strlen(param_name));
 }
@@ -0,0 +1,152 @@
+/*
+ * SPDX-FileCopyrightText: 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+#include <stdbool.h>
+#include <esp_log.h>
+#include <esp_rmaker_utils.h>
+#include "esp_rmaker_hash.h"
+
+static const char *TAG = "esp_rmaker_hash";
+
+#define HASH_MIN_CAPACITY       8
+#define HASH_MAX_CAPACITY       (1 << 15)
+
+/* FNV-1a */
+static uint32_t esp_rmaker_hash_key(const char *key, size_t key_len)
+{
+    uint32_t h = 2166136261U;
+    for (size_t i = 0; i < key_len; i++) {
+        h ^= (uint8_t)key[i];
+        h *= 16777619U;
+    }
+    return h;
+}
+
+static bool esp_rmaker_hash_key_matches(const char *entry_key, const char *key, size_t key_len)
+{
+    return (strncmp(entry_key, key, key_len) == 0) && (entry_key[key_len] == '\0');
+}
+
+/* Capacity is always a power of 2, so that the index can be derived with a mask */
+static void esp_rmaker_hash_insert(esp_rmaker_hash_entry_t *entries, uint16_t capacity, const char *key, void *value)
+{
+    uint16_t mask = capacity - 1;
+    uint16_t i = esp_rmaker_hash_key(key, strlen(key)) & mask;
+    while (entries[i].key) {
+        i = (i + 1) & mask;
+    }
+    entries[i].key = key;
+    entries[i].value = value;
+}
+
+static esp_err_t esp_rmaker_hash_resize(esp_rmaker_hash_t *hash, uint16_t capacity)
+{
+    esp_rmaker_hash_entry_t *entries = MEM_CALLOC_EXTRAM(capacity, sizeof(esp_rmaker_hash_entry_t));
+    if (!entries) {
+        ESP_LOGE(TAG, "Failed to allocate hash table of %d entries.", capacity);
+        return ESP_ERR_NO_MEM;
+    }
+    for (uint16_t i = 0; i < hash->capacity; i++) {
+        if (hash->entries[i].key) {
+            esp_rmaker_hash_insert(entries, capacity, hash->entries[i].key, hash->entries[i].value);
+        }
+    }
+    if (hash->entries) {
+        free(hash->entries);
+    }
+    hash->entries = entries;
+    hash->capacity = capacity;
+    return ESP_OK;
+}
+
+esp_err_t esp_rmaker_hash_add(esp_rmaker_hash_t *hash, const char *key, void *value)
+{
+    if (!hash || !key) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (esp_rmaker_hash_get(hash, key, strlen(key))) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    /* Keeping the load factor below 3/4 so that the probe sequences remain short */
+    if ((hash->count + 1) * 4 > hash->capacity * 3) {
+        uint16_t capacity = hash->capacity ? hash->capacity * 2 : HASH_MIN_CAPACITY;
+        if (capacity > HASH_MAX_CAPACITY) {
+            return ESP_ERR_NO_MEM;
+        }
+        esp_err_t err = esp_rmaker_hash_resize(hash, capacity);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    esp_rmaker_hash_insert(hash->entries, hash->capacity, key, value);
+    hash->count++;
+    return ESP_OK;
+}
+
+void *esp_rmaker_hash_get(const esp_rmaker_hash_t *hash, const char *key, size_t key_len)
+{
+    if (!hash || !key || !hash->count) {
+        return NULL;
+    }
+    uint16_t mask = hash->capacity - 1;
+    uint16_t i = esp_rmaker_hash_key(key, key_len) & mask;
+    while (hash->entries[i].key) {
+        if (esp_rmaker_hash_key_matches(hash->entries[i].key, key, key_len)) {
+            return hash->entries[i].value;
+        }
+        i = (i + 1) & mask;
+    }
+    return NULL;
+}
+
+esp_err_t esp_rmaker_hash_remove(esp_rmaker_hash_t *hash, const char *key)
+{
+    if (!hash || !key || !hash->count) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint16_t mask = hash->capacity - 1;
+    size_t key_len = strlen(key);
+    uint16_t i = esp_rmaker_hash_key(key, key_len) & mask;
+    while (hash->entries[i].key) {
+        if (esp_rmaker_hash_key_matches(hash->entries[i].key, key, key_len)) {
+            break;
+        }
+        i = (i + 1) & mask;
+    }
+    if (!hash->entries[i].key) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    /* Backward shift deletion, so that no tombstones are required. Any following entry
+     * in the same cluster, whose home slot is not cyclically in (i, j], is moved into the hole.
+     */
+    uint16_t j = i;
+    while (1) {
+        j = (j + 1) & mask;
+        if (!hash->entries[j].key) {
+            break;
+        }
+        uint16_t home = esp_rmaker_hash_key(hash->entries[j].key, strlen(hash->entries[j].key)) & mask;
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            hash->entries[i] = hash->entries[j];
+            i = j;
+        }
+    }
+    hash->entries[i].key = NULL;
+    hash->entries[i].value = NULL;
+    hash->count--;
+    return ESP_OK;
+}
+
+void esp_rmaker_hash_deinit(esp_rmaker_hash_t *hash)
+{
+    if (hash && hash->entries) {
+        free(hash->entries);
+    }
+    if (hash) {
+        memset(hash, 0, sizeof(esp_rmaker_hash_t));
+    }
+}
@@ -0,0 +1,31 @@
+/*
+ * SPDX-FileCopyrightText: 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <esp_err.h>
+
+/* Simple open addressing (linear probing) hash table, mapping NULL terminated string keys
+ * to entries. The keys are not copied and so, should remain valid as long as the entry
+ * is present in the table. Typically, the key would be the name/id member of the entry itself.
+ */
+typedef struct {
+    const char *key;
+    void *value;
+} esp_rmaker_hash_entry_t;
+
+typedef struct {
+    esp_rmaker_hash_entry_t *entries;
+    uint16_t capacity;
+    uint16_t count;
+} esp_rmaker_hash_t;
+
+esp_err_t esp_rmaker_hash_add(esp_rmaker_hash_t *hash, const char *key, void *value);
+/* key_len allows lookups using keys which are not NULL terminated, Eg. keys in a JSON payload */
+void *esp_rmaker_hash_get(const esp_rmaker_hash_t *hash, const char *key, size_t key_len);
+esp_err_t esp_rmaker_hash_remove(esp_rmaker_hash_t *hash, const char *key);
+void esp_rmaker_hash_deinit(esp_rmaker_hash_t *hash);
@@ -15,8 +15,10 @@
 #include <stdint.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/queue.h>
+#include <nvs.h>
 #include <json_generator.h>
 #include <esp_rmaker_core.h>
+#include "esp_rmaker_hash.h"
 
 #define RMAKER_PARAM_FLAG_VALUE_CHANGE   (1 << 0)
 #define RMAKER_PARAM_FLAG_VALUE_NOTIFY   (1 << 1)
@@ -48,10 +50,31 @@ struct esp_rmaker_param {
     uint8_t prop_flags;
     char *ui_type;
     esp_rmaker_param_val_t val;
+    /* Capacity of the buffer pointed to by val.val.s, for string/object/array params.
+     * The buffer is reused for new values which fit in it.
+     */
+    size_t val_buf_size;
     esp_rmaker_param_bounds_t *bounds;
     esp_rmaker_param_valid_str_list_t *valid_str_list;
     struct esp_rmaker_device *parent;
     struct esp_rmaker_param * next;
+    /* Next param in the parent device's dirty list. Valid only if flags != 0 */
+    struct esp_rmaker_param *dirty_next;
+    /* Set if the value is yet to be written to NVS */
+    bool persist_pending;
+    /* Next param in the queue of values to be written to NVS. Valid only if persist_pending is set */
+    struct esp_rmaker_param *persist_next;
+    /* Set if the value was read from the per param NVS key and should be moved to the snapshot */
+    bool snapshot_migrate;
+    /* Buffered time series records, if CONFIG_ESP_RMAKER_TS_BATCHING is enabled */
+    struct esp_rmaker_ts_ring *ts_ring;
+    /* Change sequence number of the last value change. 0 if unchanged since boot */
+    int change_seq;
+    /* Set for params whose values are fetched using the device read callback on reads */
+    bool read_through;
+    uint32_t read_ttl_ms;
+    /* Time at which the value was last fetched using the read callback. 0 if never */
+    int64_t read_time_us;
 };
 typedef struct esp_rmaker_param _esp_rmaker_param_t;
 
@@ -69,14 +92,29 @@ struct esp_rmaker_device {
     char *subtype;
     char *model;
     esp_rmaker_device_write_cb_t write_cb;
+    esp_rmaker_device_bulk_write_cb_t bulk_write_cb;
     esp_rmaker_device_read_cb_t read_cb;
     void *priv_data;
     bool is_service;
     esp_rmaker_attr_t *attributes;
     _esp_rmaker_param_t *params;
+    /* Last param in the list. Params are only ever appended, so that adding one does not walk the list */
+    _esp_rmaker_param_t *params_tail;
+    /* Index of params by name */
+    esp_rmaker_hash_t param_index;
     _esp_rmaker_param_t *primary;
     const esp_rmaker_node_t *parent;
     struct esp_rmaker_device *next;
+    /* Params of this device with pending report/notify flags */
+    _esp_rmaker_param_t *dirty_params;
+    /* Next device in the node's dirty list. Valid only if is_dirty is set */
+    struct esp_rmaker_device *dirty_next;
+    bool is_dirty;
+    /* NVS handle for the device's namespace, kept open once used for persistent params */
+    nvs_handle persist_handle;
+    bool persist_handle_open;
+    /* Highest change sequence number amongst the params */
+    int change_seq;
 };
 typedef struct esp_rmaker_device _esp_rmaker_device_t;
 
@@ -85,25 +123,71 @@ typedef struct {
     esp_rmaker_node_info_t *info;
     esp_rmaker_attr_t *attributes;
     _esp_rmaker_device_t *devices;
+    /* Index of devices/services by name */
+    esp_rmaker_hash_t device_index;
+    /* Devices having at least one param with pending report/notify flags */
+    _esp_rmaker_device_t *dirty_devices;
 } _esp_rmaker_node_t;
 
+/* Growable buffer into which the JSON generator output can be streamed via the flush callback,
+ * so that JSON of unknown size can be generated in a single pass.
+ */
+typedef struct {
+    char *buf;
+    size_t size;
+    size_t len;
+    bool failed;
+} esp_rmaker_json_buf_t;
+
+#define ESP_RMAKER_JSON_CHUNK_SIZE  128
+
+/* Params and values of an action (like that of a schedule or scene) resolved from its JSON */
+typedef struct esp_rmaker_param_action esp_rmaker_param_action_t;
+
 esp_rmaker_node_t *esp_rmaker_node_create(const char *name, const char *type);
 esp_err_t esp_rmaker_change_node_id(char *node_id, size_t len);
 esp_err_t esp_rmaker_report_value(const esp_rmaker_param_val_t *val, char *key, json_gen_str_t *jptr);
+esp_err_t esp_rmaker_json_buf_reserve(esp_rmaker_json_buf_t *jbuf, size_t size);
+void esp_rmaker_json_buf_start(esp_rmaker_json_buf_t *jbuf, json_gen_str_t *jstr, char *chunk, size_t chunk_size);
+esp_err_t esp_rmaker_json_buf_end(esp_rmaker_json_buf_t *jbuf, json_gen_str_t *jstr);
 esp_err_t esp_rmaker_report_data_type(esp_rmaker_val_type_t type, char *data_type_key, json_gen_str_t *jptr);
 esp_err_t esp_rmaker_report_node_config(void);
+esp_err_t esp_rmaker_node_config_fingerprint_init(void);
 esp_err_t esp_rmaker_report_node_state(void);
 _esp_rmaker_device_t *esp_rmaker_node_get_first_device(const esp_rmaker_node_t *node);
 esp_rmaker_attr_t *esp_rmaker_node_get_first_attribute(const esp_rmaker_node_t *node);
 esp_err_t esp_rmaker_params_mqtt_init(void);
 esp_err_t esp_rmaker_param_get_stored_value(_esp_rmaker_param_t *param, esp_rmaker_param_val_t *val);
 esp_err_t esp_rmaker_param_store_value(_esp_rmaker_param_t *param);
+esp_err_t esp_rmaker_param_persist(_esp_rmaker_param_t *param);
+esp_err_t esp_rmaker_device_get_nvs_handle(_esp_rmaker_device_t *device, nvs_handle *handle);
+void esp_rmaker_device_persist_deinit(_esp_rmaker_device_t *device);
+esp_err_t esp_rmaker_param_snapshot_get_value(_esp_rmaker_param_t *param, esp_rmaker_param_val_t *val);
+esp_err_t esp_rmaker_param_snapshot_store(void);
+esp_err_t esp_rmaker_param_val_lock(void);
+void esp_rmaker_param_val_unlock(void);
+void esp_rmaker_param_snapshot_release(void);
+void esp_rmaker_param_set_flags(_esp_rmaker_param_t *param, uint8_t flags);
+void esp_rmaker_param_track_dirty(_esp_rmaker_param_t *param);
+void esp_rmaker_device_track_dirty_params(_esp_rmaker_device_t *device);
+void esp_rmaker_device_untrack_dirty_params(_esp_rmaker_device_t *device);
 esp_err_t esp_rmaker_node_delete(const esp_rmaker_node_t *node);
 esp_err_t esp_rmaker_param_delete(const esp_rmaker_param_t *param);
 esp_err_t esp_rmaker_attribute_delete(esp_rmaker_attr_t *attr);
-char *esp_rmaker_get_node_config(void);
+void esp_rmaker_node_config_changed(void);
+uint32_t esp_rmaker_node_config_get_generation(void);
+const char *esp_rmaker_node_config_acquire(size_t *len);
+void esp_rmaker_node_config_release(void *node_config);
 char *esp_rmaker_get_node_params(void);
+void esp_rmaker_param_mark_changed(_esp_rmaker_param_t *param);
+int esp_rmaker_param_get_change_seq(void);
+void esp_rmaker_populate_params_since(json_gen_str_t *jptr, int since);
+void esp_rmaker_param_read_through_refresh(esp_rmaker_req_src_t src);
 esp_err_t esp_rmaker_handle_set_params(char *data, size_t data_len, esp_rmaker_req_src_t src);
+esp_rmaker_param_action_t *esp_rmaker_param_action_compile(const char *data, size_t data_len);
+esp_err_t esp_rmaker_param_action_perform(esp_rmaker_param_action_t **action, const char *data, size_t data_len,
+        esp_rmaker_req_src_t src);
+void esp_rmaker_param_action_free(esp_rmaker_param_action_t *action);
 esp_err_t esp_rmaker_user_mapping_prov_init(void);
 esp_err_t esp_rmaker_user_mapping_prov_deinit(void);
 esp_err_t esp_rmaker_user_node_mapping_init(void);
@@ -24,8 +24,16 @@
 #include <esp_https_server.h>
 #include <mdns.h>
 #include <esp_rmaker_utils.h>
+#include <json_parser.h>
+#include <json_generator.h>
 
 #include <esp_idf_version.h>
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
+#include <esp_random.h>
+#else
+#include <esp_system.h>
+#endif
+
 #if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(4, 2, 0)
 // Features supported in 4.2
 
@@ -55,6 +63,7 @@ static const char * TAG = "esp_rmaker_local";
 enum property_types {
     PROP_TYPE_NODE_CONFIG = 1,
     PROP_TYPE_NODE_PARAMS,
+    PROP_TYPE_NODE_PARAMS_DELTA,
 };
 
 /* Custom flags that can be set for a property */
@@ -64,10 +73,78 @@ enum property_flags {
 
 static bool g_local_ctrl_is_started = false;
 
+#ifdef CONFIG_ESP_RMAKER_LOCAL_CTRL_PARAMS_DELTA
+/* Random id generated on every boot, since the change sequence numbers restart from 0 after a reboot */
+static int params_delta_boot_id;
+/* Change sequence number after which the changed params are to be returned on the next read.
+ * -1 if not set since the last read, in which case all the params are returned.
+ */
+static int params_delta_since = -1;
+#endif /* CONFIG_ESP_RMAKER_LOCAL_CTRL_PARAMS_DELTA */
+
 static char *g_serv_name;
 static bool wait_for_wifi_prov;
 /********* Handler functions for responding to control requests / commands *********/
 
+#ifdef CONFIG_ESP_RMAKER_LOCAL_CTRL_PARAMS_DELTA
+/* Expected data: {"boot_id":<boot_id>,"since":<seq>}, using the values from the last read of the params delta.
+ * All the params will be returned on the next read, if the boot_id does not match.
+ *
+ * The property is shared by all the clients and its set and get are separate requests. So, if multiple
+ * clients set it before a read, the oldest sequence number is retained, and a read consumes it.
+ * The delta returned is thus always a superset of the one requested by any client, which can check
+ * the "since" of the response to know which changes it covers.
+ */
+static esp_err_t esp_rmaker_local_ctrl_set_params_delta(const char *data, size_t data_len)
+{
+    jparse_ctx_t jctx;
+    if (json_parse_start(&jctx, data, data_len) != 0) {
+        ESP_LOGE(TAG, "Invalid params delta request.");
+        return ESP_ERR_INVALID_ARG;
+    }
+    int boot_id = 0, since = 0;
+    json_obj_get_int(&jctx, "boot_id", &boot_id);
+    if ((json_obj_get_int(&jctx, "since", &since) != 0) || (boot_id != params_delta_boot_id) || (since < 0)) {
+        since = 0;
+    }
+    json_parse_end(&jctx);
+    if ((params_delta_since < 0) || (since < params_delta_since)) {
+        params_delta_since = since;
+    }
+    return ESP_OK;
+}
+
+/* Generates {"boot_id":<boot_id>,"seq":<seq>,"since":<since>,"params":{<changed params>}} */
+static char *esp_rmaker_local_ctrl_get_params_delta(void)
+{
+    esp_rmaker_param_read_through_refresh(ESP_RMAKER_REQ_SRC_LOCAL);
+    int seq = esp_rmaker_param_get_change_seq();
+    int since = (params_delta_since < 0) ? 0 : params_delta_since;
+    params_delta_since = -1;
+    /* The sequence number has wrapped around */
+    if (since > seq) {
+        since = 0;
+    }
+    esp_rmaker_json_buf_t jbuf = {0};
+    char chunk[ESP_RMAKER_JSON_CHUNK_SIZE];
+    json_gen_str_t jstr;
+    esp_rmaker_json_buf_start(&jbuf, &jstr, chunk, sizeof(chunk));
+    json_gen_start_object(&jstr);
+    json_gen_obj_set_int(&jstr, "boot_id", params_delta_boot_id);
+    json_gen_obj_set_int(&jstr, "seq", seq);
+    json_gen_obj_set_int(&jstr, "since", since);
+    json_gen_push_object(&jstr, "params");
+    esp_rmaker_populate_params_since(&jstr, since);
+    json_gen_pop_object(&jstr);
+    json_gen_end_object(&jstr);
+    if (esp_rmaker_json_buf_end(&jbuf, &jstr) != ESP_OK) {
+        free(jbuf.buf);
+        return NULL;
+    }
+    return jbuf.buf;
+}
+#endif /* CONFIG_ESP_RMAKER_LOCAL_CTRL_PARAMS_DELTA */
+
 static esp_err_t get_property_values(size_t props_count,
                                      const esp_local_ctrl_prop_t props[],
                                      esp_local_ctrl_prop_val_t prop_values[],
@@ -79,14 +156,16 @@ static esp_err_t get_property_values(size_t props_count,
         ESP_LOGD(TAG, "(%"PRIu32") Reading property : %s", i, props[i].name);
         switch (props[i].type) {
             case PROP_TYPE_NODE_CONFIG: {
-                char *node_config = esp_rmaker_get_node_config();
+                size_t node_config_len = 0;
+                const char *node_config = esp_rmaker_node_config_acquire(&node_config_len);
                 if (!node_config) {
                     ESP_LOGE(TAG, "Failed to allocate memory for %s", props[i].name);
                     ret = ESP_ERR_NO_MEM;
                 } else {
-                    prop_values[i].size = strlen(node_config);
-                    prop_values[i].data = node_config;
-                    prop_values[i].free_fn = free;
+                    /* The node config is handed out without copying. It is released once sent */
+                    prop_values[i].size = node_config_len;
+                    prop_values[i].data = (void *)node_config;
+                    prop_values[i].free_fn = esp_rmaker_node_config_release;
                 }
                 break;
             }
@@ -102,6 +181,20 @@ static esp_err_t get_property_values(size_t props_count,
                 }
                 break;
             }
+#ifdef CONFIG_ESP_RMAKER_LOCAL_CTRL_PARAMS_DELTA
+            case PROP_TYPE_NODE_PARAMS_DELTA: {
+                char *params_delta = esp_rmaker_local_ctrl_get_params_delta();
+                if (!params_delta) {
+                    ESP_LOGE(TAG, "Failed to allocate memory for %s", props[i].name);
+                    ret = ESP_ERR_NO_MEM;
+                } else {
+                    prop_values[i].size = strlen(params_delta);
+                    prop_values[i].data = params_delta;
+                    prop_values[i].free_fn = free;
+                }
+                break;
+            }
+#endif /* CONFIG_ESP_RMAKER_LOCAL_CTRL_PARAMS_DELTA */
             default:
                 break;
         }
@@ -141,6 +234,12 @@ static esp_err_t set_property_values(size_t props_count,
                 ret = esp_rmaker_handle_set_params((char *)prop_values[i].data,
                         prop_values[i].size, ESP_RMAKER_REQ_SRC_LOCAL);
                 break;
+#ifdef CONFIG_ESP_RMAKER_LOCAL_CTRL_PARAMS_DELTA
+            case PROP_TYPE_NODE_PARAMS_DELTA:
+                ret = esp_rmaker_local_ctrl_set_params_delta((const char *)prop_values[i].data,
+                        prop_values[i].size);
+                break;
+#endif /* CONFIG_ESP_RMAKER_LOCAL_CTRL_PARAMS_DELTA */
             default:
                 break;
         }
@@ -335,6 +434,21 @@ static esp_err_t __esp_rmaker_start_local_ctrl_service(const char *serv_name)
     /* Now register the properties */
     ESP_ERROR_CHECK(esp_local_ctrl_add_property(&node_config));
     ESP_ERROR_CHECK(esp_local_ctrl_add_property(&node_params));
+#ifdef CONFIG_ESP_RMAKER_LOCAL_CTRL_PARAMS_DELTA
+    /* Create the Node Params delta property. Reads return only the params changed since the
+     * change sequence number set by the client.
+     */
+    esp_local_ctrl_prop_t node_params_delta = {
+        .name        = "params_delta",
+        .type        = PROP_TYPE_NODE_PARAMS_DELTA,
+        .size        = 0,
+        .flags       = 0,
+        .ctx         = NULL,
+        .ctx_free_fn = NULL
+    };
+    params_delta_boot_id = (int)(esp_random() & INT32_MAX);
+    ESP_ERROR_CHECK(esp_local_ctrl_add_property(&node_params_delta));
+#endif /* CONFIG_ESP_RMAKER_LOCAL_CTRL_PARAMS_DELTA */
 
     /* update the global status */
     g_local_ctrl_is_started = true;
@@ -5,6 +5,8 @@
  */
 #pragma once
 
+#include <esp_err.h>
+
 #define NODE_CONFIG_TOPIC_RULE                  "esp_node_config"
 #define NODE_PARAMS_LOCAL_TOPIC_RULE            "esp_set_params"
 #define NODE_PARAMS_LOCAL_INIT_RULE             "esp_init_params"
@@ -14,6 +16,7 @@
 #define OTASTATUS_TOPIC_RULE                    "esp_node_otastatus"
 #define TIME_SERIES_DATA_TOPIC_RULE             "esp_ts_ingest"
 #define CMD_RESP_TOPIC_RULE                     "esp_cmd_resp"
+#define NODE_CONFIG_FINGERPRINT_TOPIC_RULE      "esp_node_config_fingerprint"
 
 
 #define USER_MAPPING_TOPIC_SUFFIX               "user/mapping"
@@ -23,6 +26,8 @@
 #define TIME_SERIES_DATA_TOPIC_SUFFIX           "tsdata"
 #define NODE_PARAMS_ALERT_TOPIC_SUFFIX          "alert"
 #define NODE_CONFIG_TOPIC_SUFFIX                "config"
+#define NODE_CONFIG_FINGERPRINT_TOPIC_SUFFIX    "config/fingerprint"
+#define NODE_CONFIG_REQUEST_TOPIC_SUFFIX        "config/request"
 #define OTAURL_TOPIC_SUFFIX                     "otaurl"
 #define OTAFETCH_TOPIC_SUFFIX                   "otafetch"
 #define OTASTATUS_TOPIC_SUFFIX                  "otastatus"
@@ -31,3 +36,24 @@
 #define INSIGHTS_TOPIC_SUFFIX                   "diagnostics/from-node"
 
 #define MQTT_TOPIC_BUFFER_SIZE 150
+
+/* Topics on which the node publishes. The complete topics are generated once for the node id,
+ * using esp_rmaker_mqtt_topics_build(), and can then be fetched using esp_rmaker_mqtt_get_topic().
+ */
+typedef enum {
+    ESP_RMAKER_MQTT_TOPIC_NODE_CONFIG = 0,
+    ESP_RMAKER_MQTT_TOPIC_PARAMS_LOCAL,
+    ESP_RMAKER_MQTT_TOPIC_PARAMS_LOCAL_INIT,
+    ESP_RMAKER_MQTT_TOPIC_PARAMS_ALERT,
+    ESP_RMAKER_MQTT_TOPIC_USER_MAPPING,
+    ESP_RMAKER_MQTT_TOPIC_OTAFETCH,
+    ESP_RMAKER_MQTT_TOPIC_OTASTATUS,
+    ESP_RMAKER_MQTT_TOPIC_TIME_SERIES_DATA,
+    ESP_RMAKER_MQTT_TOPIC_CMD_RESP,
+    ESP_RMAKER_MQTT_TOPIC_NODE_CONFIG_FINGERPRINT,
+    ESP_RMAKER_MQTT_TOPIC_MAX,
+} esp_rmaker_mqtt_topic_id_t;
+
+esp_err_t esp_rmaker_mqtt_topics_build(const char *node_id);
+void esp_rmaker_mqtt_topics_free(void);
+const char *esp_rmaker_mqtt_get_topic(esp_rmaker_mqtt_topic_id_t topic_id);
@@ -81,6 +81,7 @@ esp_err_t esp_rmaker_node_delete(const esp_rmaker_node_t *node)
             esp_rmaker_device_delete((esp_rmaker_device_t *)device);
             device = next_device;
         }
+        esp_rmaker_hash_deinit(&_node->device_index);
         /* Node ID is created in the context of esp_rmaker_init and just assigned
          * here. So, we would not free it here.
          */
@@ -90,6 +91,7 @@ esp_err_t esp_rmaker_node_delete(const esp_rmaker_node_t *node)
         if (_node->info) {
             esp_rmaker_node_info_free(_node->info);
         }
+        esp_rmaker_node_config_changed();
         return ESP_OK;
     }
     return ESP_ERR_INVALID_ARG;
@@ -164,6 +166,7 @@ esp_err_t esp_rmaker_node_add_fw_version(const esp_rmaker_node_t *node, const ch
         ESP_LOGE(TAG, "Failed to allocate memory for fw version.");
         return ESP_ERR_NO_MEM;
     }
+    esp_rmaker_node_config_changed();
     return ESP_OK;
 }
 
@@ -186,6 +189,7 @@ esp_err_t esp_rmaker_node_add_model(const esp_rmaker_node_t *node, const char *m
         ESP_LOGE(TAG, "Failed to allocate memory for node model.");
         return ESP_ERR_NO_MEM;
     }
+    esp_rmaker_node_config_changed();
     return ESP_OK;
 }
 
@@ -208,6 +212,7 @@ esp_err_t esp_rmaker_node_add_subtype(const esp_rmaker_node_t *node, const char
         ESP_LOGE(TAG, "Failed to allocate memory for node subtype.");
         return ESP_ERR_NO_MEM;
     }
+    esp_rmaker_node_config_changed();
     return ESP_OK;
 }
 
@@ -244,6 +249,7 @@ esp_err_t esp_rmaker_node_add_attribute(const esp_rmaker_node_t *node, const cha
         ((_esp_rmaker_node_t *)node)->attributes = new_attr;
     }
     ESP_LOGI(TAG, "Node attribute %s created", attr_name);
+    esp_rmaker_node_config_changed();
     return ESP_OK;
 }
 
@@ -267,12 +273,18 @@ esp_err_t esp_rmaker_node_add_device(const esp_rmaker_node_t *node, const esp_rm
             break;
         }
     }
+    if (esp_rmaker_hash_add(&_node->device_index, _new_device->name, _new_device) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to index %s %s", _new_device->is_service ? "Service":"Device", _new_device->name);
+        return ESP_ERR_NO_MEM;
+    }
     if (_device) {
         _device->next = _new_device;
     } else {
         _node->devices = _new_device;
     }
     _new_device->parent = node;
+    esp_rmaker_device_track_dirty_params(_new_device);
+    esp_rmaker_node_config_changed();
     return ESP_OK;
 }
 
@@ -303,7 +315,10 @@ esp_err_t esp_rmaker_node_remove_device(const esp_rmaker_node_t *node, const esp
     } else {
         prev_device->next = tmp_device->next;
     }
+    esp_rmaker_hash_remove(&_node->device_index, tmp_device->name);
+    esp_rmaker_device_untrack_dirty_params(tmp_device);
     tmp_device->parent = NULL;
+    esp_rmaker_node_config_changed();
     return ESP_OK;
 }
 
@@ -313,14 +328,8 @@ esp_rmaker_device_t *esp_rmaker_node_get_device_by_name(const esp_rmaker_node_t
         ESP_LOGE(TAG, "Node handle or device name cannot be NULL");
         return NULL;
     }
-    _esp_rmaker_device_t *device = ((_esp_rmaker_node_t *)node)->devices;
-    while(device) {
-        if (strcmp(device->name, device_name) == 0) {
-            break;
-        }
-        device = device->next;
-    }
-    return (esp_rmaker_device_t *)device;
+    return (esp_rmaker_device_t *)esp_rmaker_hash_get(&((_esp_rmaker_node_t *)node)->device_index,
+            device_name, strlen(device_name));
 }
 
 _esp_rmaker_device_t *esp_rmaker_node_get_first_device(const esp_rmaker_node_t *node)
@@ -13,11 +13,18 @@
 // limitations under the License.
 #include <sdkconfig.h>
 #include <string.h>
+#include <stddef.h>
+#include <inttypes.h>
 #include <esp_log.h>
+#include <esp_event.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 #include <esp_ota_ops.h>
 #include <json_generator.h>
 #include <esp_rmaker_core.h>
 #include <esp_rmaker_utils.h>
+#include <esp_rmaker_work_queue.h>
+#include <esp_rmaker_common_events.h>
 #include "esp_rmaker_internal.h"
 #include "esp_rmaker_mqtt.h"
 #include "esp_rmaker_mqtt_topics.h"
@@ -112,6 +119,69 @@ esp_err_t esp_rmaker_report_value(const esp_rmaker_param_val_t *val, char *key,
     return ESP_OK;
 }
 
+esp_err_t esp_rmaker_json_buf_reserve(esp_rmaker_json_buf_t *jbuf, size_t size)
+{
+    if (jbuf->size >= size) {
+        return ESP_OK;
+    }
+    char *buf = MEM_CALLOC_EXTRAM(1, size);
+    if (!buf) {
+        ESP_LOGE(TAG, "Failed to allocate %d bytes for JSON buffer.", size);
+        return ESP_ERR_NO_MEM;
+    }
+    if (jbuf->buf) {
+        memcpy(buf, jbuf->buf, jbuf->len);
+        free(jbuf->buf);
+    }
+    jbuf->buf = buf;
+    jbuf->size = size;
+    return ESP_OK;
+}
+
+/* Appends the chunk flushed by the JSON generator, growing the buffer if required */
+static void esp_rmaker_json_buf_flush_cb(char *chunk, void *priv)
+{
+    esp_rmaker_json_buf_t *jbuf = (esp_rmaker_json_buf_t *)priv;
+    size_t chunk_len = strlen(chunk);
+    if (jbuf->failed || (chunk_len == 0)) {
+        return;
+    }
+    size_t req_size = jbuf->len + chunk_len + 1; /* +1 for NULL termination */
+    if (req_size > jbuf->size) {
+        size_t new_size = jbuf->size ? jbuf->size : ESP_RMAKER_JSON_CHUNK_SIZE;
+        while (new_size < req_size) {
+            new_size *= 2;
+        }
+        if (esp_rmaker_json_buf_reserve(jbuf, new_size) != ESP_OK) {
+            jbuf->failed = true;
+            return;
+        }
+    }
+    memcpy(jbuf->buf + jbuf->len, chunk, chunk_len);
+    jbuf->len += chunk_len;
+    jbuf->buf[jbuf->len] = '\0';
+}
+
+void esp_rmaker_json_buf_start(esp_rmaker_json_buf_t *jbuf, json_gen_str_t *jstr, char *chunk, size_t chunk_size)
+{
+    jbuf->len = 0;
+    jbuf->failed = false;
+    if (jbuf->buf) {
+        jbuf->buf[0] = '\0';
+    }
+    json_gen_str_start(jstr, chunk, chunk_size, esp_rmaker_json_buf_flush_cb, jbuf);
+}
+
+esp_err_t esp_rmaker_json_buf_end(esp_rmaker_json_buf_t *jbuf, json_gen_str_t *jstr)
+{
+    /* This flushes out the last chunk */
+    json_gen_str_end(jstr);
+    if (jbuf->failed || !jbuf->buf) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
 esp_err_t esp_rmaker_report_data_type(esp_rmaker_val_type_t type, char *data_type_key, json_gen_str_t *jptr)
 {
     switch (type) {
@@ -252,41 +322,306 @@ int __esp_rmaker_get_node_config(char *buf, size_t buf_size)
     return json_gen_str_end(&jstr);
 }
 
-char *esp_rmaker_get_node_config(void)
+/* Rendered node configuration. The data is handed out as is, and the entry is freed
+ * only after the last reference to it is released.
+ */
+typedef struct {
+    uint32_t ref_count;
+    size_t len;
+    char data[];
+} esp_rmaker_node_config_entry_t;
+
+static portMUX_TYPE node_config_lock = portMUX_INITIALIZER_UNLOCKED;
+/* Incremented on every change in the node configuration */
+static uint32_t node_config_generation;
+#ifdef CONFIG_ESP_RMAKER_NODE_CONFIG_CACHE
+static esp_rmaker_node_config_entry_t *node_config_cache;
+#endif
+
+/* Should be called with node_config_lock held. Returns the entry if it has to be freed */
+static esp_rmaker_node_config_entry_t *esp_rmaker_node_config_unref(esp_rmaker_node_config_entry_t *entry)
 {
+    if (entry && (--entry->ref_count == 0)) {
+        return entry;
+    }
+    return NULL;
+}
+
+void esp_rmaker_node_config_changed(void)
+{
+    esp_rmaker_node_config_entry_t *stale = NULL;
+    portENTER_CRITICAL(&node_config_lock);
+    node_config_generation++;
+#ifdef CONFIG_ESP_RMAKER_NODE_CONFIG_CACHE
+    stale = esp_rmaker_node_config_unref(node_config_cache);
+    node_config_cache = NULL;
+#endif
+    portEXIT_CRITICAL(&node_config_lock);
+    free(stale);
+}
+
+uint32_t esp_rmaker_node_config_get_generation(void)
+{
+    portENTER_CRITICAL(&node_config_lock);
+    uint32_t generation = node_config_generation;
+    portEXIT_CRITICAL(&node_config_lock);
+    return generation;
+}
+
+const char *esp_rmaker_node_config_acquire(size_t *len)
+{
+    esp_rmaker_node_config_entry_t *entry = NULL;
+#ifdef CONFIG_ESP_RMAKER_NODE_CONFIG_CACHE
+    portENTER_CRITICAL(&node_config_lock);
+    if (node_config_cache) {
+        entry = node_config_cache;
+        entry->ref_count++;
+    }
+    uint32_t generation = node_config_generation;
+    portEXIT_CRITICAL(&node_config_lock);
+    if (entry) {
+        goto done;
+    }
+#endif
+
     /* Setting buffer to NULL and size to 0 just to get the required buffer size */
     int req_size = __esp_rmaker_get_node_config(NULL, 0);
     if (req_size < 0) {
         ESP_LOGE(TAG, "Failed to get required size for Node config JSON.");
         return NULL;
     }
-    char *node_config = MEM_CALLOC_EXTRAM(1, req_size);
-    if (!node_config) {
+    entry = MEM_CALLOC_EXTRAM(1, sizeof(esp_rmaker_node_config_entry_t) + req_size);
+    if (!entry) {
         ESP_LOGE(TAG, "Failed to allocate %d bytes for node config", req_size);
         return NULL;
     }
-    if (__esp_rmaker_get_node_config(node_config, req_size) < 0) {
-        free(node_config);
+    if (__esp_rmaker_get_node_config(entry->data, req_size) < 0) {
+        free(entry);
         ESP_LOGE(TAG, "Failed to generate Node config JSON.");
         return NULL;
     }
     ESP_LOGD(TAG, "Generated Node config of length %d", req_size);
-    return node_config;
+    entry->ref_count = 1;
+    entry->len = strlen(entry->data);
+#ifdef CONFIG_ESP_RMAKER_NODE_CONFIG_CACHE
+    esp_rmaker_node_config_entry_t *stale = NULL;
+    portENTER_CRITICAL(&node_config_lock);
+    /* Cache the entry only if the configuration did not change while it was being generated */
+    if (generation == node_config_generation) {
+        stale = esp_rmaker_node_config_unref(node_config_cache);
+        node_config_cache = entry;
+        entry->ref_count++;
+    }
+    portEXIT_CRITICAL(&node_config_lock);
+    free(stale);
+done:
+#endif
+    if (len) {
+        *len = entry->len;
+    }
+    return entry->data;
 }
 
-esp_err_t esp_rmaker_report_node_config()
+void esp_rmaker_node_config_release(void *node_config)
+{
+    if (!node_config) {
+        return;
+    }
+    esp_rmaker_node_config_entry_t *entry = (esp_rmaker_node_config_entry_t *)
+            ((char *)node_config - offsetof(esp_rmaker_node_config_entry_t, data));
+    portENTER_CRITICAL(&node_config_lock);
+    entry = esp_rmaker_node_config_unref(entry);
+    portEXIT_CRITICAL(&node_config_lock);
+    free(entry);
+}
+
+#ifdef CONFIG_ESP_RMAKER_NODE_CONFIG_FINGERPRINT
+#define NODE_CONFIG_NVS_NAMESPACE           "rmaker_config"
+#define NODE_CONFIG_FINGERPRINT_NVS_NAME    "fingerprint"
+#define NODE_CONFIG_FINGERPRINT_DATA_SIZE   200
+#define NODE_CONFIG_FINGERPRINT_LOCK_MSEC   5000
+
+/* The fingerprint of a published node configuration is stored only once the broker acknowledges
+ * its msg_id, so that a config which never made it to the cloud does not get skipped next time.
+ */
+static SemaphoreHandle_t node_config_fingerprint_lock;
+static bool node_config_fingerprint_pending;
+static uint64_t node_config_pending_fingerprint;
+static int node_config_msg_id;
+
+/* 64 bit FNV-1a hash of the node configuration JSON. It just needs to be stable across reboots */
+static uint64_t esp_rmaker_node_config_fingerprint(const char *data, size_t len)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static esp_err_t esp_rmaker_node_config_get_stored_fingerprint(uint64_t *fingerprint)
+{
+    nvs_handle handle;
+    esp_err_t err = nvs_open_from_partition(ESP_RMAKER_NVS_PART_NAME, NODE_CONFIG_NVS_NAMESPACE, NVS_READONLY, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = nvs_get_u64(handle, NODE_CONFIG_FINGERPRINT_NVS_NAME, fingerprint);
+    nvs_close(handle);
+    return err;
+}
+
+static esp_err_t esp_rmaker_node_config_store_fingerprint(uint64_t fingerprint)
+{
+    nvs_handle handle;
+    esp_err_t err = nvs_open_from_partition(ESP_RMAKER_NVS_PART_NAME, NODE_CONFIG_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    err = nvs_set_u64(handle, NODE_CONFIG_FINGERPRINT_NVS_NAME, fingerprint);
+    if (err == ESP_OK) {
+        err = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    return err;
+}
+
+static esp_err_t esp_rmaker_report_node_config_fingerprint(uint64_t fingerprint)
 {
-    char *publish_payload = esp_rmaker_get_node_config();
+    char publish_payload[NODE_CONFIG_FINGERPRINT_DATA_SIZE];
+    char fingerprint_str[17];
+    snprintf(fingerprint_str, sizeof(fingerprint_str), "%016" PRIx64, fingerprint);
+    json_gen_str_t jstr;
+    json_gen_str_start(&jstr, publish_payload, sizeof(publish_payload), NULL, NULL);
+    json_gen_start_object(&jstr);
+    json_gen_obj_set_string(&jstr, "node_id", esp_rmaker_get_node_id());
+    json_gen_obj_set_string(&jstr, "config_version", ESP_RMAKER_CONFIG_VERSION);
+    json_gen_obj_set_string(&jstr, "fingerprint", fingerprint_str);
+    if ((json_gen_end_object(&jstr) < 0) || (json_gen_str_end(&jstr) < 0)) {
+        ESP_LOGE(TAG, "Failed to generate Node config fingerprint JSON.");
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "Node Configuration unchanged. Reporting its fingerprint %s.", fingerprint_str);
+    return esp_rmaker_mqtt_publish(esp_rmaker_mqtt_get_topic(ESP_RMAKER_MQTT_TOPIC_NODE_CONFIG_FINGERPRINT), publish_payload,
+                        strlen(publish_payload), RMAKER_MQTT_QOS1, NULL);
+}
+
+static void esp_rmaker_node_config_published_handler(void* arg, esp_event_base_t event_base,
+                    int32_t event_id, void* event_data)
+{
+    int msg_id = *((int *)event_data);
+    if (xSemaphoreTake(node_config_fingerprint_lock, NODE_CONFIG_FINGERPRINT_LOCK_MSEC/portTICK_PERIOD_MS) != pdTRUE) {
+        ESP_LOGW(TAG, "Failed to take Node config fingerprint lock.");
+        return;
+    }
+    bool store = node_config_fingerprint_pending && (msg_id == node_config_msg_id);
+    if (store) {
+        node_config_fingerprint_pending = false;
+    }
+    uint64_t fingerprint = node_config_pending_fingerprint;
+    xSemaphoreGive(node_config_fingerprint_lock);
+    if (store) {
+        ESP_LOGI(TAG, "Node Configuration published. Storing its fingerprint.");
+        if (esp_rmaker_node_config_store_fingerprint(fingerprint) != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to store Node config fingerprint.");
+        }
+    }
+}
+
+/* The msg_id is required for the acknowledgement, which also means that this publish is not
+ * held in the offline queue. If it fails, the full config is reported again on the next attempt.
+ */
+static esp_err_t esp_rmaker_publish_node_config_with_fingerprint(const char *payload, size_t payload_len,
+                    uint64_t fingerprint)
+{
+    if (xSemaphoreTake(node_config_fingerprint_lock, NODE_CONFIG_FINGERPRINT_LOCK_MSEC/portTICK_PERIOD_MS) != pdTRUE) {
+        ESP_LOGE(TAG, "Failed to take Node config fingerprint lock.");
+        return ESP_FAIL;
+    }
+    int msg_id = -1;
+    esp_err_t ret = esp_rmaker_mqtt_publish(esp_rmaker_mqtt_get_topic(ESP_RMAKER_MQTT_TOPIC_NODE_CONFIG), (void *)payload,
+                        payload_len, RMAKER_MQTT_QOS1, &msg_id);
+    node_config_fingerprint_pending = (ret == ESP_OK);
+    node_config_pending_fingerprint = fingerprint;
+    node_config_msg_id = msg_id;
+    xSemaphoreGive(node_config_fingerprint_lock);
+    return ret;
+}
+#endif /* CONFIG_ESP_RMAKER_NODE_CONFIG_FINGERPRINT */
+
+/* If force is false, and CONFIG_ESP_RMAKER_NODE_CONFIG_FINGERPRINT is enabled, only the fingerprint
+ * is reported if the node configuration is the same as the one last reported.
+ */
+static esp_err_t esp_rmaker_publish_node_config(bool force)
+{
+    size_t publish_payload_len = 0;
+    const char *publish_payload = esp_rmaker_node_config_acquire(&publish_payload_len);
     if (!publish_payload) {
         ESP_LOGE(TAG, "Could not get node configuration for reporting to cloud");
         return ESP_FAIL;
     }
-    char publish_topic[MQTT_TOPIC_BUFFER_SIZE];
-    esp_rmaker_create_mqtt_topic(publish_topic, MQTT_TOPIC_BUFFER_SIZE, NODE_CONFIG_TOPIC_SUFFIX, NODE_CONFIG_TOPIC_RULE);
-    ESP_LOGI(TAG, "Reporting Node Configuration of length %d bytes.", strlen(publish_payload));
+#ifdef CONFIG_ESP_RMAKER_NODE_CONFIG_FINGERPRINT
+    uint64_t fingerprint = esp_rmaker_node_config_fingerprint(publish_payload, publish_payload_len);
+    uint64_t stored_fingerprint = 0;
+    if (!force && (esp_rmaker_node_config_get_stored_fingerprint(&stored_fingerprint) == ESP_OK)
+            && (stored_fingerprint == fingerprint)) {
+        esp_rmaker_node_config_release((void *)publish_payload);
+        return esp_rmaker_report_node_config_fingerprint(fingerprint);
+    }
+#endif /* CONFIG_ESP_RMAKER_NODE_CONFIG_FINGERPRINT */
+    ESP_LOGI(TAG, "Reporting Node Configuration of length %d bytes.", publish_payload_len);
     ESP_LOGD(TAG, "%s", publish_payload);
-    esp_err_t ret = esp_rmaker_mqtt_publish(publish_topic, publish_payload, strlen(publish_payload),
-                        RMAKER_MQTT_QOS1, NULL);
-    free(publish_payload);
+#ifdef CONFIG_ESP_RMAKER_NODE_CONFIG_FINGERPRINT
+    esp_err_t ret = esp_rmaker_publish_node_config_with_fingerprint(publish_payload, publish_payload_len, fingerprint);
+#else
+    esp_err_t ret = esp_rmaker_mqtt_publish(esp_rmaker_mqtt_get_topic(ESP_RMAKER_MQTT_TOPIC_NODE_CONFIG), (void *)publish_payload,
+                        publish_payload_len, RMAKER_MQTT_QOS1, NULL);
+#endif /* CONFIG_ESP_RMAKER_NODE_CONFIG_FINGERPRINT */
+    esp_rmaker_node_config_release((void *)publish_payload);
     return ret;
 }
+
+esp_err_t esp_rmaker_report_node_config()
+{
+    return esp_rmaker_publish_node_config(false);
+}
+
+#ifdef CONFIG_ESP_RMAKER_NODE_CONFIG_FINGERPRINT
+static void esp_rmaker_node_config_report_work_cb(void *priv_data)
+{
+    esp_rmaker_publish_node_config(true);
+}
+
+static void esp_rmaker_node_config_request_callback(const char *topic, void *payload, size_t payload_len, void *priv_data)
+{
+    ESP_LOGI(TAG, "Node Configuration requested by the cloud.");
+    esp_rmaker_work_queue_add_task(esp_rmaker_node_config_report_work_cb, NULL);
+}
+
+esp_err_t esp_rmaker_node_config_fingerprint_init(void)
+{
+    if (!node_config_fingerprint_lock) {
+        node_config_fingerprint_lock = xSemaphoreCreateMutex();
+        if (!node_config_fingerprint_lock) {
+            ESP_LOGE(TAG, "Failed to create Node config fingerprint lock.");
+            return ESP_ERR_NO_MEM;
+        }
+        if (esp_event_handler_register(RMAKER_COMMON_EVENT, RMAKER_MQTT_EVENT_PUBLISHED,
+                    &esp_rmaker_node_config_published_handler, NULL) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to register for MQTT publish events.");
+            vSemaphoreDelete(node_config_fingerprint_lock);
+            node_config_fingerprint_lock = NULL;
+            return ESP_FAIL;
+        }
+    }
+    char subscribe_topic[MQTT_TOPIC_BUFFER_SIZE];
+    snprintf(subscribe_topic, sizeof(subscribe_topic), "node/%s/%s",
+                esp_rmaker_get_node_id(), NODE_CONFIG_REQUEST_TOPIC_SUFFIX);
+    esp_err_t err = esp_rmaker_mqtt_subscribe(subscribe_topic, esp_rmaker_node_config_request_callback, RMAKER_MQTT_QOS1, NULL);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to subscribe to %s. Error %d", subscribe_topic, err);
+    }
+    return err;
+}
+#endif /* CONFIG_ESP_RMAKER_NODE_CONFIG_FINGERPRINT */
@@ -14,9 +14,18 @@
 #include <sdkconfig.h>
 #include <time.h>
 #include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <stdatomic.h>
 #include <esp_log.h>
 #include <esp_err.h>
 #include <nvs.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/timers.h>
+#include <freertos/semphr.h>
 
 #include <json_parser.h>
 #include <json_generator.h>
@@ -25,6 +34,7 @@
 #include <esp_rmaker_standard_types.h>
 #include <esp_rmaker_mqtt.h>
 #include <esp_rmaker_utils.h>
+#include <esp_rmaker_work_queue.h>
 #include "esp_rmaker_mqtt_topics.h"
 #include "esp_rmaker_internal.h"
 
@@ -32,19 +42,111 @@
 
 #define ESP_RMAKER_ALERT_KEY                    "esp.alert.str"
 
-#define RMAKER_PARAMS_SIZE_MARGIN       50 /* To accommodate for changes in param values while creating JSON */
 #define RMAKER_ALERT_STR_MARGIN         25 /* To accommodate rest of the alert payload {"esp.alert.str":""}  */
 #define MAX_TS_DATA_PARAM_NAME          66 /* Time series data param name is of the format <device_name>.<param_name> */
+#define RMAKER_PARAM_VAL_BUF_ALIGN      32 /* String/object/array value buffers are allocated in multiples of this */
+#define ESP_RMAKER_BULK_WRITE_MAX_PARAMS    16 /* Maximum params of a device in a single write request for the bulk write callback */
 
-static size_t max_node_params_size = CONFIG_ESP_RMAKER_MAX_PARAM_DATA_SIZE;
 /* This buffer will be allocated once and will be reused for all param updates.
- * It may be reallocated if the params size becomes too large */
+ * It grows if the params size becomes too large */
+static esp_rmaker_json_buf_t node_params_jbuf;
+/* Buffer for the alert payload, which is generated along with the params report by esp_rmaker_param_notify() */
+static esp_rmaker_json_buf_t node_alert_jbuf;
+/* Serialises the use of the above buffers, since reports get generated from the application tasks
+ * as well as the work queue. Recursive, since reports can be triggered from within the publish path.
+ */
+static SemaphoreHandle_t node_params_lock;
+/* Serialises the updates of the string values of params, which get overwritten in place or reallocated,
+ * with the reads of the values for storing them in NVS, which happen from the work queue.
+ */
+static SemaphoreHandle_t param_val_lock;
+static portMUX_TYPE param_lock_create_mux = portMUX_INITIALIZER_UNLOCKED;
 
-static char publish_topic[MQTT_TOPIC_BUFFER_SIZE];
 static bool esp_rmaker_params_mqtt_init_done;
+/* Incremented on every param value change. Kept within the positive int range, since it is reported in JSON */
+static atomic_int param_change_seq;
+/* Number of params marked as read-through, so that the params need not be looked at if there are none */
+static atomic_int read_through_params;
+/* Param whose read callback is being invoked, and the task invoking it. Values set by the callback
+ * are just stored, without being reported, since they are fetched only to be returned for the read.
+ * These are set only with read_through_lock held, which serialises the refreshes from different tasks.
+ * Recursive, since the read callbacks may fetch the node params, which refreshes them again.
+ */
+static _esp_rmaker_param_t *read_through_param;
+static TaskHandle_t read_through_task;
+static SemaphoreHandle_t read_through_lock;
+#ifdef CONFIG_ESP_RMAKER_PARAM_REPORT_COALESCE
+static TimerHandle_t param_report_timer;
+#endif /* CONFIG_ESP_RMAKER_PARAM_REPORT_COALESCE */
+/* Maximum number of tasks which can have report transactions open at a time */
+#define RMAKER_PARAM_REPORT_TXN_MAX_TASKS   4
+/* Report transaction of a task. The reports from a task are deferred while it has a transaction open,
+ * and sent together on its outermost commit. Reports from other tasks are not affected.
+ */
+typedef struct {
+    TaskHandle_t task;  /* NULL if the slot is free */
+    uint16_t depth;
+    bool pending;
+    int64_t start_us;
+} esp_rmaker_param_report_txn_t;
+static portMUX_TYPE param_report_txn_lock = portMUX_INITIALIZER_UNLOCKED;
+static esp_rmaker_param_report_txn_t param_report_txns[RMAKER_PARAM_REPORT_TXN_MAX_TASKS];
+static esp_rmaker_param_report_txn_stats_t param_report_txn_stats;
+
+#ifdef CONFIG_ESP_RMAKER_PARAM_PERSIST_WRITE_BEHIND
+/* Queue of persistent params whose values are yet to be written to NVS */
+static _esp_rmaker_param_t *persist_queue;
+static portMUX_TYPE persist_queue_lock = portMUX_INITIALIZER_UNLOCKED;
+static TimerHandle_t param_persist_timer;
+#endif /* CONFIG_ESP_RMAKER_PARAM_PERSIST_WRITE_BEHIND */
+#ifdef CONFIG_ESP_RMAKER_PARAM_PERSIST_SNAPSHOT
+/* Set if the snapshot needs to be written, but the write failed */
+static bool param_snapshot_pending;
+#endif /* CONFIG_ESP_RMAKER_PARAM_PERSIST_SNAPSHOT */
+static esp_rmaker_param_persist_stats_t param_persist_stats;
+
+#ifdef CONFIG_ESP_RMAKER_TS_BATCHING
+typedef struct {
+    uint32_t t;
+    esp_rmaker_param_val_t val;
+} esp_rmaker_ts_record_t;
+
+/* Ring buffer of the time series records of a param */
+struct esp_rmaker_ts_ring {
+    esp_rmaker_ts_record_t records[CONFIG_ESP_RMAKER_TS_BATCH_MAX_RECORDS];
+    uint16_t head;          /* Index of the oldest record */
+    uint16_t count;
+    uint16_t flush_count;   /* Number of records, from the oldest, included in the message being sent */
+};
+
+/* Protects the ring buffers, counters and the time series JSON buffer */
+static SemaphoreHandle_t ts_lock;
+static TimerHandle_t ts_flush_timer;
+static esp_rmaker_json_buf_t ts_data_jbuf;
+static uint32_t ts_pending_records;
+static bool ts_flush_queued;
+static bool ts_flush_in_progress;
+static bool ts_publish_failed;
+#endif /* CONFIG_ESP_RMAKER_TS_BATCHING */
 
 static const char *TAG = "esp_rmaker_param";
 
+/* Scratch buffer for the string/object/array values received in set params requests.
+ * It is grow-only and reused across requests so that steady state writes do not need
+ * any heap allocations.
+ */
+typedef struct {
+    char *buf;
+    size_t size;
+    bool in_use;
+} esp_rmaker_param_scratch_t;
+
+/* One scratch buffer per request source, so that nested requests (Eg. a scene activated
+ * by a cloud request) do not clobber each other's values.
+ */
+static esp_rmaker_param_scratch_t set_params_scratch[ESP_RMAKER_REQ_SRC_MAX];
+static esp_rmaker_param_alloc_stats_t param_alloc_stats;
+
 
 static const char *cb_srcs[ESP_RMAKER_REQ_SRC_MAX] = {
     [ESP_RMAKER_REQ_SRC_INIT] = "Init",
@@ -117,276 +219,781 @@ esp_rmaker_param_val_t esp_rmaker_array(const char *val)
     return param_val;
 }
 
-static esp_err_t esp_rmaker_populate_params(char *buf, size_t *buf_len, uint8_t flags, bool reset_flags)
+/* Guards the dirty lists of the node and devices, since params get updated from multiple tasks */
+static portMUX_TYPE dirty_list_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* Adds the device to the node's dirty list, if it has any params with pending flags
+ * and is part of a node. Should be called with dirty_list_lock held.
+ */
+static void __esp_rmaker_device_track_dirty_params(_esp_rmaker_device_t *device)
 {
-    esp_err_t err = ESP_OK;
+    _esp_rmaker_node_t *node = (_esp_rmaker_node_t *)device->parent;
+    if (!node || device->is_dirty || !device->dirty_params) {
+        return;
+    }
+    device->dirty_next = node->dirty_devices;
+    node->dirty_devices = device;
+    device->is_dirty = true;
+}
+
+void esp_rmaker_device_track_dirty_params(_esp_rmaker_device_t *device)
+{
+    portENTER_CRITICAL(&dirty_list_lock);
+    __esp_rmaker_device_track_dirty_params(device);
+    portEXIT_CRITICAL(&dirty_list_lock);
+}
+
+/* Removes the device from the node's dirty list. The device retains its own list of
+ * dirty params so that they get reported if the device is added to the node again.
+ */
+void esp_rmaker_device_untrack_dirty_params(_esp_rmaker_device_t *device)
+{
+    _esp_rmaker_node_t *node = (_esp_rmaker_node_t *)device->parent;
+    portENTER_CRITICAL(&dirty_list_lock);
+    if (!node || !device->is_dirty) {
+        portEXIT_CRITICAL(&dirty_list_lock);
+        return;
+    }
+    _esp_rmaker_device_t **device_ptr = &node->dirty_devices;
+    while (*device_ptr) {
+        if (*device_ptr == device) {
+            *device_ptr = device->dirty_next;
+            break;
+        }
+        device_ptr = &(*device_ptr)->dirty_next;
+    }
+    device->dirty_next = NULL;
+    device->is_dirty = false;
+    portEXIT_CRITICAL(&dirty_list_lock);
+}
+
+/* Adds a param with pending flags to its parent device's dirty list. Should be called with dirty_list_lock held. */
+static void __esp_rmaker_param_track_dirty(_esp_rmaker_param_t *param)
+{
+    _esp_rmaker_device_t *device = param->parent;
+    if (!device || !param->flags) {
+        return;
+    }
+    param->dirty_next = device->dirty_params;
+    device->dirty_params = param;
+    __esp_rmaker_device_track_dirty_params(device);
+}
+
+void esp_rmaker_param_track_dirty(_esp_rmaker_param_t *param)
+{
+    portENTER_CRITICAL(&dirty_list_lock);
+    __esp_rmaker_param_track_dirty(param);
+    portEXIT_CRITICAL(&dirty_list_lock);
+}
+
+void esp_rmaker_param_set_flags(_esp_rmaker_param_t *param, uint8_t flags)
+{
+    portENTER_CRITICAL(&dirty_list_lock);
+    bool was_dirty = param->flags ? true : false;
+    param->flags |= flags;
+    /* A param with some flags already set would already be in the dirty list */
+    if (!was_dirty) {
+        __esp_rmaker_param_track_dirty(param);
+    }
+    portEXIT_CRITICAL(&dirty_list_lock);
+}
+
+/* Clears the given flags from all the dirty params and drops the params (and devices)
+ * which do not have any pending flags thereafter. This visits only the changed params.
+ */
+static void esp_rmaker_reset_param_flags(_esp_rmaker_node_t *node, uint8_t flags)
+{
+    portENTER_CRITICAL(&dirty_list_lock);
+    _esp_rmaker_device_t **device_ptr = &node->dirty_devices;
+    while (*device_ptr) {
+        _esp_rmaker_device_t *device = *device_ptr;
+        _esp_rmaker_param_t **param_ptr = &device->dirty_params;
+        while (*param_ptr) {
+            _esp_rmaker_param_t *param = *param_ptr;
+            param->flags &= ~flags;
+            if (param->flags) {
+                param_ptr = &param->dirty_next;
+            } else {
+                *param_ptr = param->dirty_next;
+                param->dirty_next = NULL;
+            }
+        }
+        if (device->dirty_params) {
+            device_ptr = &device->dirty_next;
+        } else {
+            *device_ptr = device->dirty_next;
+            device->dirty_next = NULL;
+            device->is_dirty = false;
+        }
+    }
+    portEXIT_CRITICAL(&dirty_list_lock);
+}
+
+static void esp_rmaker_populate_device_params(_esp_rmaker_device_t *device, uint8_t flags, json_gen_str_t *jptr)
+{
+    bool device_added = false;
+    /* If flags are specified, only the params in the device's dirty list can match */
+    _esp_rmaker_param_t *param = flags ? device->dirty_params : device->params;
+    while (param) {
+        if (!flags || (param->flags & flags)) {
+            if (!device_added) {
+                json_gen_push_object(jptr, device->name);
+                device_added = true;
+            }
+            esp_rmaker_report_value(&param->val, param->name, jptr);
+        }
+        param = flags ? param->dirty_next : param->next;
+    }
+    if (device_added) {
+        json_gen_pop_object(jptr);
+    }
+}
+
+/* The JSON is streamed into jbuf, which grows as required. So, it is generated only once,
+ * without having to find the required size first.
+ */
+static esp_err_t esp_rmaker_populate_params(esp_rmaker_json_buf_t *jbuf, uint8_t flags, bool reset_flags)
+{
+    _esp_rmaker_node_t *node = (_esp_rmaker_node_t *)esp_rmaker_get_node();
+    if (!node) {
+        ESP_LOGE(TAG, "Node handle cannot be NULL.");
+        return ESP_ERR_INVALID_STATE;
+    }
+    char chunk[ESP_RMAKER_JSON_CHUNK_SIZE];
     json_gen_str_t jstr;
-    json_gen_str_start(&jstr, buf, *buf_len, NULL, NULL);
+    esp_rmaker_json_buf_start(jbuf, &jstr, chunk, sizeof(chunk));
     json_gen_start_object(&jstr);
-    _esp_rmaker_device_t *device = esp_rmaker_node_get_first_device(esp_rmaker_get_node());
+    /* If flags are specified, only the devices in the node's dirty list need to be looked at */
+    _esp_rmaker_device_t *device = flags ? node->dirty_devices : node->devices;
     while (device) {
+        esp_rmaker_populate_device_params(device, flags, &jstr);
+        device = flags ? device->dirty_next : device->next;
+    }
+    json_gen_end_object(&jstr);
+    esp_err_t err = esp_rmaker_json_buf_end(jbuf, &jstr);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to generate Node params JSON.");
+        return err;
+    }
+    /* Resetting the flags only after the JSON has been generated successfully, so that
+     * the params get reported during the next attempt, in case of failures.
+     */
+    if (reset_flags && flags) {
+        esp_rmaker_reset_param_flags(node, flags);
+    }
+    return ESP_OK;
+}
+
+int esp_rmaker_param_get_change_seq(void)
+{
+    return atomic_load(&param_change_seq);
+}
+
+void esp_rmaker_param_mark_changed(_esp_rmaker_param_t *param)
+{
+    int seq = atomic_load(&param_change_seq);
+    int next;
+    do {
+        next = (seq == INT32_MAX) ? 1 : seq + 1;
+    } while (!atomic_compare_exchange_weak(&param_change_seq, &seq, next));
+    param->change_seq = next;
+    if (param->parent) {
+        param->parent->change_seq = next;
+    }
+}
+
+/* Adds the values of the params changed after the given change sequence number, to the
+ * current JSON object. All the params are added if since is 0.
+ */
+void esp_rmaker_populate_params_since(json_gen_str_t *jptr, int since)
+{
+    _esp_rmaker_device_t *device = esp_rmaker_node_get_first_device(esp_rmaker_get_node());
+    for (; device; device = device->next) {
+        if (since && (device->change_seq <= since)) {
+            continue;
+        }
         bool device_added = false;
         _esp_rmaker_param_t *param = device->params;
-        while (param) {
-            if (!flags || (param->flags & flags)) {
-                if (!device_added) {
-                    json_gen_push_object(&jstr, device->name);
-                    device_added = true;
-                }
-                esp_rmaker_report_value(&param->val, param->name, &jstr);
+        for (; param; param = param->next) {
+            if (since && (param->change_seq <= since)) {
+                continue;
             }
-            param = param->next;
+            if (!device_added) {
+                json_gen_push_object(jptr, device->name);
+                device_added = true;
+            }
+            esp_rmaker_report_value(&param->val, param->name, jptr);
         }
         if (device_added) {
-            json_gen_pop_object(&jstr);
+            json_gen_pop_object(jptr);
         }
-        device = device->next;
     }
-    if (json_gen_end_object(&jstr) < 0) {
-        err = ESP_ERR_NO_MEM;
+}
+
+/* The locks are created lazily, since params can be updated and reported before esp_rmaker_start().
+ * The mutex created by a task which loses the race gets deleted.
+ */
+static esp_err_t esp_rmaker_param_lock_create(SemaphoreHandle_t *lock, bool recursive)
+{
+    if (*lock) {
+        return ESP_OK;
     }
-    /* Resetting the flags after creating the JSON in order to handle cases wherein
-     * memory has been insufficient and this same function would have to be called
-     * again with a larger buffer.
-     */
-    if (err == ESP_OK) {
-        device = esp_rmaker_node_get_first_device(esp_rmaker_get_node());
-        while (device) {
-            _esp_rmaker_param_t *param = device->params;
-            while (param) {
-                if (reset_flags) {
-                    param->flags &= ~flags;
-                }
-                param = param->next;
+    SemaphoreHandle_t new_lock = recursive ? xSemaphoreCreateRecursiveMutex() : xSemaphoreCreateMutex();
+    if (!new_lock) {
+        ESP_LOGE(TAG, "Failed to create param lock.");
+        return ESP_ERR_NO_MEM;
+    }
+    portENTER_CRITICAL(&param_lock_create_mux);
+    if (!*lock) {
+        *lock = new_lock;
+        new_lock = NULL;
+    }
+    portEXIT_CRITICAL(&param_lock_create_mux);
+    if (new_lock) {
+        vSemaphoreDelete(new_lock);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_rmaker_param_set_read_through(const esp_rmaker_param_t *param, uint32_t ttl_ms)
+{
+    if (!param) {
+        ESP_LOGE(TAG, "Param handle cannot be NULL.");
+        return ESP_ERR_INVALID_ARG;
+    }
+    _esp_rmaker_param_t *_param = (_esp_rmaker_param_t *)param;
+    if (!_param->read_through) {
+        _param->read_through = true;
+        atomic_fetch_add(&read_through_params, 1);
+    }
+    _param->read_ttl_ms = ttl_ms;
+    _param->read_time_us = 0;
+    return ESP_OK;
+}
+
+static bool esp_rmaker_param_is_being_read(const _esp_rmaker_param_t *param)
+{
+    return (param == read_through_param) && (read_through_task == xTaskGetCurrentTaskHandle());
+}
+
+/* Invokes the device read callbacks for the read-through params whose values are older than their TTL */
+void esp_rmaker_param_read_through_refresh(esp_rmaker_req_src_t src)
+{
+    if (!atomic_load(&read_through_params)) {
+        return;
+    }
+    if (esp_rmaker_param_lock_create(&read_through_lock, true) != ESP_OK) {
+        return;
+    }
+    xSemaphoreTakeRecursive(read_through_lock, portMAX_DELAY);
+    /* Restored after each callback, in case this is a refresh from within a read callback */
+    _esp_rmaker_param_t *prev_param = read_through_param;
+    int64_t now = esp_timer_get_time();
+    esp_rmaker_read_ctx_t ctx = {
+        .src = src,
+    };
+    _esp_rmaker_device_t *device = esp_rmaker_node_get_first_device(esp_rmaker_get_node());
+    for (; device; device = device->next) {
+        if (!device->read_cb) {
+            continue;
+        }
+        _esp_rmaker_param_t *param = device->params;
+        for (; param; param = param->next) {
+            if (!param->read_through || (param->read_time_us &&
+                        ((now - param->read_time_us) < ((int64_t)param->read_ttl_ms * 1000)))) {
+                continue;
+            }
+            read_through_task = xTaskGetCurrentTaskHandle();
+            read_through_param = param;
+            esp_err_t err = device->read_cb((esp_rmaker_device_t *)device, (esp_rmaker_param_t *)param,
+                        device->priv_data, &ctx);
+            read_through_param = prev_param;
+            if (err == ESP_OK) {
+                param->read_time_us = now;
+            } else {
+                ESP_LOGE(TAG, "Read of param %s - %s failed", device->name, param->name);
             }
-            device = device->next;
         }
     }
-    *buf_len = json_gen_str_end(&jstr);
-    return err;
+    xSemaphoreGiveRecursive(read_through_lock);
 }
 
-/* This function does not use the node_params_buf since this is for external use
- * and we do not want __esp_rmaker_allocate_and_populate_params to overwrite
+/* This function does not use the node_params_jbuf since this is for external use
+ * and we do not want esp_rmaker_allocate_and_populate_params to overwrite
  * the buffer.
  */
 char *esp_rmaker_get_node_params(void)
 {
-    size_t req_size = 0;
-    /* Passing NULL pointer to find the required buffer size */
-    esp_err_t err = esp_rmaker_populate_params(NULL, &req_size, 0, false);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to get required size for Node params JSON.");
-        return NULL;
-    }
-    /* Keeping some margin just in case some param value changes in between */
-    req_size += RMAKER_PARAMS_SIZE_MARGIN;
-    char *node_params = MEM_CALLOC_EXTRAM(1, req_size);
-    if (!node_params) {
-        ESP_LOGE(TAG, "Failed to allocate %d bytes for Node params.", req_size);
+    esp_rmaker_param_read_through_refresh(ESP_RMAKER_REQ_SRC_LOCAL);
+    esp_rmaker_json_buf_t jbuf = {0};
+    if (esp_rmaker_populate_params(&jbuf, 0, false) != ESP_OK) {
+        if (jbuf.buf) {
+            free(jbuf.buf);
+        }
         return NULL;
     }
-    err = esp_rmaker_populate_params(node_params, &req_size, 0, false);
+    return jbuf.buf;
+}
+
+static esp_err_t esp_rmaker_node_params_lock(void)
+{
+    esp_err_t err = esp_rmaker_param_lock_create(&node_params_lock, true);
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to generate Node params JSON.");
-        free(node_params);
-        return NULL;
+        return err;
     }
-    return node_params;
+    xSemaphoreTakeRecursive(node_params_lock, portMAX_DELAY);
+    return ESP_OK;
+}
+
+static void esp_rmaker_node_params_unlock(void)
+{
+    xSemaphoreGiveRecursive(node_params_lock);
 }
 
-static char * esp_rmaker_param_get_buf(size_t size)
+esp_err_t esp_rmaker_param_val_lock(void)
 {
-    static char *s_node_params_buf;
-    static size_t s_param_buf_size;
-    /* If received size is 0, we will just return the pointer to the buffer */
-    if (size == 0) {
-        return s_node_params_buf;
+    esp_err_t err = esp_rmaker_param_lock_create(&param_val_lock, false);
+    if (err != ESP_OK) {
+        return err;
     }
-    /* If s_param_buf_size is not 0, it means that a buffer was already allocated.
-     * If the requested "size" is not the same as the existing s_param_buf_size,
-     * we need to free existing buffer.
+    xSemaphoreTake(param_val_lock, portMAX_DELAY);
+    return ESP_OK;
+}
+
+void esp_rmaker_param_val_unlock(void)
+{
+    xSemaphoreGive(param_val_lock);
+}
+
+static esp_err_t esp_rmaker_allocate_and_populate_params(uint8_t flags, bool reset_flags)
+{
+    /* Typically, CONFIG_ESP_RMAKER_MAX_PARAM_DATA_SIZE should be sufficient for the parameters.
+     * The buffer will grow otherwise.
      */
-    if ((s_param_buf_size != 0) && (s_param_buf_size != size)) {
-        ESP_LOGD(TAG, "Freeing s_node_params_buf of size %d", s_param_buf_size);
-        free(s_node_params_buf);
-        s_node_params_buf = NULL;
-    }
-    if (!s_node_params_buf) {
-        ESP_LOGD(TAG, "Allocating s_node_params_buf for size %d.", size);
-        s_node_params_buf = MEM_CALLOC_EXTRAM(1, size);
-        if (!s_node_params_buf) {
-            ESP_LOGE(TAG, "Failed to allocate %d bytes for Node params.", size);
-            s_param_buf_size = 0;
-            return NULL;
-        }
-        s_param_buf_size = size;
+    esp_err_t err = esp_rmaker_json_buf_reserve(&node_params_jbuf, CONFIG_ESP_RMAKER_MAX_PARAM_DATA_SIZE);
+    if (err != ESP_OK) {
+        return err;
     }
-    return s_node_params_buf;
+    return esp_rmaker_populate_params(&node_params_jbuf, flags, reset_flags);
 }
 
-static esp_err_t esp_rmaker_allocate_and_populate_params(uint8_t flags, bool reset_flags)
+static esp_err_t esp_rmaker_publish_params(esp_rmaker_json_buf_t *jbuf, uint8_t flags)
 {
-    char *node_params_buf = esp_rmaker_param_get_buf(max_node_params_size);
-    if (!node_params_buf) {
-        return ESP_ERR_NO_MEM;
+    /* Just checking if there are indeed any params to report by comparing with a decent enough
+     * length as even the smallest possible data, Eg. '{"d":{"p":0}}' will be > 10 bytes.
+     */
+    if (jbuf->len <= 10) {
+        return ESP_OK;
     }
-    /* Typically, max_node_params_size should be sufficient for the parameters */
-    size_t req_size = max_node_params_size;
-    esp_err_t err = esp_rmaker_populate_params(node_params_buf, &req_size, flags, reset_flags);
-    /* If the max_node_params_size was insufficient, we will re-allocate new buffer */
-    if (err == ESP_ERR_NO_MEM) {
-        ESP_LOGW(TAG, "%d bytes not sufficient for Node params. Reallocating %d bytes.",
-                max_node_params_size, req_size + RMAKER_PARAMS_SIZE_MARGIN);
-        max_node_params_size = req_size + RMAKER_PARAMS_SIZE_MARGIN; /* Keeping some margin since paramater value size can change */
-        node_params_buf = esp_rmaker_param_get_buf(max_node_params_size);
-        if (!node_params_buf) {
-            return ESP_ERR_NO_MEM;
-        }
-        req_size = max_node_params_size;
-        err = esp_rmaker_populate_params(node_params_buf, &req_size, flags, reset_flags);
-        if (err != ESP_OK) {
-            ESP_LOGE(TAG, "Failed to populate node parameters.");
-        }
+    esp_rmaker_mqtt_topic_id_t topic_id;
+    if (flags == RMAKER_PARAM_FLAG_VALUE_CHANGE) {
+        topic_id = ESP_RMAKER_MQTT_TOPIC_PARAMS_LOCAL;
+        ESP_LOGI(TAG, "Reporting params: %s", jbuf->buf);
+    } else if (flags == RMAKER_PARAM_FLAG_VALUE_NOTIFY) {
+        topic_id = ESP_RMAKER_MQTT_TOPIC_PARAMS_ALERT;
+        ESP_LOGI(TAG, "Notifying params: %s", jbuf->buf);
+    } else {
+        return ESP_FAIL;
     }
-    return err;
+    if (esp_rmaker_params_mqtt_init_done) {
+        esp_rmaker_mqtt_publish(esp_rmaker_mqtt_get_topic(topic_id), jbuf->buf, jbuf->len, RMAKER_MQTT_QOS1, NULL);
+    } else {
+        ESP_LOGW(TAG, "Not reporting params since params mqtt not initialized yet.");
+    }
+    return ESP_OK;
 }
 
 static esp_err_t esp_rmaker_report_param_internal(uint8_t flags)
 {
+    if (esp_rmaker_node_params_lock() != ESP_OK) {
+        return ESP_ERR_NO_MEM;
+    }
     esp_err_t err = esp_rmaker_allocate_and_populate_params(flags, true);
     if (err == ESP_OK) {
-        /* Just checking if there are indeed any params to report by comparing with a decent enough
-         * length as even the smallest possible data, Eg. '{"d":{"p":0}}' will be > 10 bytes.
-         */
-        char *node_params_buf = esp_rmaker_param_get_buf(0);
-        if (strlen(node_params_buf) > 10) {
-            if (flags == RMAKER_PARAM_FLAG_VALUE_CHANGE) {
-                esp_rmaker_create_mqtt_topic(publish_topic, sizeof(publish_topic), NODE_PARAMS_LOCAL_TOPIC_SUFFIX, NODE_PARAMS_LOCAL_TOPIC_RULE);
-                ESP_LOGI(TAG, "Reporting params: %s", node_params_buf);
-            } else if (flags == RMAKER_PARAM_FLAG_VALUE_NOTIFY) {
-                esp_rmaker_create_mqtt_topic(publish_topic, sizeof(publish_topic), NODE_PARAMS_ALERT_TOPIC_SUFFIX, NODE_PARAMS_ALERT_TOPIC_RULE);
-                ESP_LOGI(TAG, "Notifying params: %s", node_params_buf);
-            } else {
-                return ESP_FAIL;
+        err = esp_rmaker_publish_params(&node_params_jbuf, flags);
+    }
+    esp_rmaker_node_params_unlock();
+    return err;
+}
+
+static void esp_rmaker_populate_device_notify_params(_esp_rmaker_device_t *device,
+        json_gen_str_t *alert_jptr, json_gen_str_t *state_jptr)
+{
+    bool alert_device_added = false;
+    bool state_device_added = false;
+    _esp_rmaker_param_t *param = device->dirty_params;
+    while (param) {
+        if (param->flags & RMAKER_PARAM_FLAG_VALUE_NOTIFY) {
+            if (!alert_device_added) {
+                json_gen_push_object(alert_jptr, device->name);
+                alert_device_added = true;
             }
-            if (esp_rmaker_params_mqtt_init_done) {
-                esp_rmaker_mqtt_publish(publish_topic, node_params_buf, strlen(node_params_buf), RMAKER_MQTT_QOS1, NULL);
-            } else {
-                ESP_LOGW(TAG, "Not reporting params since params mqtt not initialized yet.");
+            esp_rmaker_report_value(&param->val, param->name, alert_jptr);
+        }
+        if (param->flags & RMAKER_PARAM_FLAG_VALUE_CHANGE) {
+            if (!state_device_added) {
+                json_gen_push_object(state_jptr, device->name);
+                state_device_added = true;
             }
+            esp_rmaker_report_value(&param->val, param->name, state_jptr);
         }
-        return ESP_OK;
+        param = param->dirty_next;
+    }
+    if (alert_device_added) {
+        json_gen_pop_object(alert_jptr);
+    }
+    if (state_device_added) {
+        json_gen_pop_object(state_jptr);
     }
-    return err;
 }
 
+/* Generates the alert payload (params with the notify flag) and the params report (params with
+ * the value change flag) together, from a single walk of the node's dirty list.
+ */
+static esp_err_t esp_rmaker_populate_notify_params(void)
+{
+    _esp_rmaker_node_t *node = (_esp_rmaker_node_t *)esp_rmaker_get_node();
+    if (!node) {
+        ESP_LOGE(TAG, "Node handle cannot be NULL.");
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_err_t err = esp_rmaker_json_buf_reserve(&node_params_jbuf, CONFIG_ESP_RMAKER_MAX_PARAM_DATA_SIZE);
+    if (err != ESP_OK) {
+        return err;
+    }
+    char alert_chunk[ESP_RMAKER_JSON_CHUNK_SIZE];
+    char state_chunk[ESP_RMAKER_JSON_CHUNK_SIZE];
+    json_gen_str_t alert_jstr, state_jstr;
+    esp_rmaker_json_buf_start(&node_alert_jbuf, &alert_jstr, alert_chunk, sizeof(alert_chunk));
+    esp_rmaker_json_buf_start(&node_params_jbuf, &state_jstr, state_chunk, sizeof(state_chunk));
+    json_gen_start_object(&alert_jstr);
+    json_gen_start_object(&state_jstr);
+    _esp_rmaker_device_t *device = node->dirty_devices;
+    while (device) {
+        esp_rmaker_populate_device_notify_params(device, &alert_jstr, &state_jstr);
+        device = device->dirty_next;
+    }
+    json_gen_end_object(&alert_jstr);
+    json_gen_end_object(&state_jstr);
+    esp_err_t alert_err = esp_rmaker_json_buf_end(&node_alert_jbuf, &alert_jstr);
+    err = esp_rmaker_json_buf_end(&node_params_jbuf, &state_jstr);
+    if ((alert_err != ESP_OK) || (err != ESP_OK)) {
+        ESP_LOGE(TAG, "Failed to generate Node params JSON.");
+        return (alert_err != ESP_OK) ? alert_err : err;
+    }
+    esp_rmaker_reset_param_flags(node, RMAKER_PARAM_FLAG_VALUE_NOTIFY | RMAKER_PARAM_FLAG_VALUE_CHANGE);
+    return ESP_OK;
+}
 
-static esp_err_t esp_rmaker_device_set_params(_esp_rmaker_device_t *device, jparse_ctx_t *jptr, esp_rmaker_req_src_t src)
+static char *esp_rmaker_param_scratch_get(esp_rmaker_req_src_t src, size_t size)
 {
-    _esp_rmaker_param_t *param = device->params;
-    while (param) {
-        esp_rmaker_param_val_t new_val = {0};
-        bool param_found = false;
-        switch(param->val.type) {
-            case RMAKER_VAL_TYPE_BOOLEAN:
-                if (json_obj_get_bool(jptr, param->name, &new_val.val.b) == 0) {
-                    new_val.type = RMAKER_VAL_TYPE_BOOLEAN;
-                    param_found = true;
-                }
+    if ((src >= ESP_RMAKER_REQ_SRC_MAX) || set_params_scratch[src].in_use) {
+        /* Nested request from the same source. Fall back to a temporary allocation */
+        param_alloc_stats.scratch_allocs++;
+        return MEM_CALLOC_EXTRAM(1, size);
+    }
+    esp_rmaker_param_scratch_t *scratch = &set_params_scratch[src];
+    if (scratch->size < size) {
+        size_t buf_size = (size + RMAKER_PARAM_VAL_BUF_ALIGN - 1) & ~(RMAKER_PARAM_VAL_BUF_ALIGN - 1);
+        char *buf = MEM_CALLOC_EXTRAM(1, buf_size);
+        if (!buf) {
+            return NULL;
+        }
+        if (scratch->buf) {
+            free(scratch->buf);
+        }
+        scratch->buf = buf;
+        scratch->size = buf_size;
+        param_alloc_stats.scratch_allocs++;
+    } else {
+        param_alloc_stats.scratch_reuses++;
+    }
+    scratch->in_use = true;
+    return scratch->buf;
+}
+
+static void esp_rmaker_param_scratch_put(esp_rmaker_req_src_t src, char *buf)
+{
+    if ((src < ESP_RMAKER_REQ_SRC_MAX) && set_params_scratch[src].in_use
+            && (set_params_scratch[src].buf == buf)) {
+        set_params_scratch[src].in_use = false;
+    } else {
+        free(buf);
+    }
+}
+
+/* Kind of a JSON value token, as per its type */
+typedef enum {
+    RMAKER_JSON_VAL_PRIMITIVE,
+    RMAKER_JSON_VAL_STRING,
+    RMAKER_JSON_VAL_OBJECT,
+    RMAKER_JSON_VAL_ARRAY,
+} esp_rmaker_json_val_kind_t;
+
+static esp_rmaker_json_val_kind_t esp_rmaker_json_val_kind(json_tok_t *tok)
+{
+    switch (tok->type) {
+        case JSMN_STRING:
+            return RMAKER_JSON_VAL_STRING;
+        case JSMN_OBJECT:
+            return RMAKER_JSON_VAL_OBJECT;
+        case JSMN_ARRAY:
+            return RMAKER_JSON_VAL_ARRAY;
+        default:
+            return RMAKER_JSON_VAL_PRIMITIVE;
+    }
+}
+
+/* Copies a primitive value token into buf, for parsing it with the standard library functions */
+static bool esp_rmaker_json_primitive_str(jparse_ctx_t *jctx, json_tok_t *tok, char *buf, size_t buf_size)
+{
+    int len = tok->end - tok->start;
+    if ((esp_rmaker_json_val_kind(tok) != RMAKER_JSON_VAL_PRIMITIVE) || (len <= 0)
+            || (len >= (int)buf_size)) {
+        return false;
+    }
+    memcpy(buf, jctx->js + tok->start, len);
+    buf[len] = '\0';
+    return true;
+}
+
+/* Gets the new value of the param from its value token in the payload. The token is read directly,
+ * instead of looking up the param name again, since the caller already has it from walking the keys.
+ * Returns ESP_ERR_NOT_FOUND if the value is not of the type of the param.
+ * The value should be released using esp_rmaker_param_put_new_val().
+ */
+static esp_err_t esp_rmaker_param_get_new_val(_esp_rmaker_param_t *param, jparse_ctx_t *jptr,
+        json_tok_t *val_tok, esp_rmaker_req_src_t src, esp_rmaker_param_val_t *new_val)
+{
+    char num_str[32];
+    char *end_ptr = NULL;
+    esp_rmaker_json_val_kind_t kind = esp_rmaker_json_val_kind(val_tok);
+    switch(param->val.type) {
+        case RMAKER_VAL_TYPE_BOOLEAN:
+            if (!esp_rmaker_json_primitive_str(jptr, val_tok, num_str, sizeof(num_str))) {
                 break;
-            case RMAKER_VAL_TYPE_INTEGER:
-                if (json_obj_get_int(jptr, param->name, &new_val.val.i) == 0) {
-                    new_val.type = RMAKER_VAL_TYPE_INTEGER;
-                    param_found = true;
-                }
+            }
+            if (strcmp(num_str, "true") == 0) {
+                new_val->val.b = true;
+            } else if (strcmp(num_str, "false") == 0) {
+                new_val->val.b = false;
+            } else {
                 break;
-            case RMAKER_VAL_TYPE_FLOAT:
-                if (json_obj_get_float(jptr, param->name, &new_val.val.f) == 0) {
-                    new_val.type = RMAKER_VAL_TYPE_FLOAT;
-                    param_found = true;
-                }
+            }
+            new_val->type = RMAKER_VAL_TYPE_BOOLEAN;
+            return ESP_OK;
+        case RMAKER_VAL_TYPE_INTEGER:
+            if (!esp_rmaker_json_primitive_str(jptr, val_tok, num_str, sizeof(num_str))) {
                 break;
-            case RMAKER_VAL_TYPE_STRING: {
-                int val_size = 0;
-                if (json_obj_get_strlen(jptr, param->name, &val_size) == 0) {
-                    val_size++; /* For NULL termination */
-                    new_val.val.s = MEM_CALLOC_EXTRAM(1, val_size);
-                    if (!new_val.val.s) {
-                        return ESP_ERR_NO_MEM;
-                    }
-                    json_obj_get_string(jptr, param->name, new_val.val.s, val_size);
-                    new_val.type = RMAKER_VAL_TYPE_STRING;
-                    param_found = true;
-                }
+            }
+            new_val->val.i = (int)strtol(num_str, &end_ptr, 10);
+            if (*end_ptr != '\0') {
                 break;
             }
-            case RMAKER_VAL_TYPE_OBJECT: {
-                int val_size = 0;
-                if (json_obj_get_object_strlen(jptr, param->name, &val_size) == 0) {
-                    val_size++; /* For NULL termination */
-                    new_val.val.s = MEM_CALLOC_EXTRAM(1, val_size);
-                    if (!new_val.val.s) {
-                        return ESP_ERR_NO_MEM;
-                    }
-                    json_obj_get_object_str(jptr, param->name, new_val.val.s, val_size);
-                    new_val.type = RMAKER_VAL_TYPE_OBJECT;
-                    param_found = true;
-                }
+            new_val->type = RMAKER_VAL_TYPE_INTEGER;
+            return ESP_OK;
+        case RMAKER_VAL_TYPE_FLOAT:
+            if (!esp_rmaker_json_primitive_str(jptr, val_tok, num_str, sizeof(num_str))) {
                 break;
             }
-            case RMAKER_VAL_TYPE_ARRAY: {
-                int val_size = 0;
-                if (json_obj_get_array_strlen(jptr, param->name, &val_size) == 0) {
-                    val_size++; /* For NULL termination */
-                    new_val.val.s = MEM_CALLOC_EXTRAM(1, val_size);
-                    if (!new_val.val.s) {
-                        return ESP_ERR_NO_MEM;
-                    }
-                    json_obj_get_array_str(jptr, param->name, new_val.val.s, val_size);
-                    new_val.type = RMAKER_VAL_TYPE_ARRAY;
-                    param_found = true;
-                }
+            new_val->val.f = strtof(num_str, &end_ptr);
+            if (*end_ptr != '\0') {
                 break;
             }
-            default:
+            new_val->type = RMAKER_VAL_TYPE_FLOAT;
+            return ESP_OK;
+        case RMAKER_VAL_TYPE_STRING:
+        case RMAKER_VAL_TYPE_OBJECT:
+        case RMAKER_VAL_TYPE_ARRAY: {
+            esp_rmaker_json_val_kind_t expected = (param->val.type == RMAKER_VAL_TYPE_STRING) ? RMAKER_JSON_VAL_STRING :
+                    (param->val.type == RMAKER_VAL_TYPE_OBJECT) ? RMAKER_JSON_VAL_OBJECT : RMAKER_JSON_VAL_ARRAY;
+            if (kind != expected) {
                 break;
+            }
+            /* Copied as is, like the json_obj_get_*_str() APIs */
+            int val_size = val_tok->end - val_tok->start + 1; /* For NULL termination */
+            new_val->val.s = esp_rmaker_param_scratch_get(src, val_size);
+            if (!new_val->val.s) {
+                return ESP_ERR_NO_MEM;
+            }
+            memcpy(new_val->val.s, jptr->js + val_tok->start, val_size - 1);
+            new_val->val.s[val_size - 1] = '\0';
+            new_val->type = param->val.type;
+            return ESP_OK;
+        }
+        default:
+            break;
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+static void esp_rmaker_param_put_new_val(esp_rmaker_req_src_t src, esp_rmaker_param_val_t *new_val)
+{
+    if ((new_val->type == RMAKER_VAL_TYPE_STRING) || (new_val->type == RMAKER_VAL_TYPE_OBJECT ||
+                (new_val->type == RMAKER_VAL_TYPE_ARRAY))) {
+        if (new_val->val.s) {
+            esp_rmaker_param_scratch_put(src, new_val->val.s);
         }
-        if (param_found) {
-            /* Special handling for ESP_RMAKER_PARAM_NAME. Just update the name instead
-             * of calling the registered callback.
-             */
-            if (param->type && (strcmp(param->type, ESP_RMAKER_PARAM_NAME) == 0)) {
+    }
+}
+
+/* Special handling for ESP_RMAKER_PARAM_NAME. Just update the name instead of calling the registered
+ * callback, unless CONFIG_RMAKER_NAME_PARAM_CB is set.
+ */
+static bool esp_rmaker_param_is_name_param(_esp_rmaker_param_t *param)
+{
 #ifdef CONFIG_RMAKER_NAME_PARAM_CB
-                if (device->write_cb) {
-                    esp_rmaker_write_ctx_t ctx = {
-                        .src = src,
-                    };
-                    device->write_cb((esp_rmaker_device_t *)device, (esp_rmaker_param_t *)param,
-                                new_val, device->priv_data, &ctx);
-                } else {
-                    esp_rmaker_param_update_and_report((esp_rmaker_param_t *)param, new_val);
-                }
+    return false;
 #else
-                esp_rmaker_param_update_and_report((esp_rmaker_param_t *)param, new_val);
+    return param->type && (strcmp(param->type, ESP_RMAKER_PARAM_NAME) == 0);
 #endif
-            } else if (device->write_cb) {
-                esp_rmaker_write_ctx_t ctx = {
-                    .src = src,
-                };
-                if (device->write_cb((esp_rmaker_device_t *)device, (esp_rmaker_param_t *)param,
-                            new_val, device->priv_data, &ctx) != ESP_OK) {
-                    ESP_LOGE(TAG, "Remote update to param %s - %s failed", device->name, param->name);
-                }
-            }
-            if ((new_val.type == RMAKER_VAL_TYPE_STRING) || (new_val.type == RMAKER_VAL_TYPE_OBJECT ||
-                        (new_val.type == RMAKER_VAL_TYPE_ARRAY))) {
-                if (new_val.val.s) {
-                    free(new_val.val.s);
-                }
+}
+
+static void esp_rmaker_device_write_param(_esp_rmaker_device_t *device, _esp_rmaker_param_t *param,
+        esp_rmaker_param_val_t new_val, esp_rmaker_req_src_t src)
+{
+    if (esp_rmaker_param_is_name_param(param)) {
+        esp_rmaker_param_update_and_report((esp_rmaker_param_t *)param, new_val);
+    } else if (device->write_cb) {
+        esp_rmaker_write_ctx_t ctx = {
+            .src = src,
+        };
+        if (device->write_cb((esp_rmaker_device_t *)device, (esp_rmaker_param_t *)param,
+                    new_val, device->priv_data, &ctx) != ESP_OK) {
+            ESP_LOGE(TAG, "Remote update to param %s - %s failed", device->name, param->name);
+        }
+    } else if (param->type && (strcmp(param->type, ESP_RMAKER_PARAM_NAME) == 0)) {
+        esp_rmaker_param_update_and_report((esp_rmaker_param_t *)param, new_val);
+    }
+}
+
+static esp_err_t esp_rmaker_device_set_param(_esp_rmaker_device_t *device, _esp_rmaker_param_t *param,
+        jparse_ctx_t *jptr, json_tok_t *val_tok, esp_rmaker_req_src_t src)
+{
+    esp_rmaker_param_val_t new_val = {0};
+    esp_err_t err = esp_rmaker_param_get_new_val(param, jptr, val_tok, src, &new_val);
+    if (err == ESP_ERR_NOT_FOUND) {
+        return ESP_OK;
+    } else if (err != ESP_OK) {
+        return err;
+    }
+    esp_rmaker_device_write_param(device, param, new_val, src);
+    esp_rmaker_param_put_new_val(src, &new_val);
+    return ESP_OK;
+}
+
+/* json_parser does not have an API to iterate over the keys of an object and so, the tokens
+ * are walked directly. All the tokens nested within a token start before the token ends.
+ */
+static json_tok_t *esp_rmaker_json_skip_token(jparse_ctx_t *jctx, json_tok_t *tok)
+{
+    json_tok_t *last = jctx->tokens + jctx->num_tokens;
+    json_tok_t *next = tok + 1;
+    while ((next < last) && (next->start < tok->end)) {
+        next++;
+    }
+    return next;
+}
+
+/* Returns the first key of the object if key is NULL, else the key following the given key.
+ * Returns NULL if there are no more keys. A key is returned only if its value is also present,
+ * so that key + 1, which is the value of the key, can be accessed by the callers.
+ */
+static json_tok_t *esp_rmaker_json_obj_next_key(jparse_ctx_t *jctx, json_tok_t *obj, json_tok_t *key)
+{
+    if (obj->type != JSMN_OBJECT) {
+        return NULL;
+    }
+    json_tok_t *last = jctx->tokens + jctx->num_tokens;
+    json_tok_t *next = key ? esp_rmaker_json_skip_token(jctx, key + 1) : obj + 1;
+    if ((next + 1 >= last) || (next->start >= obj->end) || ((next + 1)->start >= obj->end)) {
+        return NULL;
+    }
+    return next;
+}
+
+static void esp_rmaker_device_bulk_write(_esp_rmaker_device_t *device, esp_rmaker_param_write_req_t write_req[],
+        uint8_t count, esp_rmaker_req_src_t src)
+{
+    esp_rmaker_write_ctx_t ctx = {
+        .src = src,
+    };
+    if (device->bulk_write_cb((esp_rmaker_device_t *)device, write_req, count,
+                device->priv_data, &ctx) != ESP_OK) {
+        ESP_LOGE(TAG, "Remote update to params of %s failed", device->name);
+    }
+}
+
+static void esp_rmaker_device_bulk_write_and_put(_esp_rmaker_device_t *device, esp_rmaker_param_write_req_t write_req[],
+        uint8_t count, esp_rmaker_req_src_t src)
+{
+    esp_rmaker_device_bulk_write(device, write_req, count, src);
+    for (uint8_t i = 0; i < count; i++) {
+        esp_rmaker_param_put_new_val(src, &write_req[i].val);
+    }
+}
+
+/* All the params of the device present in the payload are passed to the bulk write callback
+ * in a single invocation (or more, only if there are more than ESP_RMAKER_BULK_WRITE_MAX_PARAMS).
+ */
+static esp_err_t esp_rmaker_device_bulk_set_params(_esp_rmaker_device_t *device, jparse_ctx_t *jptr, esp_rmaker_req_src_t src)
+{
+    esp_rmaker_param_write_req_t write_req[ESP_RMAKER_BULK_WRITE_MAX_PARAMS];
+    uint8_t count = 0;
+    esp_err_t err = ESP_OK;
+    json_tok_t *obj = jptr->cur;
+    json_tok_t *key = esp_rmaker_json_obj_next_key(jptr, obj, NULL);
+    for (; key; key = esp_rmaker_json_obj_next_key(jptr, obj, key)) {
+        _esp_rmaker_param_t *param = esp_rmaker_hash_get(&device->param_index,
+                jptr->js + key->start, key->end - key->start);
+        if (!param) {
+            continue;
+        }
+        esp_rmaker_param_val_t new_val = {0};
+        /* key + 1 is the value of the key */
+        err = esp_rmaker_param_get_new_val(param, jptr, key + 1, src, &new_val);
+        if (err == ESP_ERR_NOT_FOUND) {
+            err = ESP_OK;
+            continue;
+        } else if (err != ESP_OK) {
+            break;
+        }
+        if (esp_rmaker_param_is_name_param(param)) {
+            esp_rmaker_param_update_and_report((esp_rmaker_param_t *)param, new_val);
+            esp_rmaker_param_put_new_val(src, &new_val);
+            continue;
+        }
+        write_req[count].param = (esp_rmaker_param_t *)param;
+        write_req[count].val = new_val;
+        if (++count == ESP_RMAKER_BULK_WRITE_MAX_PARAMS) {
+            esp_rmaker_device_bulk_write_and_put(device, write_req, count, src);
+            count = 0;
+        }
+    }
+    if (count) {
+        esp_rmaker_device_bulk_write_and_put(device, write_req, count, src);
+    }
+    return err;
+}
+
+static esp_err_t esp_rmaker_device_set_params(_esp_rmaker_device_t *device, jparse_ctx_t *jptr, esp_rmaker_req_src_t src)
+{
+    if (device->bulk_write_cb) {
+        return esp_rmaker_device_bulk_set_params(device, jptr, src);
+    }
+    /* Only the params present in the payload are looked up, using the device's param index */
+    json_tok_t *obj = jptr->cur;
+    json_tok_t *key = esp_rmaker_json_obj_next_key(jptr, obj, NULL);
+    while (key) {
+        _esp_rmaker_param_t *param = esp_rmaker_hash_get(&device->param_index,
+                jptr->js + key->start, key->end - key->start);
+        if (param) {
+            esp_err_t err = esp_rmaker_device_set_param(device, param, jptr, key + 1, src);
+            if (err != ESP_OK) {
+                return err;
             }
         }
-        param = param->next;
+        key = esp_rmaker_json_obj_next_key(jptr, obj, key);
     }
     return ESP_OK;
 }
@@ -394,19 +1001,194 @@ static esp_err_t esp_rmaker_device_set_params(_esp_rmaker_device_t *device, jpar
 esp_err_t esp_rmaker_handle_set_params(char *data, size_t data_len, esp_rmaker_req_src_t src)
 {
     ESP_LOGI(TAG, "Received params: %.*s", data_len, data);
+    _esp_rmaker_node_t *node = (_esp_rmaker_node_t *)esp_rmaker_get_node();
+    if (!node) {
+        ESP_LOGE(TAG, "Node handle cannot be NULL.");
+        return ESP_ERR_INVALID_STATE;
+    }
     jparse_ctx_t jctx;
     if (json_parse_start(&jctx, data, data_len) != 0) {
         return ESP_FAIL;
     }
-    _esp_rmaker_device_t *device = esp_rmaker_node_get_first_device(esp_rmaker_get_node());
-    while (device) {
-        if (json_obj_get_object(&jctx, device->name) == 0) {
+    /* Only the devices present in the payload are looked up, using the node's device index */
+    json_tok_t *root = jctx.cur;
+    if ((jctx.num_tokens < 1) || (root->type != JSMN_OBJECT)) {
+        ESP_LOGE(TAG, "Received params are not a JSON object.");
+        json_parse_end(&jctx);
+        return ESP_FAIL;
+    }
+    json_tok_t *key = esp_rmaker_json_obj_next_key(&jctx, root, NULL);
+    while (key) {
+        _esp_rmaker_device_t *device = esp_rmaker_hash_get(&node->device_index,
+                jctx.js + key->start, key->end - key->start);
+        /* The value of the key is entered directly, rather than looking up the device name again */
+        if (device && (esp_rmaker_json_val_kind(key + 1) == RMAKER_JSON_VAL_OBJECT)) {
+            jctx.cur = key + 1;
             esp_rmaker_device_set_params(device, &jctx, src);
-            json_obj_leave_object(&jctx);
+            jctx.cur = root;
+        }
+        key = esp_rmaker_json_obj_next_key(&jctx, root, key);
+    }
+    json_parse_end(&jctx);
+    return ESP_OK;
+}
+
+/* The params of an action get resolved once and the values get copied, so that performing the action
+ * does not need the JSON to be parsed again. The params are grouped by device, in the order
+ * of the devices in the JSON, so that the entries of a device can be passed as is to its bulk write callback.
+ */
+struct esp_rmaker_param_action {
+    /* Node config generation at the time of compilation. Params may have been removed after it changes. */
+    uint32_t generation;
+    uint16_t count;
+    esp_rmaker_param_write_req_t entries[];
+};
+
+/* Walks the params of the action JSON. Only counts the params if action is NULL, in which case the count
+ * is an upper bound, since params with invalid values get skipped while compiling.
+ */
+static esp_err_t esp_rmaker_param_action_parse(_esp_rmaker_node_t *node, jparse_ctx_t *jctx,
+        esp_rmaker_param_action_t *action, uint16_t *count)
+{
+    esp_err_t err = ESP_OK;
+    *count = 0;
+    json_tok_t *root = jctx->cur;
+    json_tok_t *key = esp_rmaker_json_obj_next_key(jctx, root, NULL);
+    for (; key && (err == ESP_OK); key = esp_rmaker_json_obj_next_key(jctx, root, key)) {
+        _esp_rmaker_device_t *device = esp_rmaker_hash_get(&node->device_index,
+                jctx->js + key->start, key->end - key->start);
+        if (!device || (esp_rmaker_json_val_kind(key + 1) != RMAKER_JSON_VAL_OBJECT)) {
+            continue;
+        }
+        json_tok_t *obj = key + 1;
+        json_tok_t *param_key = esp_rmaker_json_obj_next_key(jctx, obj, NULL);
+        for (; param_key; param_key = esp_rmaker_json_obj_next_key(jctx, obj, param_key)) {
+            _esp_rmaker_param_t *param = esp_rmaker_hash_get(&device->param_index,
+                    jctx->js + param_key->start, param_key->end - param_key->start);
+            if (!param) {
+                continue;
+            }
+            if (!action) {
+                (*count)++;
+                continue;
+            }
+            /* With ESP_RMAKER_REQ_SRC_MAX, the scratch buffers are not used and the values get allocated */
+            esp_rmaker_param_val_t val = {0};
+            err = esp_rmaker_param_get_new_val(param, jctx, param_key + 1, ESP_RMAKER_REQ_SRC_MAX, &val);
+            if (err == ESP_ERR_NOT_FOUND) {
+                /* Skipped, rather than failing the compilation, which would then be re-attempted on every trigger */
+                ESP_LOGW(TAG, "Skipping invalid value for param %s - %s in action", device->name, param->name);
+                err = ESP_OK;
+                continue;
+            } else if (err != ESP_OK) {
+                break;
+            }
+            action->entries[*count].param = (esp_rmaker_param_t *)param;
+            action->entries[*count].val = val;
+            (*count)++;
+        }
+    }
+    return err;
+}
+
+esp_rmaker_param_action_t *esp_rmaker_param_action_compile(const char *data, size_t data_len)
+{
+    _esp_rmaker_node_t *node = (_esp_rmaker_node_t *)esp_rmaker_get_node();
+    if (!node || !data) {
+        return NULL;
+    }
+    /* Captured before parsing, so that any change during the compilation makes the action stale */
+    uint32_t generation = esp_rmaker_node_config_get_generation();
+    jparse_ctx_t jctx;
+    if (json_parse_start(&jctx, (char *)data, data_len) != 0) {
+        ESP_LOGE(TAG, "Failed to parse action: %.*s", data_len, data);
+        return NULL;
+    }
+    esp_rmaker_param_action_t *action = NULL;
+    uint16_t count = 0;
+    /* The first pass just counts the params, to know the size of the action */
+    if (esp_rmaker_param_action_parse(node, &jctx, NULL, &count) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to parse action: %.*s", data_len, data);
+        goto end;
+    }
+    action = MEM_CALLOC_EXTRAM(1, sizeof(esp_rmaker_param_action_t) + count * sizeof(esp_rmaker_param_write_req_t));
+    if (!action) {
+        ESP_LOGE(TAG, "Failed to allocate action with %d params", count);
+        goto end;
+    }
+    action->generation = generation;
+    if (esp_rmaker_param_action_parse(node, &jctx, action, &action->count) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to compile action");
+        esp_rmaker_param_action_free(action);
+        action = NULL;
+    }
+end:
+    json_parse_end(&jctx);
+    return action;
+}
+
+void esp_rmaker_param_action_free(esp_rmaker_param_action_t *action)
+{
+    if (!action) {
+        return;
+    }
+    for (uint16_t i = 0; i < action->count; i++) {
+        esp_rmaker_param_put_new_val(ESP_RMAKER_REQ_SRC_MAX, &action->entries[i].val);
+    }
+    free(action);
+}
+
+esp_err_t esp_rmaker_param_action_perform(esp_rmaker_param_action_t **action, const char *data, size_t data_len,
+        esp_rmaker_req_src_t src)
+{
+    if (!action) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!*action || ((*action)->generation != esp_rmaker_node_config_get_generation())) {
+        esp_rmaker_param_action_free(*action);
+        *action = esp_rmaker_param_action_compile(data, data_len);
+        if (!*action) {
+            /* Fall back to handling the JSON as is */
+            return esp_rmaker_handle_set_params((char *)data, data_len, src);
+        }
+    }
+    esp_rmaker_param_write_req_t *entries = (*action)->entries;
+    uint16_t count = (*action)->count;
+    ESP_LOGI(TAG, "Performing action with %d params", count);
+    uint16_t i = 0;
+    while (i < count) {
+        _esp_rmaker_device_t *device = ((_esp_rmaker_param_t *)entries[i].param)->parent;
+        /* Find the entries of this device */
+        uint16_t end = i + 1;
+        while ((end < count) && (((_esp_rmaker_param_t *)entries[end].param)->parent == device)) {
+            end++;
+        }
+        if (device->bulk_write_cb) {
+            /* Name params are handled internally, like in esp_rmaker_device_bulk_set_params() */
+            uint16_t start = i;
+            for (; i < end; i++) {
+                _esp_rmaker_param_t *param = (_esp_rmaker_param_t *)entries[i].param;
+                if (esp_rmaker_param_is_name_param(param) || ((i - start) == UINT8_MAX)) {
+                    if (i > start) {
+                        esp_rmaker_device_bulk_write(device, &entries[start], i - start, src);
+                    }
+                    start = i;
+                    if (esp_rmaker_param_is_name_param(param)) {
+                        esp_rmaker_param_update_and_report(entries[i].param, entries[i].val);
+                        start = i + 1;
+                    }
+                }
+            }
+            if (end > start) {
+                esp_rmaker_device_bulk_write(device, &entries[start], end - start, src);
+            }
+        } else {
+            for (; i < end; i++) {
+                esp_rmaker_device_write_param(device, (_esp_rmaker_param_t *)entries[i].param, entries[i].val, src);
+            }
         }
-        device = device->next;
+        i = end;
     }
-    json_parse_end(&jctx);
     return ESP_OK;
 }
 
@@ -428,13 +1210,35 @@ static esp_err_t esp_rmaker_register_for_set_params(void)
     return ESP_OK;
 }
 
+/* The handle is opened once and kept open, so that the namespace need not be looked up on every write */
+esp_err_t esp_rmaker_device_get_nvs_handle(_esp_rmaker_device_t *device, nvs_handle *handle)
+{
+    if (!device->persist_handle_open) {
+        esp_err_t err = nvs_open_from_partition(ESP_RMAKER_NVS_PART_NAME, device->name, NVS_READWRITE,
+                &device->persist_handle);
+        if (err != ESP_OK) {
+            return err;
+        }
+        device->persist_handle_open = true;
+    }
+    *handle = device->persist_handle;
+    return ESP_OK;
+}
+
 esp_err_t esp_rmaker_param_get_stored_value(_esp_rmaker_param_t *param, esp_rmaker_param_val_t *val)
 {
     if (!param || !param->parent || !val) {
         return ESP_FAIL;
     }
+    esp_err_t err;
+#ifdef CONFIG_ESP_RMAKER_PARAM_PERSIST_SNAPSHOT
+    err = esp_rmaker_param_snapshot_get_value(param, val);
+    if (err != ESP_ERR_NOT_FOUND) {
+        return err;
+    }
+#endif /* CONFIG_ESP_RMAKER_PARAM_PERSIST_SNAPSHOT */
     nvs_handle handle;
-    esp_err_t err = nvs_open_from_partition(ESP_RMAKER_NVS_PART_NAME, param->parent->name, NVS_READONLY, &handle);
+    err = esp_rmaker_device_get_nvs_handle(param->parent, &handle);
     if (err != ESP_OK) {
         return err;
     }
@@ -466,7 +1270,13 @@ esp_err_t esp_rmaker_param_get_stored_value(_esp_rmaker_param_t *param, esp_rmak
         size_t len = sizeof(esp_rmaker_param_val_t);
         err = nvs_get_blob(handle, param->name, val, &len);
     }
-    nvs_close(handle);
+#ifdef CONFIG_ESP_RMAKER_PARAM_PERSIST_SNAPSHOT
+    /* Value stored in the older per param format. Queue it, so that it gets moved to the snapshot */
+    if (err == ESP_OK) {
+        param->snapshot_migrate = true;
+        esp_rmaker_param_persist(param);
+    }
+#endif /* CONFIG_ESP_RMAKER_PARAM_PERSIST_SNAPSHOT */
     return err;
 }
 
@@ -476,27 +1286,171 @@ esp_err_t esp_rmaker_param_store_value(_esp_rmaker_param_t *param)
         return ESP_FAIL;
     }
     nvs_handle handle;
-    esp_err_t err = nvs_open_from_partition(ESP_RMAKER_NVS_PART_NAME, param->parent->name, NVS_READWRITE, &handle);
+    esp_err_t err = esp_rmaker_device_get_nvs_handle(param->parent, &handle);
     if (err != ESP_OK) {
         return err;
     }
     if ((param->val.type == RMAKER_VAL_TYPE_STRING) || (param->val.type == RMAKER_VAL_TYPE_OBJECT) ||
                 (param->val.type == RMAKER_VAL_TYPE_ARRAY)) {
+        /* The value can be changed by other tasks while it is being written */
+        if ((err = esp_rmaker_param_val_lock()) != ESP_OK) {
+            return err;
+        }
         /* Store only if value is not NULL */
         if (param->val.val.s) {
             err = nvs_set_blob(handle, param->name, param->val.val.s, strlen(param->val.val.s));
             nvs_commit(handle);
+            param_persist_stats.writes++;
         } else {
             err = ESP_OK;
         }
+        esp_rmaker_param_val_unlock();
     } else {
         err = nvs_set_blob(handle, param->name, &param->val, sizeof(esp_rmaker_param_val_t));
         nvs_commit(handle);
+        param_persist_stats.writes++;
+    }
+    return err;
+}
+
+#ifdef CONFIG_ESP_RMAKER_PARAM_PERSIST_WRITE_BEHIND
+static void esp_rmaker_param_persist_work_cb(void *priv_data)
+{
+    esp_rmaker_param_persist_flush();
+}
+
+static void esp_rmaker_param_persist_timer_cb(TimerHandle_t timer)
+{
+    /* Adding to work queue to change the context from timer's task. */
+    esp_rmaker_work_queue_add_task(esp_rmaker_param_persist_work_cb, NULL);
+}
+
+static void esp_rmaker_param_persist_shutdown_handler(void)
+{
+    esp_rmaker_param_persist_flush();
+}
+
+/* Starts the flush timer, if not already running, so that all the values queued till
+ * it expires get written together.
+ */
+static esp_err_t esp_rmaker_param_persist_schedule(void)
+{
+    if (!param_persist_timer) {
+        param_persist_timer = xTimerCreate("param_persist_tm",
+                pdMS_TO_TICKS(CONFIG_ESP_RMAKER_PARAM_PERSIST_FLUSH_MS),
+                pdFALSE, NULL, esp_rmaker_param_persist_timer_cb);
+        if (!param_persist_timer) {
+            ESP_LOGW(TAG, "Failed to create param persist timer. Storing immediately.");
+            return esp_rmaker_param_persist_flush();
+        }
+        /* Pending values should not be lost on a reboot */
+        esp_register_shutdown_handler(esp_rmaker_param_persist_shutdown_handler);
+    }
+    if (xTimerIsTimerActive(param_persist_timer) == pdFALSE) {
+        if (xTimerStart(param_persist_timer, 0) != pdPASS) {
+            return esp_rmaker_param_persist_flush();
+        }
+    }
+    return ESP_OK;
+}
+#endif /* CONFIG_ESP_RMAKER_PARAM_PERSIST_WRITE_BEHIND */
+
+/* Writes the param value to NVS, or queues it for writing later, if write-behind is enabled.
+ * A param already in the queue is not added again, since only its latest value needs to be written.
+ */
+esp_err_t esp_rmaker_param_persist(_esp_rmaker_param_t *param)
+{
+    if (!param->parent) {
+        return ESP_FAIL;
+    }
+    param_persist_stats.requests++;
+#ifdef CONFIG_ESP_RMAKER_PARAM_PERSIST_WRITE_BEHIND
+    bool queued = false;
+    portENTER_CRITICAL(&persist_queue_lock);
+    if (!param->persist_pending) {
+        param->persist_pending = true;
+        param->persist_next = persist_queue;
+        persist_queue = param;
+        queued = true;
+    }
+    portEXIT_CRITICAL(&persist_queue_lock);
+    if (!queued) {
+        param_persist_stats.coalesced++;
+        return ESP_OK;
+    }
+    return esp_rmaker_param_persist_schedule();
+#else
+    return esp_rmaker_param_store_value(param);
+#endif /* CONFIG_ESP_RMAKER_PARAM_PERSIST_WRITE_BEHIND */
+}
+
+esp_err_t esp_rmaker_param_persist_flush(void)
+{
+    esp_err_t err = ESP_OK;
+#ifdef CONFIG_ESP_RMAKER_PARAM_PERSIST_WRITE_BEHIND
+    if (param_persist_timer) {
+        xTimerStop(param_persist_timer, 0);
+    }
+    portENTER_CRITICAL(&persist_queue_lock);
+    _esp_rmaker_param_t *queue = persist_queue;
+    persist_queue = NULL;
+    portEXIT_CRITICAL(&persist_queue_lock);
+    /* The params are dequeued one at a time, so that an update received in the meantime
+     * either gets coalesced (if the param is yet to be written) or queued afresh.
+     */
+    while (queue) {
+        portENTER_CRITICAL(&persist_queue_lock);
+        _esp_rmaker_param_t *param = queue;
+        queue = param->persist_next;
+        param->persist_next = NULL;
+        param->persist_pending = false;
+        portEXIT_CRITICAL(&persist_queue_lock);
+#ifdef CONFIG_ESP_RMAKER_PARAM_PERSIST_SNAPSHOT
+        /* Values of params of devices which are part of the node go into the snapshot */
+        if (param->parent->parent) {
+            param_snapshot_pending = true;
+            continue;
+        }
+#endif /* CONFIG_ESP_RMAKER_PARAM_PERSIST_SNAPSHOT */
+        if (esp_rmaker_param_store_value(param) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to store value of param %s.", param->name);
+            err = ESP_FAIL;
+        }
+    }
+#ifdef CONFIG_ESP_RMAKER_PARAM_PERSIST_SNAPSHOT
+    if (param_snapshot_pending) {
+        if (esp_rmaker_param_snapshot_store() == ESP_OK) {
+            param_snapshot_pending = false;
+            param_persist_stats.writes++;
+        } else {
+            /* Retry after the flush interval */
+            esp_rmaker_param_persist_schedule();
+            err = ESP_FAIL;
+        }
     }
-    nvs_close(handle);
+#endif /* CONFIG_ESP_RMAKER_PARAM_PERSIST_SNAPSHOT */
+#endif /* CONFIG_ESP_RMAKER_PARAM_PERSIST_WRITE_BEHIND */
     return err;
 }
 
+void esp_rmaker_device_persist_deinit(_esp_rmaker_device_t *device)
+{
+    esp_rmaker_param_persist_flush();
+    if (device->persist_handle_open) {
+        nvs_close(device->persist_handle);
+        device->persist_handle_open = false;
+    }
+}
+
+esp_err_t esp_rmaker_param_get_persist_stats(esp_rmaker_param_persist_stats_t *stats)
+{
+    if (!stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *stats = param_persist_stats;
+    return ESP_OK;
+}
+
 esp_rmaker_param_val_t *esp_rmaker_param_get_val(esp_rmaker_param_t *param)
 {
     if (!param) {
@@ -519,6 +1473,25 @@ esp_err_t esp_rmaker_param_delete(const esp_rmaker_param_t *param)
         if (_param->ui_type) {
             free(_param->ui_type);
         }
+#ifdef CONFIG_ESP_RMAKER_TS_BATCHING
+        if (_param->ts_ring) {
+            /* A flush may be walking the ring concurrently */
+            xSemaphoreTake(ts_lock, portMAX_DELAY);
+            struct esp_rmaker_ts_ring *ring = _param->ts_ring;
+            _param->ts_ring = NULL;
+            ts_pending_records -= ring->count;
+            xSemaphoreGive(ts_lock);
+            free(ring);
+        }
+#endif /* CONFIG_ESP_RMAKER_TS_BATCHING */
+        if (_param->read_through) {
+            /* Not freed while a refresh may be invoking its read callback */
+            if (read_through_lock) {
+                xSemaphoreTakeRecursive(read_through_lock, portMAX_DELAY);
+                xSemaphoreGiveRecursive(read_through_lock);
+            }
+            atomic_fetch_sub(&read_through_params, 1);
+        }
         free(_param);
         return ESP_OK;
     }
@@ -563,6 +1536,8 @@ esp_rmaker_param_t *esp_rmaker_param_create(const char *param_name, const char *
              param->val.val.s = strdup(val.val.s);
              if (!param->val.val.s) {
                  ESP_LOGE(TAG, "Failed to allocate memory for the value of param %s.", param_name);
+             } else {
+                 param->val_buf_size = strlen(param->val.val.s) + 1;
              }
         }
     } else {
@@ -607,6 +1582,7 @@ esp_err_t esp_rmaker_param_add_bounds(const esp_rmaker_param_t *param,
         free(_param->bounds);
     }
     _param->bounds = bounds;
+    esp_rmaker_node_config_changed();
     return ESP_OK;
 }
 
@@ -632,7 +1608,8 @@ esp_err_t esp_rmaker_param_add_valid_str_list(const esp_rmaker_param_t *param, c
         free(_param->valid_str_list);
     }
     _param->valid_str_list = valid_str_list;
-  return ESP_OK;
+    esp_rmaker_node_config_changed();
+    return ESP_OK;
 }
 
 esp_err_t esp_rmaker_param_add_array_max_count(const esp_rmaker_param_t *param, int count)
@@ -656,6 +1633,7 @@ esp_err_t esp_rmaker_param_add_array_max_count(const esp_rmaker_param_t *param,
         free(_param->bounds);
     }
     _param->bounds = bounds;
+    esp_rmaker_node_config_changed();
     return ESP_OK;
 }
 
@@ -670,12 +1648,48 @@ esp_err_t esp_rmaker_param_add_ui_type(const esp_rmaker_param_t *param, const ch
         free(_param->ui_type);
     }
     if ((_param->ui_type = strdup(ui_type)) != NULL ) {
+        esp_rmaker_node_config_changed();
         return ESP_OK;
     } else {
         return ESP_ERR_NO_MEM;
     }
 }
 
+/* Should be called with the param value lock held */
+static esp_err_t esp_rmaker_param_update_str(_esp_rmaker_param_t *_param, const char *val)
+{
+    if (!val) {
+        if (_param->val.val.s) {
+            free(_param->val.val.s);
+        }
+        _param->val.val.s = NULL;
+        _param->val_buf_size = 0;
+        return ESP_OK;
+    }
+    size_t len = strlen(val) + 1;
+    if (_param->val.val.s && (len <= _param->val_buf_size)) {
+        /* The new value fits in the existing buffer and so, just overwrite it */
+        if (_param->val.val.s != val) {
+            memmove(_param->val.val.s, val, len);
+        }
+        param_alloc_stats.value_reuses++;
+        return ESP_OK;
+    }
+    size_t buf_size = (len + RMAKER_PARAM_VAL_BUF_ALIGN - 1) & ~(RMAKER_PARAM_VAL_BUF_ALIGN - 1);
+    char *new_val = MEM_CALLOC_EXTRAM(1, buf_size);
+    if (!new_val) {
+        return ESP_FAIL;
+    }
+    memcpy(new_val, val, len);
+    if (_param->val.val.s) {
+        free(_param->val.val.s);
+    }
+    _param->val.val.s = new_val;
+    _param->val_buf_size = buf_size;
+    param_alloc_stats.value_allocs++;
+    return ESP_OK;
+}
+
 esp_err_t esp_rmaker_param_update(const esp_rmaker_param_t *param, esp_rmaker_param_val_t val)
 {
     if (!param) {
@@ -691,17 +1705,15 @@ esp_err_t esp_rmaker_param_update(const esp_rmaker_param_t *param, esp_rmaker_pa
         case RMAKER_VAL_TYPE_STRING:
         case RMAKER_VAL_TYPE_OBJECT:
         case RMAKER_VAL_TYPE_ARRAY: {
-            char *new_val = NULL;
-            if (val.val.s) {
-                new_val = strdup(val.val.s);
-                if (!new_val) {
-                    return ESP_FAIL;
-                }
+            esp_err_t err = esp_rmaker_param_val_lock();
+            if (err != ESP_OK) {
+                return err;
             }
-            if (_param->val.val.s) {
-                free(_param->val.val.s);
+            err = esp_rmaker_param_update_str(_param, val.val.s);
+            esp_rmaker_param_val_unlock();
+            if (err != ESP_OK) {
+                return err;
             }
-            _param->val.val.s = new_val;
             break;
         }
         case RMAKER_VAL_TYPE_BOOLEAN:
@@ -712,12 +1724,79 @@ esp_err_t esp_rmaker_param_update(const esp_rmaker_param_t *param, esp_rmaker_pa
         default:
             return ESP_ERR_INVALID_ARG;
     }
-    _param->flags |= RMAKER_PARAM_FLAG_VALUE_CHANGE;
+    /* A value fetched by a read callback is only returned in the local control response */
+    if (!esp_rmaker_param_is_being_read(_param)) {
+        esp_rmaker_param_set_flags(_param, RMAKER_PARAM_FLAG_VALUE_CHANGE);
+    }
+    esp_rmaker_param_mark_changed(_param);
     if (_param->prop_flags & PROP_FLAG_PERSIST) {
-        esp_rmaker_param_store_value(_param);
+        esp_rmaker_param_persist(_param);
+    }
+    return ESP_OK;
+}
+
+#ifdef CONFIG_ESP_RMAKER_PARAM_REPORT_COALESCE
+static void esp_rmaker_param_report_work_cb(void *priv_data)
+{
+    esp_rmaker_report_param_internal(RMAKER_PARAM_FLAG_VALUE_CHANGE);
+}
+
+static void esp_rmaker_param_report_timer_cb(TimerHandle_t timer)
+{
+    /* Adding to work queue to change the context from timer's task. */
+    esp_rmaker_work_queue_add_task(esp_rmaker_param_report_work_cb, NULL);
+}
+
+/* Starts the coalescing window, if not already running. All the params updated till the window
+ * expires get reported together, since the report includes all params with the value change flag.
+ */
+static esp_err_t esp_rmaker_param_report_schedule(void)
+{
+    if (!param_report_timer) {
+        param_report_timer = xTimerCreate("param_report_tm",
+                pdMS_TO_TICKS(CONFIG_ESP_RMAKER_PARAM_REPORT_COALESCE_WINDOW_MS),
+                pdFALSE, NULL, esp_rmaker_param_report_timer_cb);
+        if (!param_report_timer) {
+            ESP_LOGW(TAG, "Failed to create param report timer. Reporting immediately.");
+            return esp_rmaker_report_param_internal(RMAKER_PARAM_FLAG_VALUE_CHANGE);
+        }
+    }
+    /* The timer is not restarted if already active, so that continuous updates
+     * cannot delay the report beyond the coalescing window.
+     */
+    if (xTimerIsTimerActive(param_report_timer) == pdFALSE) {
+        if (xTimerStart(param_report_timer, 0) != pdPASS) {
+            return esp_rmaker_report_param_internal(RMAKER_PARAM_FLAG_VALUE_CHANGE);
+        }
     }
     return ESP_OK;
 }
+#endif /* CONFIG_ESP_RMAKER_PARAM_REPORT_COALESCE */
+
+/* Returns the open report transaction of the given task, if any. Should be called with param_report_txn_lock held */
+static esp_rmaker_param_report_txn_t *esp_rmaker_param_report_txn_find(TaskHandle_t task)
+{
+    for (int i = 0; i < RMAKER_PARAM_REPORT_TXN_MAX_TASKS; i++) {
+        if (param_report_txns[i].task == task) {
+            return &param_report_txns[i];
+        }
+    }
+    return NULL;
+}
+
+/* Returns true if the report should be deferred due to a report transaction open in the current task */
+static bool esp_rmaker_param_report_txn_defer(void)
+{
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    portENTER_CRITICAL(&param_report_txn_lock);
+    esp_rmaker_param_report_txn_t *txn = esp_rmaker_param_report_txn_find(task);
+    if (txn) {
+        txn->pending = true;
+        param_report_txn_stats.deferred_reports++;
+    }
+    portEXIT_CRITICAL(&param_report_txn_lock);
+    return txn ? true : false;
+}
 
 esp_err_t esp_rmaker_param_report(const esp_rmaker_param_t *param)
 {
@@ -725,9 +1804,109 @@ esp_err_t esp_rmaker_param_report(const esp_rmaker_param_t *param)
         ESP_LOGE(TAG, "Param handle cannot be NULL.");
         return ESP_ERR_INVALID_ARG;
     }
+    if (esp_rmaker_param_report_txn_defer()) {
+        /* The value change flag is already set and so, the param will be reported on commit */
+        return ESP_OK;
+    }
+#ifdef CONFIG_ESP_RMAKER_PARAM_REPORT_COALESCE
+    return esp_rmaker_param_report_schedule();
+#else
+    return esp_rmaker_report_param_internal(RMAKER_PARAM_FLAG_VALUE_CHANGE);
+#endif /* CONFIG_ESP_RMAKER_PARAM_REPORT_COALESCE */
+}
+
+esp_err_t esp_rmaker_param_report_flush(void)
+{
+#ifdef CONFIG_ESP_RMAKER_PARAM_REPORT_COALESCE
+    if (param_report_timer) {
+        xTimerStop(param_report_timer, 0);
+    }
+#endif /* CONFIG_ESP_RMAKER_PARAM_REPORT_COALESCE */
+    if (esp_rmaker_get_state() != ESP_RMAKER_STATE_STARTED) {
+        return ESP_ERR_INVALID_STATE;
+    }
     return esp_rmaker_report_param_internal(RMAKER_PARAM_FLAG_VALUE_CHANGE);
 }
 
+esp_err_t esp_rmaker_param_report_txn_begin(void)
+{
+    esp_err_t err = ESP_OK;
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&param_report_txn_lock);
+    esp_rmaker_param_report_txn_t *txn = esp_rmaker_param_report_txn_find(task);
+    if (!txn && (txn = esp_rmaker_param_report_txn_find(NULL)) != NULL) {
+        /* Outermost transaction of this task */
+        txn->task = task;
+        txn->depth = 0;
+        txn->pending = false;
+        txn->start_us = now;
+    }
+    if (!txn) {
+        err = ESP_ERR_NO_MEM;
+    } else if (txn->depth == UINT16_MAX) {
+        err = ESP_ERR_INVALID_STATE;
+    } else {
+        txn->depth++;
+    }
+    portEXIT_CRITICAL(&param_report_txn_lock);
+    if (err == ESP_ERR_NO_MEM) {
+        ESP_LOGE(TAG, "Too many tasks with open report transactions.");
+    } else if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Too many nested report transactions.");
+    }
+    return err;
+}
+
+esp_err_t esp_rmaker_param_report_txn_commit(void)
+{
+    bool report = false;
+    uint32_t apply_us = 0;
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&param_report_txn_lock);
+    esp_rmaker_param_report_txn_t *txn = esp_rmaker_param_report_txn_find(task);
+    if (!txn) {
+        portEXIT_CRITICAL(&param_report_txn_lock);
+        ESP_LOGE(TAG, "No report transaction to commit.");
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (--txn->depth == 0) {
+        apply_us = (uint32_t)(now - txn->start_us);
+        report = txn->pending;
+        txn->task = NULL;
+        param_report_txn_stats.count++;
+        param_report_txn_stats.last_apply_us = apply_us;
+        if (apply_us > param_report_txn_stats.max_apply_us) {
+            param_report_txn_stats.max_apply_us = apply_us;
+        }
+        param_report_txn_stats.last_report_us = 0;
+    }
+    portEXIT_CRITICAL(&param_report_txn_lock);
+    if (!report) {
+        return ESP_OK;
+    }
+    int64_t report_start_us = esp_timer_get_time();
+    esp_err_t err = esp_rmaker_report_param_internal(RMAKER_PARAM_FLAG_VALUE_CHANGE);
+    uint32_t report_us = (uint32_t)(esp_timer_get_time() - report_start_us);
+    portENTER_CRITICAL(&param_report_txn_lock);
+    param_report_txn_stats.last_report_us = report_us;
+    portEXIT_CRITICAL(&param_report_txn_lock);
+    ESP_LOGD(TAG, "Report transaction committed. Apply: %"PRIu32" us, Report: %"PRIu32" us", apply_us, report_us);
+    return err;
+}
+
+esp_err_t esp_rmaker_param_get_report_txn_stats(esp_rmaker_param_report_txn_stats_t *stats)
+{
+    if (!stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    portENTER_CRITICAL(&param_report_txn_lock);
+    *stats = param_report_txn_stats;
+    portEXIT_CRITICAL(&param_report_txn_lock);
+    return ESP_OK;
+}
+
 static esp_err_t __esp_rmaker_param_report_time_series_records(json_gen_str_t *jptr, const _esp_rmaker_param_t *param)
 {
     json_gen_start_object(jptr);
@@ -760,6 +1939,197 @@ static esp_err_t __esp_rmaker_param_report_time_series(json_gen_str_t *jptr, con
     return ESP_OK;
 }
 
+#ifdef CONFIG_ESP_RMAKER_TS_BATCHING
+static void esp_rmaker_param_ts_populate(json_gen_str_t *jptr, _esp_rmaker_param_t *param)
+{
+    struct esp_rmaker_ts_ring *ring = param->ts_ring;
+    char param_name[MAX_TS_DATA_PARAM_NAME];
+    json_gen_start_object(jptr);
+    snprintf(param_name, sizeof(param_name), "%s.%s", param->parent->name, param->name);
+    json_gen_obj_set_string(jptr, "name", param_name);
+    esp_rmaker_report_data_type(param->val.type, "dt", jptr);
+    json_gen_push_array(jptr, "records");
+    for (uint16_t i = 0; i < ring->count; i++) {
+        esp_rmaker_ts_record_t *record = &ring->records[(ring->head + i) % CONFIG_ESP_RMAKER_TS_BATCH_MAX_RECORDS];
+        json_gen_start_object(jptr);
+        json_gen_obj_set_int(jptr, "t", (int)record->t);
+        esp_rmaker_report_value(&record->val, "v", jptr);
+        json_gen_end_object(jptr);
+    }
+    json_gen_pop_array(jptr);
+    json_gen_end_object(jptr);
+    ring->flush_count = ring->count;
+}
+
+/* Drops the records which were sent, retaining the ones added in the meantime */
+static void esp_rmaker_param_ts_consume(void)
+{
+    _esp_rmaker_device_t *device = esp_rmaker_node_get_first_device(esp_rmaker_get_node());
+    for (; device; device = device->next) {
+        for (_esp_rmaker_param_t *param = device->params; param; param = param->next) {
+            struct esp_rmaker_ts_ring *ring = param->ts_ring;
+            if (ring && ring->flush_count) {
+                ring->head = (ring->head + ring->flush_count) % CONFIG_ESP_RMAKER_TS_BATCH_MAX_RECORDS;
+                ring->count -= ring->flush_count;
+                ts_pending_records -= ring->flush_count;
+                ring->flush_count = 0;
+            }
+        }
+    }
+}
+
+static void esp_rmaker_param_ts_start_timer(void)
+{
+    if (ts_flush_timer && (xTimerIsTimerActive(ts_flush_timer) == pdFALSE)) {
+        xTimerStart(ts_flush_timer, 0);
+    }
+}
+
+esp_err_t esp_rmaker_param_time_series_flush(void)
+{
+    if (!ts_lock) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(ts_lock, portMAX_DELAY);
+    ts_flush_queued = false;
+    if (ts_flush_in_progress || (ts_pending_records == 0)) {
+        xSemaphoreGive(ts_lock);
+        return ESP_OK;
+    }
+    esp_err_t err = esp_rmaker_json_buf_reserve(&ts_data_jbuf, CONFIG_ESP_RMAKER_MAX_PARAM_DATA_SIZE);
+    if (err != ESP_OK) {
+        xSemaphoreGive(ts_lock);
+        return err;
+    }
+    char chunk[ESP_RMAKER_JSON_CHUNK_SIZE];
+    json_gen_str_t jstr;
+    esp_rmaker_json_buf_start(&ts_data_jbuf, &jstr, chunk, sizeof(chunk));
+    json_gen_start_object(&jstr);
+    json_gen_obj_set_string(&jstr, "ts_data_version", TS_DATA_VERSION);
+    json_gen_push_array(&jstr, "ts_data");
+    _esp_rmaker_device_t *device = esp_rmaker_node_get_first_device(esp_rmaker_get_node());
+    for (; device; device = device->next) {
+        for (_esp_rmaker_param_t *param = device->params; param; param = param->next) {
+            if (param->ts_ring && param->ts_ring->count) {
+                esp_rmaker_param_ts_populate(&jstr, param);
+            }
+        }
+    }
+    json_gen_pop_array(&jstr);
+    json_gen_end_object(&jstr);
+    err = esp_rmaker_json_buf_end(&ts_data_jbuf, &jstr);
+    if (err != ESP_OK) {
+        xSemaphoreGive(ts_lock);
+        return err;
+    }
+    /* The lock is not held while publishing, so that records can be added in the meantime */
+    ts_flush_in_progress = true;
+    uint32_t records = ts_pending_records;
+    xSemaphoreGive(ts_lock);
+
+    ESP_LOGI(TAG, "Reporting %"PRIu32" Time Series records.", records);
+    err = esp_rmaker_mqtt_publish(esp_rmaker_mqtt_get_topic(ESP_RMAKER_MQTT_TOPIC_TIME_SERIES_DATA), ts_data_jbuf.buf, ts_data_jbuf.len, RMAKER_MQTT_QOS1, NULL);
+
+    xSemaphoreTake(ts_lock, portMAX_DELAY);
+    ts_flush_in_progress = false;
+    if (err == ESP_OK) {
+        esp_rmaker_param_ts_consume();
+        ts_publish_failed = false;
+    } else {
+        /* Records are retained and will be sent once the timer expires again */
+        ESP_LOGW(TAG, "Failed to report Time Series data. Will retry.");
+        ts_publish_failed = true;
+    }
+    if (ts_pending_records) {
+        esp_rmaker_param_ts_start_timer();
+    }
+    xSemaphoreGive(ts_lock);
+    return err;
+}
+
+static void esp_rmaker_param_ts_flush_work_cb(void *priv_data)
+{
+    esp_rmaker_param_time_series_flush();
+}
+
+static void esp_rmaker_param_ts_timer_cb(TimerHandle_t timer)
+{
+    /* Adding to work queue to change the context from timer's task. */
+    esp_rmaker_work_queue_add_task(esp_rmaker_param_ts_flush_work_cb, NULL);
+}
+
+static esp_err_t esp_rmaker_param_ts_init(void)
+{
+    if (ts_lock) {
+        return ESP_OK;
+    }
+    ts_flush_timer = xTimerCreate("ts_flush_tm", pdMS_TO_TICKS(CONFIG_ESP_RMAKER_TS_BATCH_MAX_AGE * 1000),
+            pdFALSE, NULL, esp_rmaker_param_ts_timer_cb);
+    if (!ts_flush_timer) {
+        ESP_LOGE(TAG, "Failed to create Time Series flush timer.");
+        return ESP_ERR_NO_MEM;
+    }
+    ts_lock = xSemaphoreCreateMutex();
+    if (!ts_lock) {
+        ESP_LOGE(TAG, "Failed to create Time Series lock.");
+        xTimerDelete(ts_flush_timer, portMAX_DELAY);
+        ts_flush_timer = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+/* Adds the current value of the param to its ring buffer and triggers a report if
+ * the buffer has enough records. Else, the report gets triggered by the timer.
+ */
+static esp_err_t esp_rmaker_param_ts_record(_esp_rmaker_param_t *param)
+{
+    xSemaphoreTake(ts_lock, portMAX_DELAY);
+    if (!param->ts_ring) {
+        param->ts_ring = MEM_CALLOC_EXTRAM(1, sizeof(struct esp_rmaker_ts_ring));
+        if (!param->ts_ring) {
+            ESP_LOGE(TAG, "Failed to allocate Time Series buffer for %s.", param->name);
+            xSemaphoreGive(ts_lock);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    struct esp_rmaker_ts_ring *ring = param->ts_ring;
+    if (ring->count == CONFIG_ESP_RMAKER_TS_BATCH_MAX_RECORDS) {
+        ESP_LOGW(TAG, "Time Series buffer for %s full. Dropping oldest record.", param->name);
+        ring->head = (ring->head + 1) % CONFIG_ESP_RMAKER_TS_BATCH_MAX_RECORDS;
+        ring->count--;
+        ts_pending_records--;
+        if (ring->flush_count) {
+            ring->flush_count--;
+        }
+    }
+    time_t current_timestamp = 0;
+    time(&current_timestamp);
+    esp_rmaker_ts_record_t *record = &ring->records[(ring->head + ring->count) % CONFIG_ESP_RMAKER_TS_BATCH_MAX_RECORDS];
+    record->t = (uint32_t)current_timestamp;
+    record->val = param->val;
+    ring->count++;
+    ts_pending_records++;
+    /* While the reports are failing, retries are left to the timer, rather than trying on every record */
+    bool flush = (ring->count >= CONFIG_ESP_RMAKER_TS_BATCH_FLUSH_RECORDS) && !ts_flush_queued && !ts_publish_failed;
+    if (flush) {
+        ts_flush_queued = true;
+    } else {
+        esp_rmaker_param_ts_start_timer();
+    }
+    xSemaphoreGive(ts_lock);
+    if (flush) {
+        return esp_rmaker_work_queue_add_task(esp_rmaker_param_ts_flush_work_cb, NULL);
+    }
+    return ESP_OK;
+}
+#else
+esp_err_t esp_rmaker_param_time_series_flush(void)
+{
+    return ESP_OK;
+}
+#endif /* CONFIG_ESP_RMAKER_TS_BATCHING */
+
 static esp_err_t esp_rmaker_param_report_time_series(const esp_rmaker_param_t *param)
 {
     if (!param) {
@@ -774,32 +2144,45 @@ static esp_err_t esp_rmaker_param_report_time_series(const esp_rmaker_param_t *p
         ESP_LOGE(TAG, "Current time not yet available. Cannot report time series data.");
         return ESP_ERR_INVALID_STATE;
     }
-    /* node_params_buf will be NULL during the first publish */
-    char * node_params_buf = esp_rmaker_param_get_buf(max_node_params_size);
-    if (!node_params_buf) {
+#ifdef CONFIG_ESP_RMAKER_TS_BATCHING
+    /* String values are not buffered, since that would need a copy of each value */
+    if (ts_lock && (((_esp_rmaker_param_t *)param)->val.type != RMAKER_VAL_TYPE_STRING)) {
+        return esp_rmaker_param_ts_record((_esp_rmaker_param_t *)param);
+    }
+#endif /* CONFIG_ESP_RMAKER_TS_BATCHING */
+    if (esp_rmaker_node_params_lock() != ESP_OK) {
         return ESP_ERR_NO_MEM;
     }
-    esp_err_t err;
+    esp_err_t err = esp_rmaker_json_buf_reserve(&node_params_jbuf, CONFIG_ESP_RMAKER_MAX_PARAM_DATA_SIZE);
+    if (err != ESP_OK) {
+        goto end;
+    }
+    char chunk[ESP_RMAKER_JSON_CHUNK_SIZE];
     json_gen_str_t jstr;
-    int buf_len = max_node_params_size;
-    json_gen_str_start(&jstr, node_params_buf, buf_len, NULL, NULL);
+    esp_rmaker_json_buf_start(&node_params_jbuf, &jstr, chunk, sizeof(chunk));
     json_gen_start_object(&jstr);
     json_gen_obj_set_string(&jstr, "ts_data_version", TS_DATA_VERSION);
     json_gen_push_array(&jstr, "ts_data");
     if ((err = __esp_rmaker_param_report_time_series(&jstr, param)) != ESP_OK) {
-        return err;
+        esp_rmaker_json_buf_end(&node_params_jbuf, &jstr);
+        goto end;
     }
     json_gen_pop_array(&jstr);
     json_gen_end_object(&jstr);
-    json_gen_str_end(&jstr);
-    esp_rmaker_create_mqtt_topic(publish_topic, sizeof(publish_topic), TIME_SERIES_DATA_TOPIC_SUFFIX, TIME_SERIES_DATA_TOPIC_RULE);
+    if ((err = esp_rmaker_json_buf_end(&node_params_jbuf, &jstr)) != ESP_OK) {
+        goto end;
+    }
+    char *node_params_buf = node_params_jbuf.buf;
     if (esp_rmaker_params_mqtt_init_done) {
         _esp_rmaker_param_t *_param = (_esp_rmaker_param_t *)param;
         _esp_rmaker_device_t *_device = _param->parent;
         ESP_LOGI(TAG, "Reporting Time Series Data for %s.%s", _device->name, _param->name);
-        esp_rmaker_mqtt_publish(publish_topic, node_params_buf, strlen(node_params_buf), RMAKER_MQTT_QOS1, NULL);
+        esp_rmaker_mqtt_publish(esp_rmaker_mqtt_get_topic(ESP_RMAKER_MQTT_TOPIC_TIME_SERIES_DATA),
+                node_params_buf, node_params_jbuf.len, RMAKER_MQTT_QOS1, NULL);
     }
-    return ESP_OK;
+end:
+    esp_rmaker_node_params_unlock();
+    return err;
 }
 
 esp_err_t esp_rmaker_param_notify(const esp_rmaker_param_t *param)
@@ -808,19 +2191,28 @@ esp_err_t esp_rmaker_param_notify(const esp_rmaker_param_t *param)
         ESP_LOGE(TAG, "Param handle cannot be NULL.");
         return ESP_ERR_INVALID_ARG;
     }
-    ((_esp_rmaker_param_t *)param)->flags |= (RMAKER_PARAM_FLAG_VALUE_CHANGE | RMAKER_PARAM_FLAG_VALUE_NOTIFY);
-    esp_err_t err = esp_rmaker_report_param_internal(RMAKER_PARAM_FLAG_VALUE_NOTIFY);
+    esp_rmaker_param_set_flags((_esp_rmaker_param_t *)param, RMAKER_PARAM_FLAG_VALUE_CHANGE | RMAKER_PARAM_FLAG_VALUE_NOTIFY);
+    if (esp_rmaker_node_params_lock() != ESP_OK) {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t err = esp_rmaker_populate_notify_params();
     if (err != ESP_OK) {
         ESP_LOGW(TAG, "Failed to report parameter");
+    } else {
+        /* The alert goes out first, followed by the params report */
+        esp_rmaker_publish_params(&node_alert_jbuf, RMAKER_PARAM_FLAG_VALUE_NOTIFY);
+        err = esp_rmaker_publish_params(&node_params_jbuf, RMAKER_PARAM_FLAG_VALUE_CHANGE);
     }
-    return esp_rmaker_report_param_internal(RMAKER_PARAM_FLAG_VALUE_CHANGE);
+    esp_rmaker_node_params_unlock();
+    return err;
 }
 
 esp_err_t esp_rmaker_param_update_and_report(const esp_rmaker_param_t *param, esp_rmaker_param_val_t val)
 {
     esp_err_t err = esp_rmaker_param_update(param, val);
-    /** Report parameter only if the RainMaker has started */
-    if ((err == ESP_OK) && (esp_rmaker_get_state() == ESP_RMAKER_STATE_STARTED)) {
+    /** Report parameter only if the RainMaker has started, and not if called from its read callback */
+    if ((err == ESP_OK) && (esp_rmaker_get_state() == ESP_RMAKER_STATE_STARTED) &&
+            !esp_rmaker_param_is_being_read((const _esp_rmaker_param_t *)param)) {
         if (((_esp_rmaker_param_t *)param)->prop_flags & PROP_FLAG_TIME_SERIES) {
             esp_rmaker_param_report_time_series(param);
         }
@@ -832,8 +2224,9 @@ esp_err_t esp_rmaker_param_update_and_report(const esp_rmaker_param_t *param, es
 esp_err_t esp_rmaker_param_update_and_notify(const esp_rmaker_param_t *param, esp_rmaker_param_val_t val)
 {
     esp_err_t err = esp_rmaker_param_update(param, val);
-    /** Report parameter only if the RainMaker has started */
-    if ((err == ESP_OK) && (esp_rmaker_get_state() == ESP_RMAKER_STATE_STARTED)) {
+    /** Report parameter only if the RainMaker has started, and not if called from its read callback */
+    if ((err == ESP_OK) && (esp_rmaker_get_state() == ESP_RMAKER_STATE_STARTED) &&
+            !esp_rmaker_param_is_being_read((const _esp_rmaker_param_t *)param)) {
         if (((_esp_rmaker_param_t *)param)->prop_flags & PROP_FLAG_TIME_SERIES) {
             esp_rmaker_param_report_time_series(param);
         }
@@ -855,30 +2248,35 @@ static esp_err_t esp_rmaker_report_all_ts_params(void)
         }
         device = device->next;
     }
-    return ESP_OK;
+    /* Report the buffered records right away, rather than waiting for the thresholds */
+    return esp_rmaker_param_time_series_flush();
 }
 
 
 esp_err_t esp_rmaker_report_node_state(void)
 {
+    if (esp_rmaker_node_params_lock() != ESP_OK) {
+        return ESP_ERR_NO_MEM;
+    }
     esp_err_t err = esp_rmaker_allocate_and_populate_params(0, false);
     if (err == ESP_OK) {
         /* Just checking if there are indeed any params to report by comparing with a decent enough
          * length as even the smallest possible data, Eg. '{"d":{"p":0}}' will be > 10 bytes.
          */
-        char *node_params_buf = esp_rmaker_param_get_buf(0);
-        if (strlen(node_params_buf) > 10) {
-            esp_rmaker_create_mqtt_topic(publish_topic, sizeof(publish_topic), NODE_PARAMS_LOCAL_INIT_TOPIC_SUFFIX, NODE_PARAMS_LOCAL_INIT_RULE);
+        char *node_params_buf = node_params_jbuf.buf;
+        if (node_params_jbuf.len > 10) {
             ESP_LOGI(TAG, "Reporting params (init): %s", node_params_buf);
             if (esp_rmaker_params_mqtt_init_done) {
-                esp_rmaker_mqtt_publish(publish_topic, node_params_buf, strlen(node_params_buf), RMAKER_MQTT_QOS1, NULL);
+                esp_rmaker_mqtt_publish(esp_rmaker_mqtt_get_topic(ESP_RMAKER_MQTT_TOPIC_PARAMS_LOCAL_INIT), node_params_buf, node_params_jbuf.len, RMAKER_MQTT_QOS1, NULL);
             } else {
                 ESP_LOGW(TAG, "Not reporting params since params mqtt not initialized yet.");
             }
         }
+        esp_rmaker_node_params_unlock();
         /* Report all Time Series Params separately */
         return esp_rmaker_report_all_ts_params();
     }
+    esp_rmaker_node_params_unlock();
     return err;
 }
 
@@ -889,12 +2287,26 @@ esp_err_t esp_rmaker_params_mqtt_init(void)
     if (err == ESP_OK) {
         ESP_LOGI(TAG, "Params MQTT Init done.");
         esp_rmaker_params_mqtt_init_done = true;
+#ifdef CONFIG_ESP_RMAKER_TS_BATCHING
+        if (esp_rmaker_param_ts_init() != ESP_OK) {
+            ESP_LOGW(TAG, "Time Series data will not be batched.");
+        }
+#endif /* CONFIG_ESP_RMAKER_TS_BATCHING */
         /* Report the current node state i.e. values of all the node parameters */
         esp_rmaker_report_node_state();
     }
     return err;
 }
 
+esp_err_t esp_rmaker_param_get_alloc_stats(esp_rmaker_param_alloc_stats_t *stats)
+{
+    if (!stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *stats = param_alloc_stats;
+    return ESP_OK;
+}
+
 char *esp_rmaker_param_get_name(const esp_rmaker_param_t *param)
 {
     if (!param) {
@@ -919,7 +2331,6 @@ esp_err_t esp_rmaker_raise_alert(const char *alert_str)
     strlcpy(msg, alert_str, sizeof(msg));
     char buf[ESP_RMAKER_MAX_ALERT_LEN + RMAKER_ALERT_STR_MARGIN];
     snprintf(buf, sizeof(buf), "{\"%s\":\"%s\"}", ESP_RMAKER_ALERT_KEY, msg);
-    esp_rmaker_create_mqtt_topic(publish_topic, sizeof(publish_topic), NODE_PARAMS_ALERT_TOPIC_SUFFIX, NODE_PARAMS_ALERT_TOPIC_RULE);
     ESP_LOGI(TAG, "Reporting alert: %s", buf);
-    return esp_rmaker_mqtt_publish(publish_topic, buf, strlen(buf), RMAKER_MQTT_QOS1, NULL);
+    return esp_rmaker_mqtt_publish(esp_rmaker_mqtt_get_topic(ESP_RMAKER_MQTT_TOPIC_PARAMS_ALERT), buf, strlen(buf), RMAKER_MQTT_QOS1, NULL);
 }
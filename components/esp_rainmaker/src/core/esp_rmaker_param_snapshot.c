@@ -0,0 +1,502 @@
+/*
+ * SPDX-FileCopyrightText: 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <sdkconfig.h>
+#include <string.h>
+#include <esp_log.h>
+#include <nvs.h>
+#include <esp_rmaker_utils.h>
+#include "esp_rmaker_internal.h"
+#include "esp_rmaker_hash.h"
+
+#ifdef CONFIG_ESP_RMAKER_PARAM_PERSIST_SNAPSHOT
+
+static const char *TAG = "esp_rmaker_param_snapshot";
+
+/* The namespace is deliberately not a valid device name, so that it cannot clash with the
+ * per device namespaces used for the individual param values.
+ */
+#define SNAPSHOT_NVS_NAMESPACE      "rmaker.snapshot"
+#define SNAPSHOT_NVS_KEY            "params"
+#define SNAPSHOT_MAGIC              0x53505052  /* "RPPS" */
+#define SNAPSHOT_VERSION            1
+
+/* The snapshot blob consists of this header, followed by "count" entries of the format:
+ * <u16 device name len><device name><u16 param name len><param name><u8 type><u16 value len><value>
+ * Names and string values are not NULL terminated. Boolean values take 1 byte and
+ * integers/floats take 4 bytes.
+ */
+typedef struct {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t reserved;
+    uint16_t count;
+    uint32_t len;   /* Length of the entries, excluding this header */
+    uint32_t crc;   /* CRC32 of the entries */
+} __attribute__((packed)) esp_rmaker_snapshot_hdr_t;
+
+typedef struct {
+    const char *dev_name;
+    uint16_t dev_name_len;
+    const char *param_name;
+    uint16_t param_name_len;
+    uint8_t type;
+    const uint8_t *val;
+    uint16_t val_len;
+} esp_rmaker_snapshot_entry_t;
+
+/* Last snapshot read from or written to NVS. It is kept as long as it has values of params which are
+ * not part of the node yet (Eg. devices added later), so that those values can be restored when the
+ * params get added and are carried over when a new snapshot is written.
+ */
+static uint8_t *snapshot_buf;
+static bool snapshot_loaded;
+
+/* Index of the entries of snapshot_buf, built once when the snapshot is loaded, so that the value of a param
+ * can be looked up without walking all the entries. Device names map to the index of their params, which map
+ * to the entries. The names are copied, since they are not NULL terminated in the snapshot.
+ */
+typedef struct {
+    const char *name;
+    esp_rmaker_hash_t params;
+} esp_rmaker_snapshot_index_device_t;
+
+typedef struct {
+    const char *name;
+    esp_rmaker_snapshot_entry_t entry;
+} esp_rmaker_snapshot_index_param_t;
+
+static esp_rmaker_hash_t snapshot_index;
+static esp_rmaker_snapshot_index_device_t *snapshot_index_devices;
+static esp_rmaker_snapshot_index_param_t *snapshot_index_params;
+static char *snapshot_index_names;
+
+static uint32_t esp_rmaker_snapshot_crc32(const uint8_t *data, size_t len)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int j = 0; j < 8; j++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (-(crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+static bool esp_rmaker_param_is_str_type(esp_rmaker_val_type_t type)
+{
+    return (type == RMAKER_VAL_TYPE_STRING) || (type == RMAKER_VAL_TYPE_OBJECT) ||
+            (type == RMAKER_VAL_TYPE_ARRAY);
+}
+
+/* Params with NULL string values are not stored, same as the per param NVS keys */
+static bool esp_rmaker_snapshot_includes(_esp_rmaker_param_t *param)
+{
+    if (!(param->prop_flags & PROP_FLAG_PERSIST)) {
+        return false;
+    }
+    if (esp_rmaker_param_is_str_type(param->val.type) && !param->val.val.s) {
+        return false;
+    }
+    return true;
+}
+
+static uint16_t esp_rmaker_snapshot_val_len(_esp_rmaker_param_t *param)
+{
+    switch (param->val.type) {
+        case RMAKER_VAL_TYPE_BOOLEAN:
+            return 1;
+        case RMAKER_VAL_TYPE_INTEGER:
+        case RMAKER_VAL_TYPE_FLOAT:
+            return 4;
+        default:
+            return strlen(param->val.val.s);
+    }
+}
+
+static uint8_t *esp_rmaker_snapshot_put_bytes(uint8_t *ptr, const void *data, uint16_t len)
+{
+    memcpy(ptr, &len, sizeof(len));
+    ptr += sizeof(len);
+    memcpy(ptr, data, len);
+    return ptr + len;
+}
+
+static uint8_t *esp_rmaker_snapshot_put_entry(uint8_t *ptr, _esp_rmaker_param_t *param)
+{
+    ptr = esp_rmaker_snapshot_put_bytes(ptr, param->parent->name, strlen(param->parent->name));
+    ptr = esp_rmaker_snapshot_put_bytes(ptr, param->name, strlen(param->name));
+    *ptr++ = param->val.type;
+    switch (param->val.type) {
+        case RMAKER_VAL_TYPE_BOOLEAN: {
+            uint8_t b = param->val.val.b ? 1 : 0;
+            return esp_rmaker_snapshot_put_bytes(ptr, &b, 1);
+        }
+        case RMAKER_VAL_TYPE_INTEGER: {
+            int32_t i = param->val.val.i;
+            return esp_rmaker_snapshot_put_bytes(ptr, &i, 4);
+        }
+        case RMAKER_VAL_TYPE_FLOAT:
+            return esp_rmaker_snapshot_put_bytes(ptr, &param->val.val.f, 4);
+        default:
+            return esp_rmaker_snapshot_put_bytes(ptr, param->val.val.s, strlen(param->val.val.s));
+    }
+}
+
+static const uint8_t *esp_rmaker_snapshot_get_bytes(const uint8_t *ptr, const uint8_t *end,
+        const uint8_t **data, uint16_t *len)
+{
+    if ((end - ptr) < (int)sizeof(*len)) {
+        return NULL;
+    }
+    memcpy(len, ptr, sizeof(*len));
+    ptr += sizeof(*len);
+    if ((end - ptr) < *len) {
+        return NULL;
+    }
+    *data = ptr;
+    return ptr + *len;
+}
+
+/* Returns pointer to the next entry, or NULL if the entry is malformed */
+static const uint8_t *esp_rmaker_snapshot_get_entry(const uint8_t *ptr, const uint8_t *end,
+        esp_rmaker_snapshot_entry_t *entry)
+{
+    if (!(ptr = esp_rmaker_snapshot_get_bytes(ptr, end, (const uint8_t **)&entry->dev_name, &entry->dev_name_len))) {
+        return NULL;
+    }
+    if (!(ptr = esp_rmaker_snapshot_get_bytes(ptr, end, (const uint8_t **)&entry->param_name, &entry->param_name_len))) {
+        return NULL;
+    }
+    if (ptr >= end) {
+        return NULL;
+    }
+    entry->type = *ptr++;
+    return esp_rmaker_snapshot_get_bytes(ptr, end, &entry->val, &entry->val_len);
+}
+
+static void esp_rmaker_snapshot_index_free(void)
+{
+    if (snapshot_index_devices) {
+        for (uint16_t i = 0; i < snapshot_index.count; i++) {
+            esp_rmaker_hash_deinit(&snapshot_index_devices[i].params);
+        }
+        free(snapshot_index_devices);
+        snapshot_index_devices = NULL;
+    }
+    esp_rmaker_hash_deinit(&snapshot_index);
+    if (snapshot_index_params) {
+        free(snapshot_index_params);
+        snapshot_index_params = NULL;
+    }
+    if (snapshot_index_names) {
+        free(snapshot_index_names);
+        snapshot_index_names = NULL;
+    }
+}
+
+static char *esp_rmaker_snapshot_index_copy_name(char **names, const char *name, uint16_t len)
+{
+    char *copy = *names;
+    memcpy(copy, name, len);
+    copy[len] = '\0';
+    *names += len + 1;
+    return copy;
+}
+
+static esp_err_t esp_rmaker_snapshot_index_build(void)
+{
+    esp_rmaker_snapshot_hdr_t *hdr = (esp_rmaker_snapshot_hdr_t *)snapshot_buf;
+    if (hdr->count == 0) {
+        return ESP_OK;
+    }
+    /* The names take less space than the entries, apart from the NULL terminations */
+    snapshot_index_devices = MEM_CALLOC_EXTRAM(hdr->count, sizeof(esp_rmaker_snapshot_index_device_t));
+    snapshot_index_params = MEM_CALLOC_EXTRAM(hdr->count, sizeof(esp_rmaker_snapshot_index_param_t));
+    snapshot_index_names = MEM_CALLOC_EXTRAM(1, hdr->len + 2 * hdr->count);
+    if (!snapshot_index_devices || !snapshot_index_params || !snapshot_index_names) {
+        goto build_err;
+    }
+    char *names = snapshot_index_names;
+    const uint8_t *ptr = snapshot_buf + sizeof(esp_rmaker_snapshot_hdr_t);
+    const uint8_t *end = ptr + hdr->len;
+    for (uint16_t i = 0; (i < hdr->count) && (ptr < end); i++) {
+        esp_rmaker_snapshot_index_param_t *param = &snapshot_index_params[i];
+        if (!(ptr = esp_rmaker_snapshot_get_entry(ptr, end, &param->entry))) {
+            break;
+        }
+        esp_rmaker_snapshot_index_device_t *device = esp_rmaker_hash_get(&snapshot_index,
+                param->entry.dev_name, param->entry.dev_name_len);
+        if (!device) {
+            device = &snapshot_index_devices[snapshot_index.count];
+            device->name = esp_rmaker_snapshot_index_copy_name(&names, param->entry.dev_name, param->entry.dev_name_len);
+            if (esp_rmaker_hash_add(&snapshot_index, device->name, device) != ESP_OK) {
+                goto build_err;
+            }
+        }
+        param->name = esp_rmaker_snapshot_index_copy_name(&names, param->entry.param_name, param->entry.param_name_len);
+        esp_err_t err = esp_rmaker_hash_add(&device->params, param->name, param);
+        /* For duplicate entries, the first one is used */
+        if ((err != ESP_OK) && (err != ESP_ERR_INVALID_STATE)) {
+            goto build_err;
+        }
+    }
+    return ESP_OK;
+
+build_err:
+    ESP_LOGE(TAG, "Failed to allocate memory for params snapshot index.");
+    esp_rmaker_snapshot_index_free();
+    return ESP_ERR_NO_MEM;
+}
+
+/* Takes over buf as the current snapshot, or releases it if its index cannot be built */
+static void esp_rmaker_snapshot_set_buf(uint8_t *buf)
+{
+    snapshot_buf = buf;
+    if (esp_rmaker_snapshot_index_build() != ESP_OK) {
+        free(snapshot_buf);
+        snapshot_buf = NULL;
+    }
+}
+
+static void esp_rmaker_param_snapshot_load(void)
+{
+    nvs_handle handle;
+    if (nvs_open_from_partition(ESP_RMAKER_NVS_PART_NAME, SNAPSHOT_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        ESP_LOGI(TAG, "No params snapshot found.");
+        return;
+    }
+    size_t len = 0;
+    if (nvs_get_blob(handle, SNAPSHOT_NVS_KEY, NULL, &len) != ESP_OK) {
+        ESP_LOGI(TAG, "No params snapshot found.");
+        goto load_end;
+    }
+    if (len < sizeof(esp_rmaker_snapshot_hdr_t)) {
+        ESP_LOGE(TAG, "Invalid params snapshot of length %d.", len);
+        goto load_end;
+    }
+    uint8_t *buf = MEM_CALLOC_EXTRAM(1, len);
+    if (!buf) {
+        ESP_LOGE(TAG, "Failed to allocate %d bytes for params snapshot.", len);
+        goto load_end;
+    }
+    if (nvs_get_blob(handle, SNAPSHOT_NVS_KEY, buf, &len) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to read params snapshot.");
+        goto load_err;
+    }
+    esp_rmaker_snapshot_hdr_t *hdr = (esp_rmaker_snapshot_hdr_t *)buf;
+    if ((hdr->magic != SNAPSHOT_MAGIC) || (hdr->version != SNAPSHOT_VERSION)) {
+        ESP_LOGE(TAG, "Unsupported params snapshot version %d.", hdr->version);
+        goto load_err;
+    }
+    if ((hdr->len != (len - sizeof(esp_rmaker_snapshot_hdr_t))) ||
+            (hdr->crc != esp_rmaker_snapshot_crc32(buf + sizeof(esp_rmaker_snapshot_hdr_t), hdr->len))) {
+        ESP_LOGE(TAG, "Params snapshot is corrupted.");
+        goto load_err;
+    }
+    ESP_LOGI(TAG, "Loaded params snapshot with %d values.", hdr->count);
+    esp_rmaker_snapshot_set_buf(buf);
+    goto load_end;
+
+load_err:
+    free(buf);
+load_end:
+    nvs_close(handle);
+}
+
+static void esp_rmaker_param_snapshot_load_once(void)
+{
+    /* The snapshot is read from NVS only once, when it is first required */
+    if (!snapshot_loaded) {
+        esp_rmaker_param_snapshot_load();
+        snapshot_loaded = true;
+    }
+}
+
+/* Returns true if the entry is for a param of a device which is currently part of the node */
+static bool esp_rmaker_snapshot_entry_in_node(const _esp_rmaker_node_t *node, esp_rmaker_snapshot_entry_t *entry)
+{
+    _esp_rmaker_device_t *device = esp_rmaker_hash_get(&node->device_index, entry->dev_name, entry->dev_name_len);
+    return device && esp_rmaker_hash_get(&device->param_index, entry->param_name, entry->param_name_len);
+}
+
+esp_err_t esp_rmaker_param_snapshot_get_value(_esp_rmaker_param_t *param, esp_rmaker_param_val_t *val)
+{
+    esp_rmaker_param_snapshot_load_once();
+    if (!snapshot_buf) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    esp_rmaker_snapshot_index_device_t *device = esp_rmaker_hash_get(&snapshot_index,
+            param->parent->name, strlen(param->parent->name));
+    if (!device) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    esp_rmaker_snapshot_index_param_t *index_param = esp_rmaker_hash_get(&device->params,
+            param->name, strlen(param->name));
+    if (!index_param || (index_param->entry.type != param->val.type)) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    esp_rmaker_snapshot_entry_t *entry = &index_param->entry;
+    val->type = param->val.type;
+    switch (param->val.type) {
+        case RMAKER_VAL_TYPE_BOOLEAN:
+            val->val.b = entry->val[0] ? true : false;
+            break;
+        case RMAKER_VAL_TYPE_INTEGER: {
+            int32_t i;
+            memcpy(&i, entry->val, sizeof(i));
+            val->val.i = i;
+            break;
+        }
+        case RMAKER_VAL_TYPE_FLOAT:
+            memcpy(&val->val.f, entry->val, sizeof(val->val.f));
+            break;
+        default: {
+            char *s_val = MEM_CALLOC_EXTRAM(1, entry->val_len + 1);
+            if (!s_val) {
+                return ESP_ERR_NO_MEM;
+            }
+            memcpy(s_val, entry->val, entry->val_len);
+            val->val.s = s_val;
+            break;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_rmaker_param_snapshot_store(void)
+{
+    const _esp_rmaker_node_t *node = (const _esp_rmaker_node_t *)esp_rmaker_get_node();
+    if (!node) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    /* The string values can be changed by other tasks and so, the lengths computed here should remain valid
+     * till the values are copied into the snapshot.
+     */
+    esp_err_t err = esp_rmaker_param_val_lock();
+    if (err != ESP_OK) {
+        return err;
+    }
+    size_t len = 0;
+    uint16_t count = 0;
+    _esp_rmaker_device_t *device;
+    _esp_rmaker_param_t *param;
+    for (device = node->devices; device; device = device->next) {
+        for (param = device->params; param; param = param->next) {
+            if (esp_rmaker_snapshot_includes(param)) {
+                len += (3 * sizeof(uint16_t)) + 1 + strlen(device->name) + strlen(param->name) +
+                        esp_rmaker_snapshot_val_len(param);
+                count++;
+            }
+        }
+    }
+    /* Values of params which are not part of the node (yet) are carried over as is from the older
+     * snapshot, so that they are not lost if the corresponding devices get added later.
+     */
+    esp_rmaker_param_snapshot_load_once();
+    const uint8_t *old_ptr = NULL, *old_end = NULL, *entry_ptr, *next_ptr;
+    esp_rmaker_snapshot_entry_t entry;
+    uint16_t carried_count = 0;
+    if (snapshot_buf) {
+        old_ptr = snapshot_buf + sizeof(esp_rmaker_snapshot_hdr_t);
+        old_end = old_ptr + ((esp_rmaker_snapshot_hdr_t *)snapshot_buf)->len;
+    }
+    for (entry_ptr = old_ptr; entry_ptr && (entry_ptr < old_end); entry_ptr = next_ptr) {
+        if (!(next_ptr = esp_rmaker_snapshot_get_entry(entry_ptr, old_end, &entry))) {
+            break;
+        }
+        if (!esp_rmaker_snapshot_entry_in_node(node, &entry)) {
+            len += next_ptr - entry_ptr;
+            carried_count++;
+        }
+    }
+    uint8_t *buf = MEM_CALLOC_EXTRAM(1, sizeof(esp_rmaker_snapshot_hdr_t) + len);
+    if (!buf) {
+        ESP_LOGE(TAG, "Failed to allocate %d bytes for params snapshot.", sizeof(esp_rmaker_snapshot_hdr_t) + len);
+        esp_rmaker_param_val_unlock();
+        return ESP_ERR_NO_MEM;
+    }
+    uint8_t *ptr = buf + sizeof(esp_rmaker_snapshot_hdr_t);
+    for (device = node->devices; device; device = device->next) {
+        for (param = device->params; param; param = param->next) {
+            if (esp_rmaker_snapshot_includes(param)) {
+                ptr = esp_rmaker_snapshot_put_entry(ptr, param);
+            }
+        }
+    }
+    esp_rmaker_param_val_unlock();
+    for (entry_ptr = old_ptr; entry_ptr && (entry_ptr < old_end); entry_ptr = next_ptr) {
+        if (!(next_ptr = esp_rmaker_snapshot_get_entry(entry_ptr, old_end, &entry))) {
+            break;
+        }
+        if (!esp_rmaker_snapshot_entry_in_node(node, &entry)) {
+            memcpy(ptr, entry_ptr, next_ptr - entry_ptr);
+            ptr += next_ptr - entry_ptr;
+        }
+    }
+    esp_rmaker_snapshot_hdr_t *hdr = (esp_rmaker_snapshot_hdr_t *)buf;
+    hdr->magic = SNAPSHOT_MAGIC;
+    hdr->version = SNAPSHOT_VERSION;
+    hdr->count = count + carried_count;
+    hdr->len = len;
+    hdr->crc = esp_rmaker_snapshot_crc32(buf + sizeof(esp_rmaker_snapshot_hdr_t), len);
+
+    nvs_handle handle;
+    err = nvs_open_from_partition(ESP_RMAKER_NVS_PART_NAME, SNAPSHOT_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open params snapshot namespace.");
+        free(buf);
+        return err;
+    }
+    err = nvs_set_blob(handle, SNAPSHOT_NVS_KEY, buf, sizeof(esp_rmaker_snapshot_hdr_t) + len);
+    if (err == ESP_OK) {
+        err = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to store params snapshot.");
+        free(buf);
+        return err;
+    }
+    /* The values migrated from the per param NVS keys are now in the snapshot and so,
+     * the keys can be erased.
+     */
+    for (device = node->devices; device; device = device->next) {
+        for (param = device->params; param; param = param->next) {
+            if (param->snapshot_migrate) {
+                nvs_handle dev_handle;
+                if (esp_rmaker_device_get_nvs_handle(device, &dev_handle) == ESP_OK) {
+                    nvs_erase_key(dev_handle, param->name);
+                    nvs_commit(dev_handle);
+                }
+                param->snapshot_migrate = false;
+            }
+        }
+    }
+    /* The param values in RAM are the latest now and so, the older snapshot is not required.
+     * The new one is kept only if it has carried over values, which are not available otherwise.
+     */
+    esp_rmaker_param_snapshot_release();
+    if (carried_count) {
+        esp_rmaker_snapshot_set_buf(buf);
+        snapshot_loaded = true;
+    } else {
+        free(buf);
+    }
+    return ESP_OK;
+}
+
+void esp_rmaker_param_snapshot_release(void)
+{
+    esp_rmaker_snapshot_index_free();
+    if (snapshot_buf) {
+        free(snapshot_buf);
+        snapshot_buf = NULL;
+    }
+    snapshot_loaded = false;
+}
+
+#endif /* CONFIG_ESP_RMAKER_PARAM_PERSIST_SNAPSHOT */
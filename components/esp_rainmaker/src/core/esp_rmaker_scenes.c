@@ -35,6 +35,8 @@ static const char *TAG = "esp_rmaker_scenes";
 typedef struct esp_rmaker_scene_action {
     void *data;
     size_t data_len;
+    /* Action compiled from data. Re-compiled on trigger if NULL or stale */
+    esp_rmaker_param_action_t *compiled;
 } esp_rmaker_scene_action_t;
 
 typedef struct esp_rmaker_scene {
@@ -46,6 +48,7 @@ typedef struct esp_rmaker_scene {
     uint32_t flags;
     esp_rmaker_scene_action_t action;
     struct esp_rmaker_scene *next;
+    struct esp_rmaker_scene *prev;
 } esp_rmaker_scene_t;
 
 typedef enum scenes_operation {
@@ -59,6 +62,10 @@ typedef enum scenes_operation {
 
 typedef struct {
     esp_rmaker_scene_t *scenes_list;
+    /* Last scene in the list, for adding new scenes at the end */
+    esp_rmaker_scene_t *scenes_list_tail;
+    /* Scenes by id */
+    esp_rmaker_hash_t id_hash;
     int total_scenes;
     bool deactivate_support;
     esp_rmaker_device_t *scenes_service;
@@ -74,6 +81,7 @@ static void esp_rmaker_scenes_free(esp_rmaker_scene_t *scene)
     if (scene->action.data) {
         free(scene->action.data);
     }
+    esp_rmaker_param_action_free(scene->action.compiled);
     if (scene->info) {
         free(scene->info);
     }
@@ -85,16 +93,9 @@ static esp_rmaker_scene_t *esp_rmaker_scenes_get_scene_from_id(const char *id)
     if (!id) {
         return NULL;
     }
-    esp_rmaker_scene_t *scene = scenes_priv_data->scenes_list;
-    while(scene) {
-        if (strncmp(id, scene->id, sizeof(scene->id)) == 0) {
-            ESP_LOGD(TAG, "Scene with id %s found in list for get.", id);
-            return scene;
-        }
-        scene = scene->next;
-    }
-    ESP_LOGD(TAG, "Scene with id %s not found in list for get.", id);
-    return NULL;
+    esp_rmaker_scene_t *scene = esp_rmaker_hash_get(&scenes_priv_data->id_hash, id, strlen(id));
+    ESP_LOGD(TAG, "Scene with id %s %s in list for get.", id, scene ? "found" : "not found");
+    return scene;
 }
 
 static esp_err_t esp_rmaker_scenes_add_to_list(esp_rmaker_scene_t *scene)
@@ -108,22 +109,19 @@ static esp_err_t esp_rmaker_scenes_add_to_list(esp_rmaker_scene_t *scene)
         ESP_LOGI(TAG, "Scene with id %s already added to list. Not adding again.", scene->id);
         return ESP_FAIL;
     }
-    /* Parse list */
-    esp_rmaker_scene_t *prev_scene = scenes_priv_data->scenes_list;
-    while(prev_scene) {
-        if (prev_scene->next) {
-            prev_scene = prev_scene->next;
-        } else {
-            break;
-        }
+    if (esp_rmaker_hash_add(&scenes_priv_data->id_hash, scene->id, scene) != ESP_OK) {
+        return ESP_ERR_NO_MEM;
     }
 
     /* Add to list */
-    if (prev_scene) {
-        prev_scene->next = scene;
+    scene->next = NULL;
+    scene->prev = scenes_priv_data->scenes_list_tail;
+    if (scene->prev) {
+        scene->prev->next = scene;
     } else {
         scenes_priv_data->scenes_list = scene;
     }
+    scenes_priv_data->scenes_list_tail = scene;
     ESP_LOGD(TAG, "Scene with id %s added to list.", scene->id);
     scenes_priv_data->total_scenes++;
     return ESP_OK;
@@ -135,28 +133,24 @@ static esp_err_t esp_rmaker_scenes_remove_from_list(esp_rmaker_scene_t *scene)
         ESP_LOGE(TAG, "Scene is NULL. Not removing from list.");
         return ESP_ERR_INVALID_ARG;
     }
-    /* Parse list */
-    esp_rmaker_scene_t *curr_scene = scenes_priv_data->scenes_list;
-    esp_rmaker_scene_t *prev_scene = curr_scene;
-    while(curr_scene) {
-        if (strncmp(scene->id, curr_scene->id, sizeof(scene->id)) == 0) {
-            ESP_LOGD(TAG, "Scene with id %s found in list for removing", scene->id);
-            break;
-        }
-        prev_scene = curr_scene;
-        curr_scene = curr_scene->next;
-    }
-    if (!curr_scene) {
+    if (esp_rmaker_scenes_get_scene_from_id(scene->id) != scene) {
         ESP_LOGE(TAG, "Scene with id %s not found in list. Not removing.", scene->id);
         return ESP_ERR_NOT_FOUND;
     }
+    esp_rmaker_hash_remove(&scenes_priv_data->id_hash, scene->id);
 
     /* Remove from list */
-    if (curr_scene == scenes_priv_data->scenes_list) {
-        scenes_priv_data->scenes_list = curr_scene->next;
+    if (scene->prev) {
+        scene->prev->next = scene->next;
     } else {
-        prev_scene->next = curr_scene->next;
+        scenes_priv_data->scenes_list = scene->next;
     }
+    if (scene->next) {
+        scene->next->prev = scene->prev;
+    } else {
+        scenes_priv_data->scenes_list_tail = scene->prev;
+    }
+    scene->next = scene->prev = NULL;
     scenes_priv_data->total_scenes--;
     ESP_LOGD(TAG, "Scene with id %s removed from list.", scene->id);
     return ESP_OK;
@@ -254,6 +248,11 @@ static esp_err_t esp_rmaker_scenes_parse_action(jparse_ctx_t *jctx, esp_rmaker_s
         return ESP_ERR_NO_MEM;
     }
     json_obj_get_object_str(jctx, "action", action->data, action->data_len);
+    /* Compiled here itself so that the JSON need not be parsed when performing the action. If this fails
+     * (Eg. if the devices have not been added yet), it will be attempted again when performing the action.
+     */
+    esp_rmaker_param_action_free(action->compiled);
+    action->compiled = esp_rmaker_param_action_compile(action->data, action->data_len);
     return ESP_OK;
 }
 
@@ -308,6 +307,7 @@ static esp_rmaker_scene_t *esp_rmaker_scenes_find_or_create(jparse_ctx_t *jctx,
 static esp_err_t esp_rmaker_scenes_perform_operation(esp_rmaker_scene_t *scene, scenes_operation_t operation)
 {
     esp_err_t err = ESP_OK;
+    esp_err_t txn_err;
     switch (operation) {
         case OPERATION_ADD:
             if (scenes_priv_data->total_scenes < MAX_SCENES) {
@@ -331,12 +331,23 @@ static esp_err_t esp_rmaker_scenes_perform_operation(esp_rmaker_scene_t *scene,
             break;
 
         case OPERATION_ACTIVATE:
-            err = esp_rmaker_handle_set_params(scene->action.data, scene->action.data_len, ESP_RMAKER_REQ_SRC_SCENE_ACTIVATE);
+            /* The params updated by the scene get reported together */
+            txn_err = esp_rmaker_param_report_txn_begin();
+            err = esp_rmaker_param_action_perform(&scene->action.compiled, scene->action.data, scene->action.data_len,
+                    ESP_RMAKER_REQ_SRC_SCENE_ACTIVATE);
+            if (txn_err == ESP_OK) {
+                esp_rmaker_param_report_txn_commit();
+            }
             break;
 
         case OPERATION_DEACTIVATE:
             if (scenes_priv_data->deactivate_support) {
-                err = esp_rmaker_handle_set_params(scene->action.data, scene->action.data_len, ESP_RMAKER_REQ_SRC_SCENE_DEACTIVATE);
+                txn_err = esp_rmaker_param_report_txn_begin();
+                err = esp_rmaker_param_action_perform(&scene->action.compiled, scene->action.data, scene->action.data_len,
+                        ESP_RMAKER_REQ_SRC_SCENE_DEACTIVATE);
+                if (txn_err == ESP_OK) {
+                    esp_rmaker_param_report_txn_commit();
+                }
             } else {
                 ESP_LOGW(TAG, "Deactivate operation not supported.");
                 err = ESP_ERR_NOT_SUPPORTED;
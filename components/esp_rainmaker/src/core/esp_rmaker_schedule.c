@@ -72,6 +72,8 @@ typedef struct esp_rmaker_schedule_trigger {
 typedef struct esp_rmaker_schedule_action {
     void *data;
     size_t data_len;
+    /* Action compiled from data. Re-compiled on trigger if NULL or stale */
+    esp_rmaker_param_action_t *compiled;
 } esp_rmaker_schedule_action_t;
 
 typedef struct esp_rmaker_schedule {
@@ -81,6 +83,8 @@ typedef struct esp_rmaker_schedule {
     char *info;
     /* Index is used in the callback to get back the schedule. */
     int32_t index;
+    /* Index as a string, used as the key in the index hash */
+    char index_key[12];
     /* Flags are used to identify the schedule. Eg. timing, countdown */
     uint32_t flags;
     bool enabled;
@@ -88,6 +92,7 @@ typedef struct esp_rmaker_schedule {
     esp_rmaker_schedule_action_t action;
     esp_rmaker_schedule_trigger_t trigger;
     struct esp_rmaker_schedule *next;
+    struct esp_rmaker_schedule *prev;
 } esp_rmaker_schedule_t;
 
 enum time_sync_state {
@@ -107,6 +112,11 @@ typedef enum schedule_operation {
 
 typedef struct {
     esp_rmaker_schedule_t *schedule_list;
+    /* Last schedule in the list, for adding new schedules at the end */
+    esp_rmaker_schedule_t *schedule_list_tail;
+    /* Schedules by id and by index */
+    esp_rmaker_hash_t id_hash;
+    esp_rmaker_hash_t index_hash;
     int total_schedules;
     /* This index just increases. This makes sure it is unique for the given schedules */
     int32_t index;
@@ -131,6 +141,7 @@ static void esp_rmaker_schedule_free(esp_rmaker_schedule_t *schedule)
     if (schedule->action.data) {
         free(schedule->action.data);
     }
+    esp_rmaker_param_action_free(schedule->action.compiled);
     if (schedule->info) {
         free(schedule->info);
     }
@@ -142,30 +153,18 @@ static esp_rmaker_schedule_t *esp_rmaker_schedule_get_schedule_from_id(const cha
     if (!id) {
         return NULL;
     }
-    esp_rmaker_schedule_t *schedule = schedule_priv_data->schedule_list;
-    while(schedule) {
-        if (strncmp(id, schedule->id, sizeof(schedule->id)) == 0) {
-            ESP_LOGD(TAG, "Schedule with id %s found in list for get.", id);
-            return schedule;
-        }
-        schedule = schedule->next;
-    }
-    ESP_LOGD(TAG, "Schedule with id %s not found in list for get.", id);
-    return NULL;
+    esp_rmaker_schedule_t *schedule = esp_rmaker_hash_get(&schedule_priv_data->id_hash, id, strlen(id));
+    ESP_LOGD(TAG, "Schedule with id %s %s in list for get.", id, schedule ? "found" : "not found");
+    return schedule;
 }
 
 static esp_rmaker_schedule_t *esp_rmaker_schedule_get_schedule_from_index(int32_t index)
 {
-    esp_rmaker_schedule_t *schedule = schedule_priv_data->schedule_list;
-    while(schedule) {
-        if (schedule->index == index) {
-            ESP_LOGD(TAG, "Schedule with index %"PRIi32" found in list for get.", index);
-            return schedule;
-        }
-        schedule = schedule->next;
-    }
-    ESP_LOGD(TAG, "Schedule with index %"PRIi32" not found in list for get.", index);
-    return NULL;
+    char index_key[sizeof(((esp_rmaker_schedule_t *)0)->index_key)];
+    snprintf(index_key, sizeof(index_key), "%"PRIi32, index);
+    esp_rmaker_schedule_t *schedule = esp_rmaker_hash_get(&schedule_priv_data->index_hash, index_key, strlen(index_key));
+    ESP_LOGD(TAG, "Schedule with index %"PRIi32" %s in list for get.", index, schedule ? "found" : "not found");
+    return schedule;
 }
 
 static esp_err_t esp_rmaker_schedule_add_to_list(esp_rmaker_schedule_t *schedule)
@@ -179,22 +178,24 @@ static esp_err_t esp_rmaker_schedule_add_to_list(esp_rmaker_schedule_t *schedule
         ESP_LOGI(TAG, "Schedule with id %s already added to list. Not adding again.", schedule->id);
         return ESP_FAIL;
     }
-    /* Parse list */
-    esp_rmaker_schedule_t *prev_schedule = schedule_priv_data->schedule_list;
-    while(prev_schedule) {
-        if (prev_schedule->next) {
-            prev_schedule = prev_schedule->next;
-        } else {
-            break;
-        }
+    snprintf(schedule->index_key, sizeof(schedule->index_key), "%"PRIi32, schedule->index);
+    if (esp_rmaker_hash_add(&schedule_priv_data->id_hash, schedule->id, schedule) != ESP_OK) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (esp_rmaker_hash_add(&schedule_priv_data->index_hash, schedule->index_key, schedule) != ESP_OK) {
+        esp_rmaker_hash_remove(&schedule_priv_data->id_hash, schedule->id);
+        return ESP_ERR_NO_MEM;
     }
 
     /* Add to list */
-    if (prev_schedule) {
-        prev_schedule->next = schedule;
+    schedule->next = NULL;
+    schedule->prev = schedule_priv_data->schedule_list_tail;
+    if (schedule->prev) {
+        schedule->prev->next = schedule;
     } else {
         schedule_priv_data->schedule_list = schedule;
     }
+    schedule_priv_data->schedule_list_tail = schedule;
     ESP_LOGD(TAG, "Schedule with id %s added to list.", schedule->id);
     schedule_priv_data->total_schedules++;
     return ESP_OK;
@@ -206,28 +207,25 @@ static esp_err_t esp_rmaker_schedule_remove_from_list(esp_rmaker_schedule_t *sch
         ESP_LOGE(TAG, "Schedule is NULL. Not removing from list.");
         return ESP_ERR_INVALID_ARG;
     }
-    /* Parse list */
-    esp_rmaker_schedule_t *curr_schedule = schedule_priv_data->schedule_list;
-    esp_rmaker_schedule_t *prev_schedule = curr_schedule;
-    while(curr_schedule) {
-        if (strncmp(schedule->id, curr_schedule->id, sizeof(schedule->id)) == 0) {
-            ESP_LOGD(TAG, "Schedule with id %s found in list for removing", schedule->id);
-            break;
-        }
-        prev_schedule = curr_schedule;
-        curr_schedule = curr_schedule->next;
-    }
-    if (!curr_schedule) {
+    if (esp_rmaker_schedule_get_schedule_from_id(schedule->id) != schedule) {
         ESP_LOGE(TAG, "Schedule with id %s not found in list. Not removing.", schedule->id);
         return ESP_ERR_NOT_FOUND;
     }
+    esp_rmaker_hash_remove(&schedule_priv_data->id_hash, schedule->id);
+    esp_rmaker_hash_remove(&schedule_priv_data->index_hash, schedule->index_key);
 
     /* Remove from list */
-    if (curr_schedule == schedule_priv_data->schedule_list) {
-        schedule_priv_data->schedule_list = curr_schedule->next;
+    if (schedule->prev) {
+        schedule->prev->next = schedule->next;
+    } else {
+        schedule_priv_data->schedule_list = schedule->next;
+    }
+    if (schedule->next) {
+        schedule->next->prev = schedule->prev;
     } else {
-        prev_schedule->next = curr_schedule->next;
+        schedule_priv_data->schedule_list_tail = schedule->prev;
     }
+    schedule->next = schedule->prev = NULL;
     schedule_priv_data->total_schedules--;
     ESP_LOGD(TAG, "Schedule with id %s removed from list.", schedule->id);
     return ESP_OK;
@@ -287,7 +285,14 @@ static bool esp_rmaker_schedule_is_expired(esp_rmaker_schedule_t *schedule)
 
 static esp_err_t esp_rmaker_schedule_process_action(esp_rmaker_schedule_action_t *action)
 {
-    return esp_rmaker_handle_set_params(action->data, action->data_len, ESP_RMAKER_REQ_SRC_SCHEDULE);
+    /* The params updated by the action get reported together */
+    esp_err_t txn_err = esp_rmaker_param_report_txn_begin();
+    esp_err_t err = esp_rmaker_param_action_perform(&action->compiled, action->data, action->data_len,
+            ESP_RMAKER_REQ_SRC_SCHEDULE);
+    if (txn_err == ESP_OK) {
+        esp_rmaker_param_report_txn_commit();
+    }
+    return err;
 }
 
 static void esp_rmaker_schedule_trigger_work_cb(void *priv_data)
@@ -570,6 +575,11 @@ static esp_err_t esp_rmaker_schedule_parse_action(jparse_ctx_t *jctx, esp_rmaker
         return ESP_ERR_NO_MEM;
     }
     json_obj_get_object_str(jctx, "action", action->data, action->data_len);
+    /* Compiled here itself so that the JSON need not be parsed when performing the action. If this fails
+     * (Eg. if the devices have not been added yet), it will be attempted again when performing the action.
+     */
+    esp_rmaker_param_action_free(action->compiled);
+    action->compiled = esp_rmaker_param_action_compile(action->data, action->data_len);
     return ESP_OK;
 }
 
@@ -149,9 +149,7 @@ static void esp_rmaker_user_mapping_cb(void *priv_data)
     }
     json_gen_end_object(&jstr);
     json_gen_str_end(&jstr);
-    char publish_topic[MQTT_TOPIC_BUFFER_SIZE];
-    esp_rmaker_create_mqtt_topic(publish_topic, sizeof(publish_topic), USER_MAPPING_TOPIC_SUFFIX, USER_MAPPING_TOPIC_RULE);
-    esp_err_t err = esp_rmaker_mqtt_publish(publish_topic, publish_payload, strlen(publish_payload), RMAKER_MQTT_QOS1, &rmaker_user_mapping_data->mqtt_msg_id);
+    esp_err_t err = esp_rmaker_mqtt_publish(esp_rmaker_mqtt_get_topic(ESP_RMAKER_MQTT_TOPIC_USER_MAPPING), publish_payload, strlen(publish_payload), RMAKER_MQTT_QOS1, &rmaker_user_mapping_data->mqtt_msg_id);
     ESP_LOGI(TAG, "MQTT Publish: %s", publish_payload);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "MQTT Publish Error %d", err);
@@ -12,17 +12,776 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <sdkconfig.h>
+#include <string.h>
 #include <esp_log.h>
 #include <esp_rmaker_mqtt_glue.h>
 #include <esp_rmaker_client_data.h>
 #include <esp_rmaker_core.h>
+#ifdef CONFIG_ESP_RMAKER_MQTT_OFFLINE_QUEUE
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/timers.h>
+#include <esp_event.h>
+#include <esp_rmaker_common_events.h>
+#include <esp_rmaker_work_queue.h>
+#include <esp_rmaker_utils.h>
+#endif /* CONFIG_ESP_RMAKER_MQTT_OFFLINE_QUEUE */
 
 #include "esp_rmaker_mqtt.h"
 #include "esp_rmaker_mqtt_budget.h"
+#include "esp_rmaker_mqtt_dispatcher.h"
+#include "esp_rmaker_mqtt_topics.h"
 
 static const char *TAG = "esp_rmaker_mqtt";
 static esp_rmaker_mqtt_config_t g_mqtt_config;
 
+#ifdef CONFIG_ESP_RMAKER_MQTT_OFFLINE_QUEUE
+typedef struct esp_rmaker_mqtt_queued_msg {
+    char *topic;
+    char *data;         /* Allocated along with the topic */
+    size_t data_len;
+    uint8_t qos;
+    struct esp_rmaker_mqtt_queued_msg *next;
+} esp_rmaker_mqtt_queued_msg_t;
+
+static esp_rmaker_mqtt_queued_msg_t *mqtt_queue_head;
+static esp_rmaker_mqtt_queued_msg_t *mqtt_queue_tail;
+static uint8_t mqtt_queue_len;
+static size_t mqtt_queue_size;
+static bool mqtt_queue_replay_pending;
+/* Message taken off the queue by the replay, which is being published */
+static esp_rmaker_mqtt_queued_msg_t *mqtt_queue_in_flight;
+static SemaphoreHandle_t mqtt_queue_lock;
+/* Retries sending the queued messages once the budget would have revived */
+static TimerHandle_t mqtt_queue_retry_timer;
+#ifdef CONFIG_ESP_RMAKER_MQTT_ENABLE_BUDGETING
+#define MQTT_QUEUE_RETRY_MSEC   (CONFIG_ESP_RMAKER_MQTT_BUDGET_REVIVE_PERIOD * 1000)
+#else
+#define MQTT_QUEUE_RETRY_MSEC   5000
+#endif /* CONFIG_ESP_RMAKER_MQTT_ENABLE_BUDGETING */
+#endif /* CONFIG_ESP_RMAKER_MQTT_OFFLINE_QUEUE */
+
+static bool esp_rmaker_mqtt_topic_has_suffix(const char *topic, size_t topic_len, const char *suffix)
+{
+    size_t suffix_len = strlen(suffix);
+    return (topic_len > suffix_len) && (topic[topic_len - suffix_len - 1] == '/') &&
+            (strcmp(topic + topic_len - suffix_len, suffix) == 0);
+}
+
+esp_rmaker_mqtt_budget_class_t esp_rmaker_mqtt_get_budget_class(const char *topic)
+{
+    if (!topic) {
+        return ESP_RMAKER_MQTT_BUDGET_CLASS_STATE;
+    }
+    size_t topic_len = strlen(topic);
+    if (esp_rmaker_mqtt_topic_has_suffix(topic, topic_len, TIME_SERIES_DATA_TOPIC_SUFFIX) ||
+            esp_rmaker_mqtt_topic_has_suffix(topic, topic_len, INSIGHTS_TOPIC_SUFFIX)) {
+        return ESP_RMAKER_MQTT_BUDGET_CLASS_TELEMETRY;
+    }
+    if (esp_rmaker_mqtt_topic_has_suffix(topic, topic_len, NODE_PARAMS_ALERT_TOPIC_SUFFIX) ||
+            esp_rmaker_mqtt_topic_has_suffix(topic, topic_len, OTASTATUS_TOPIC_SUFFIX) ||
+            esp_rmaker_mqtt_topic_has_suffix(topic, topic_len, OTAFETCH_TOPIC_SUFFIX) ||
+            esp_rmaker_mqtt_topic_has_suffix(topic, topic_len, CMD_RESP_TOPIC_SUFFIX) ||
+            esp_rmaker_mqtt_topic_has_suffix(topic, topic_len, USER_MAPPING_TOPIC_SUFFIX)) {
+        return ESP_RMAKER_MQTT_BUDGET_CLASS_CONTROL;
+    }
+    return ESP_RMAKER_MQTT_BUDGET_CLASS_STATE;
+}
+
+#ifdef CONFIG_ESP_RMAKER_MQTT_OFFLINE_QUEUE
+/* Minimal JSON scanning, just sufficient for merging params payloads of the form
+ * {"<device>":{"<param>":<value>,...},...}
+ * All the functions return NULL on malformed input.
+ */
+static const char *esp_rmaker_json_skip_ws(const char *p, const char *end)
+{
+    while ((p < end) && ((*p == ' ') || (*p == '\t') || (*p == '\n') || (*p == '\r'))) {
+        p++;
+    }
+    return p;
+}
+
+static const char *esp_rmaker_json_skip_string(const char *p, const char *end)
+{
+    for (p++; p < end; p++) {
+        if (*p == '\\') {
+            p++;
+        } else if (*p == '"') {
+            return p + 1;
+        }
+    }
+    return NULL;
+}
+
+static const char *esp_rmaker_json_skip_value(const char *p, const char *end)
+{
+    if (p >= end) {
+        return NULL;
+    }
+    if (*p == '"') {
+        return esp_rmaker_json_skip_string(p, end);
+    }
+    if ((*p == '{') || (*p == '[')) {
+        int depth = 0;
+        while (p < end) {
+            if (*p == '"') {
+                if ((p = esp_rmaker_json_skip_string(p, end)) == NULL) {
+                    return NULL;
+                }
+                continue;
+            }
+            if ((*p == '{') || (*p == '[')) {
+                depth++;
+            } else if ((*p == '}') || (*p == ']')) {
+                if (--depth == 0) {
+                    return p + 1;
+                }
+            }
+            p++;
+        }
+        return NULL;
+    }
+    /* Numbers, true, false, null */
+    while ((p < end) && (*p != ',') && (*p != '}') && (*p != ']') && (esp_rmaker_json_skip_ws(p, end) == p)) {
+        p++;
+    }
+    return p;
+}
+
+/* Gets the next key-value pair of the object. p should point to the opening brace, or to
+ * the position returned by the previous call. Returns NULL at the end of the object.
+ */
+static const char *esp_rmaker_json_obj_next(const char *p, const char *end, const char **key, size_t *key_len,
+        const char **val, size_t *val_len)
+{
+    p = esp_rmaker_json_skip_ws(p + 1, end);
+    if ((p >= end) || (*p == '}') || (*p != '"')) {
+        return NULL;
+    }
+    const char *key_end = esp_rmaker_json_skip_string(p, end);
+    if (!key_end) {
+        return NULL;
+    }
+    *key = p;
+    *key_len = key_end - p;
+    p = esp_rmaker_json_skip_ws(key_end, end);
+    if ((p >= end) || (*p != ':')) {
+        return NULL;
+    }
+    p = esp_rmaker_json_skip_ws(p + 1, end);
+    const char *val_end = esp_rmaker_json_skip_value(p, end);
+    if (!val_end) {
+        return NULL;
+    }
+    *val = p;
+    *val_len = val_end - p;
+    p = esp_rmaker_json_skip_ws(val_end, end);
+    if ((p >= end) || ((*p != ',') && (*p != '}'))) {
+        return NULL;
+    }
+    /* Pointing to the comma or closing brace, which is skipped by the next call */
+    return p;
+}
+
+static bool esp_rmaker_json_obj_find(const char *obj, size_t obj_len, const char *key, size_t key_len,
+        const char **val, size_t *val_len)
+{
+    const char *end = obj + obj_len;
+    const char *k;
+    size_t k_len;
+    for (const char *p = obj; (p = esp_rmaker_json_obj_next(p, end, &k, &k_len, val, val_len)) != NULL; ) {
+        if ((k_len == key_len) && (memcmp(k, key, key_len) == 0)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool esp_rmaker_json_is_obj(const char *obj, size_t obj_len)
+{
+    obj = esp_rmaker_json_skip_ws(obj, obj + obj_len);
+    return obj_len && (*obj == '{');
+}
+
+static char *esp_rmaker_json_append(char *out, const char *key, size_t key_len, const char *val, size_t val_len, bool *first)
+{
+    if (!*first) {
+        *out++ = ',';
+    }
+    *first = false;
+    memcpy(out, key, key_len);
+    out += key_len;
+    *out++ = ':';
+    memcpy(out, val, val_len);
+    return out + val_len;
+}
+
+/* Merges two params payloads, with the values in the newer one taking precedence.
+ * out should be large enough to hold both the payloads. Returns the merged length, or 0 on failure.
+ */
+static size_t esp_rmaker_mqtt_merge_params(const char *old, size_t old_len, const char *new, size_t new_len, char *out)
+{
+    if (!esp_rmaker_json_is_obj(old, old_len) || !esp_rmaker_json_is_obj(new, new_len)) {
+        return 0;
+    }
+    old = esp_rmaker_json_skip_ws(old, old + old_len);
+    new = esp_rmaker_json_skip_ws(new, new + new_len);
+    const char *old_end = old + old_len, *new_end = new + new_len;
+    const char *dev, *dev_val, *new_dev_val, *param, *param_val, *new_param_val;
+    size_t dev_len, dev_val_len, new_dev_val_len, param_len, param_val_len, new_param_val_len;
+    char *ptr = out;
+    bool first_dev = true;
+    const char *p;
+    *ptr++ = '{';
+    /* Devices in the older payload, with their params merged if present in the newer one too */
+    for (p = old; (p = esp_rmaker_json_obj_next(p, old_end, &dev, &dev_len, &dev_val, &dev_val_len)) != NULL; ) {
+        if (!esp_rmaker_json_obj_find(new, new_end - new, dev, dev_len, &new_dev_val, &new_dev_val_len)) {
+            ptr = esp_rmaker_json_append(ptr, dev, dev_len, dev_val, dev_val_len, &first_dev);
+            continue;
+        }
+        if (!esp_rmaker_json_is_obj(dev_val, dev_val_len) || !esp_rmaker_json_is_obj(new_dev_val, new_dev_val_len)) {
+            return 0;
+        }
+        if (!first_dev) {
+            *ptr++ = ',';
+        }
+        first_dev = false;
+        memcpy(ptr, dev, dev_len);
+        ptr += dev_len;
+        *ptr++ = ':';
+        *ptr++ = '{';
+        bool first_param = true;
+        const char *q;
+        for (q = dev_val; (q = esp_rmaker_json_obj_next(q, dev_val + dev_val_len, &param, &param_len,
+                        &param_val, &param_val_len)) != NULL; ) {
+            if (!esp_rmaker_json_obj_find(new_dev_val, new_dev_val_len, param, param_len, &new_param_val, &new_param_val_len)) {
+                ptr = esp_rmaker_json_append(ptr, param, param_len, param_val, param_val_len, &first_param);
+            }
+        }
+        for (q = new_dev_val; (q = esp_rmaker_json_obj_next(q, new_dev_val + new_dev_val_len, &param, &param_len,
+                        &param_val, &param_val_len)) != NULL; ) {
+            ptr = esp_rmaker_json_append(ptr, param, param_len, param_val, param_val_len, &first_param);
+        }
+        *ptr++ = '}';
+    }
+    /* Devices present only in the newer payload */
+    for (p = new; (p = esp_rmaker_json_obj_next(p, new_end, &dev, &dev_len, &dev_val, &dev_val_len)) != NULL; ) {
+        if (!esp_rmaker_json_obj_find(old, old_end - old, dev, dev_len, &new_dev_val, &new_dev_val_len)) {
+            ptr = esp_rmaker_json_append(ptr, dev, dev_len, dev_val, dev_val_len, &first_dev);
+        }
+    }
+    *ptr++ = '}';
+    *ptr = '\0';
+    return ptr - out;
+}
+
+static bool esp_rmaker_mqtt_is_params_topic(const char *topic)
+{
+    return esp_rmaker_mqtt_topic_has_suffix(topic, strlen(topic), NODE_PARAMS_LOCAL_TOPIC_SUFFIX);
+}
+
+static void esp_rmaker_mqtt_queue_free_msg(esp_rmaker_mqtt_queued_msg_t *msg)
+{
+    mqtt_queue_len--;
+    mqtt_queue_size -= strlen(msg->topic) + msg->data_len;
+    free(msg->topic);
+    free(msg);
+}
+
+/* Drops the oldest message, other than the one to be kept (if any) */
+static void esp_rmaker_mqtt_queue_drop_oldest(esp_rmaker_mqtt_queued_msg_t *keep)
+{
+    esp_rmaker_mqtt_queued_msg_t *prev = NULL, *msg = mqtt_queue_head;
+    if (msg && (msg == keep)) {
+        prev = msg;
+        msg = msg->next;
+    }
+    if (!msg) {
+        return;
+    }
+    ESP_LOGW(TAG, "MQTT offline queue full. Dropping message on %s.", msg->topic);
+    if (prev) {
+        prev->next = msg->next;
+    } else {
+        mqtt_queue_head = msg->next;
+    }
+    if (mqtt_queue_tail == msg) {
+        mqtt_queue_tail = prev;
+    }
+    esp_rmaker_mqtt_queue_free_msg(msg);
+}
+
+static esp_rmaker_mqtt_queued_msg_t *esp_rmaker_mqtt_queue_alloc_msg(const char *topic, size_t data_len)
+{
+    esp_rmaker_mqtt_queued_msg_t *msg = MEM_CALLOC_EXTRAM(1, sizeof(esp_rmaker_mqtt_queued_msg_t));
+    if (!msg) {
+        return NULL;
+    }
+    size_t topic_len = strlen(topic);
+    msg->topic = MEM_CALLOC_EXTRAM(1, topic_len + 1 + data_len + 1);
+    if (!msg->topic) {
+        free(msg);
+        return NULL;
+    }
+    memcpy(msg->topic, topic, topic_len);
+    msg->data = msg->topic + topic_len + 1;
+    return msg;
+}
+
+/* Merges the params payload into the queued message for the same topic, if any.
+ * Should be called with the queue lock held.
+ */
+static esp_err_t esp_rmaker_mqtt_queue_merge(const char *topic, const char *data, size_t data_len, uint8_t qos)
+{
+    esp_rmaker_mqtt_queued_msg_t *prev = NULL, *msg;
+    for (msg = mqtt_queue_head; msg; prev = msg, msg = msg->next) {
+        if (strcmp(msg->topic, topic) == 0) {
+            break;
+        }
+    }
+    if (!msg) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    esp_rmaker_mqtt_queued_msg_t *merged = esp_rmaker_mqtt_queue_alloc_msg(topic, msg->data_len + data_len);
+    if (!merged) {
+        return ESP_ERR_NO_MEM;
+    }
+    merged->data_len = esp_rmaker_mqtt_merge_params(msg->data, msg->data_len, data, data_len, merged->data);
+    size_t merged_size = strlen(topic) + merged->data_len;
+    if ((merged->data_len == 0) || (merged_size > CONFIG_ESP_RMAKER_MQTT_OFFLINE_QUEUE_SIZE)) {
+        /* The new message then gets queued separately */
+        free(merged->topic);
+        free(merged);
+        return ESP_FAIL;
+    }
+    /* The merged message takes the place of the older one in the queue, so that the order is retained */
+    merged->qos = (qos > msg->qos) ? qos : msg->qos;
+    merged->next = msg->next;
+    if (prev) {
+        prev->next = merged;
+    } else {
+        mqtt_queue_head = merged;
+    }
+    if (mqtt_queue_tail == msg) {
+        mqtt_queue_tail = merged;
+    }
+    esp_rmaker_mqtt_queue_free_msg(msg);
+    mqtt_queue_len++;
+    mqtt_queue_size += merged_size;
+    /* The merged message may be larger than the older one, so the same limit as for adding applies */
+    while ((mqtt_queue_size > CONFIG_ESP_RMAKER_MQTT_OFFLINE_QUEUE_SIZE) && (mqtt_queue_len > 1)) {
+        esp_rmaker_mqtt_queue_drop_oldest(merged);
+    }
+    return ESP_OK;
+}
+
+/* If if_pending is set, the message is queued only if other messages are already queued.
+ * ESP_ERR_NOT_FOUND is returned otherwise.
+ */
+static esp_err_t esp_rmaker_mqtt_queue_add(const char *topic, const char *data, size_t data_len, uint8_t qos,
+        bool if_pending)
+{
+    xSemaphoreTake(mqtt_queue_lock, portMAX_DELAY);
+    if (if_pending && !mqtt_queue_head && !mqtt_queue_in_flight) {
+        xSemaphoreGive(mqtt_queue_lock);
+        return ESP_ERR_NOT_FOUND;
+    }
+    size_t size = strlen(topic) + data_len;
+    if (size > CONFIG_ESP_RMAKER_MQTT_OFFLINE_QUEUE_SIZE) {
+        xSemaphoreGive(mqtt_queue_lock);
+        ESP_LOGE(TAG, "Message on %s too large to be queued.", topic);
+        return ESP_ERR_NO_MEM;
+    }
+    if (esp_rmaker_mqtt_is_params_topic(topic) &&
+            (esp_rmaker_mqtt_queue_merge(topic, data, data_len, qos) == ESP_OK)) {
+        ESP_LOGI(TAG, "Merged params report with the queued one.");
+        xSemaphoreGive(mqtt_queue_lock);
+        return ESP_OK;
+    }
+    while (mqtt_queue_head && ((mqtt_queue_len >= CONFIG_ESP_RMAKER_MQTT_OFFLINE_QUEUE_LEN) ||
+                (mqtt_queue_size + size > CONFIG_ESP_RMAKER_MQTT_OFFLINE_QUEUE_SIZE))) {
+        esp_rmaker_mqtt_queue_drop_oldest(NULL);
+    }
+    esp_rmaker_mqtt_queued_msg_t *msg = esp_rmaker_mqtt_queue_alloc_msg(topic, data_len);
+    if (!msg) {
+        xSemaphoreGive(mqtt_queue_lock);
+        ESP_LOGE(TAG, "Failed to allocate memory for queueing message on %s.", topic);
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(msg->data, data, data_len);
+    msg->data_len = data_len;
+    msg->qos = qos;
+    if (mqtt_queue_tail) {
+        mqtt_queue_tail->next = msg;
+    } else {
+        mqtt_queue_head = msg;
+    }
+    mqtt_queue_tail = msg;
+    mqtt_queue_len++;
+    mqtt_queue_size += size;
+    ESP_LOGI(TAG, "Queued message on %s. %d message(s) pending.", topic, mqtt_queue_len);
+    xSemaphoreGive(mqtt_queue_lock);
+    return ESP_OK;
+}
+
+/* Sends the queued messages in order, till a publish fails or the budget runs out. The message being sent
+ * is taken off the queue, so that the lock is not held while publishing, and is put back at the head if
+ * the publish fails. Messages published meanwhile get queued, so that they are sent after it.
+ * The message still counts towards the queue limits while it is being sent.
+ */
+static void esp_rmaker_mqtt_queue_replay(void *priv_data)
+{
+    xSemaphoreTake(mqtt_queue_lock, portMAX_DELAY);
+    mqtt_queue_replay_pending = false;
+    while (mqtt_queue_head) {
+        esp_rmaker_mqtt_queued_msg_t *msg = mqtt_queue_head;
+        esp_rmaker_mqtt_budget_class_t budget_class = esp_rmaker_mqtt_get_budget_class(msg->topic);
+        int reservation = esp_rmaker_mqtt_reserve_budget(budget_class);
+        if (reservation < 0) {
+            /* The budget revives only when accessed, so check again after a while */
+            if (mqtt_queue_retry_timer) {
+                xTimerStart(mqtt_queue_retry_timer, 0);
+            }
+            break;
+        }
+        mqtt_queue_head = msg->next;
+        if (!mqtt_queue_head) {
+            mqtt_queue_tail = NULL;
+        }
+        msg->next = NULL;
+        mqtt_queue_in_flight = msg;
+        xSemaphoreGive(mqtt_queue_lock);
+
+        esp_err_t err = g_mqtt_config.publish(msg->topic, msg->data, msg->data_len, msg->qos, NULL);
+
+        xSemaphoreTake(mqtt_queue_lock, portMAX_DELAY);
+        mqtt_queue_in_flight = NULL;
+        if (err != ESP_OK) {
+            esp_rmaker_mqtt_release_budget(budget_class, reservation);
+            msg->next = mqtt_queue_head;
+            mqtt_queue_head = msg;
+            if (!mqtt_queue_tail) {
+                mqtt_queue_tail = msg;
+            }
+            break;
+        }
+        esp_rmaker_mqtt_queue_free_msg(msg);
+    }
+    if (mqtt_queue_len) {
+        ESP_LOGW(TAG, "%d queued message(s) still pending.", mqtt_queue_len);
+    }
+    xSemaphoreGive(mqtt_queue_lock);
+}
+
+static void esp_rmaker_mqtt_queue_schedule_replay(void)
+{
+    if (!mqtt_queue_lock || !mqtt_queue_head || mqtt_queue_replay_pending) {
+        return;
+    }
+    /* Adding to work queue to change the context from the event/timer task. */
+    mqtt_queue_replay_pending = true;
+    if (esp_rmaker_work_queue_add_task(esp_rmaker_mqtt_queue_replay, NULL) != ESP_OK) {
+        mqtt_queue_replay_pending = false;
+    }
+}
+
+static void esp_rmaker_mqtt_event_handler(void* arg, esp_event_base_t event_base,
+                          int32_t event_id, void* event_data)
+{
+    esp_rmaker_mqtt_queue_schedule_replay();
+}
+
+static void esp_rmaker_mqtt_queue_retry_timer_cb(TimerHandle_t timer)
+{
+    esp_rmaker_mqtt_queue_schedule_replay();
+}
+
+static esp_err_t esp_rmaker_mqtt_queue_init(void)
+{
+    if (mqtt_queue_lock) {
+        return ESP_OK;
+    }
+    mqtt_queue_lock = xSemaphoreCreateMutex();
+    if (!mqtt_queue_lock) {
+        return ESP_ERR_NO_MEM;
+    }
+    mqtt_queue_retry_timer = xTimerCreate("mqtt_queue_tm", pdMS_TO_TICKS(MQTT_QUEUE_RETRY_MSEC),
+            pdFALSE, NULL, esp_rmaker_mqtt_queue_retry_timer_cb);
+    if (!mqtt_queue_retry_timer) {
+        vSemaphoreDelete(mqtt_queue_lock);
+        mqtt_queue_lock = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    return esp_event_handler_register(RMAKER_COMMON_EVENT, RMAKER_MQTT_EVENT_CONNECTED,
+            &esp_rmaker_mqtt_event_handler, NULL);
+}
+
+static void esp_rmaker_mqtt_queue_deinit(void)
+{
+    if (!mqtt_queue_lock) {
+        return;
+    }
+    esp_event_handler_unregister(RMAKER_COMMON_EVENT, RMAKER_MQTT_EVENT_CONNECTED, &esp_rmaker_mqtt_event_handler);
+    xTimerDelete(mqtt_queue_retry_timer, portMAX_DELAY);
+    mqtt_queue_retry_timer = NULL;
+    while (mqtt_queue_head) {
+        esp_rmaker_mqtt_queued_msg_t *msg = mqtt_queue_head;
+        mqtt_queue_head = msg->next;
+        esp_rmaker_mqtt_queue_free_msg(msg);
+    }
+    mqtt_queue_tail = NULL;
+    vSemaphoreDelete(mqtt_queue_lock);
+    mqtt_queue_lock = NULL;
+}
+
+void esp_rmaker_mqtt_budget_revived(void)
+{
+    esp_rmaker_mqtt_queue_schedule_replay();
+}
+#else
+void esp_rmaker_mqtt_budget_revived(void)
+{
+}
+#endif /* CONFIG_ESP_RMAKER_MQTT_OFFLINE_QUEUE */
+
+#ifdef CONFIG_ESP_RMAKER_MQTT_SUBSCRIBE_DISPATCHER
+/* Node of the trie of topic suffixes (relative to node/<node_id>/) having handlers. Each node
+ * represents a single character and its children are linked through the sibling pointers.
+ */
+typedef struct esp_rmaker_mqtt_trie_node {
+    char c;
+    esp_rmaker_mqtt_subscribe_cb_t cb;
+    void *priv_data;
+    struct esp_rmaker_mqtt_trie_node *child;
+    struct esp_rmaker_mqtt_trie_node *sibling;
+} esp_rmaker_mqtt_trie_node_t;
+
+static esp_rmaker_mqtt_trie_node_t mqtt_sub_trie;
+static uint8_t mqtt_sub_count;
+/* node/<node_id>/# */
+static char *mqtt_sub_wildcard;
+static size_t mqtt_sub_prefix_len;
+static SemaphoreHandle_t mqtt_sub_lock;
+
+/* Should be called with mqtt_sub_lock held */
+static esp_err_t esp_rmaker_mqtt_dispatcher_build_wildcard(const char *node_id)
+{
+    if (!node_id) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    size_t len = strlen("node/") + strlen(node_id) + strlen("/#") + 1;
+    char *wildcard = MEM_CALLOC_EXTRAM(1, len);
+    if (!wildcard) {
+        return ESP_ERR_NO_MEM;
+    }
+    snprintf(wildcard, len, "node/%s/#", node_id);
+    if (mqtt_sub_wildcard) {
+        free(mqtt_sub_wildcard);
+    }
+    mqtt_sub_prefix_len = len - 2; /* Excluding the '#' and the NULL termination */
+    mqtt_sub_wildcard = wildcard;
+    return ESP_OK;
+}
+
+esp_err_t esp_rmaker_mqtt_dispatcher_set_node_id(const char *node_id)
+{
+    if (!node_id) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!mqtt_sub_lock) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(mqtt_sub_lock, portMAX_DELAY);
+    /* The wildcard subscription with the broker cannot be changed underneath the registered handlers */
+    esp_err_t err = (mqtt_sub_count == 0) ? esp_rmaker_mqtt_dispatcher_build_wildcard(node_id) : ESP_ERR_INVALID_STATE;
+    xSemaphoreGive(mqtt_sub_lock);
+    return err;
+}
+
+/* Returns the part of the topic after node/<node_id>/, if the topic can be handled by the dispatcher */
+static const char *esp_rmaker_mqtt_dispatcher_get_suffix(const char *topic)
+{
+    /* The topics are subscribed to individually if the dispatcher could not be initialised */
+    if (!mqtt_sub_lock) {
+        return NULL;
+    }
+    xSemaphoreTake(mqtt_sub_lock, portMAX_DELAY);
+    if (!mqtt_sub_wildcard && (esp_rmaker_mqtt_dispatcher_build_wildcard(esp_rmaker_get_node_id()) != ESP_OK)) {
+        xSemaphoreGive(mqtt_sub_lock);
+        return NULL;
+    }
+    xSemaphoreGive(mqtt_sub_lock);
+    if (strncmp(topic, mqtt_sub_wildcard, mqtt_sub_prefix_len) != 0) {
+        return NULL;
+    }
+    const char *suffix = topic + mqtt_sub_prefix_len;
+    /* Topics with wildcards of their own are subscribed to separately */
+    if ((*suffix == '\0') || strpbrk(suffix, "+#")) {
+        return NULL;
+    }
+    return suffix;
+}
+
+static esp_rmaker_mqtt_trie_node_t *esp_rmaker_mqtt_trie_find(const char *suffix, bool create)
+{
+    esp_rmaker_mqtt_trie_node_t *node = &mqtt_sub_trie;
+    for (; *suffix; suffix++) {
+        esp_rmaker_mqtt_trie_node_t *child = node->child;
+        while (child && (child->c != *suffix)) {
+            child = child->sibling;
+        }
+        if (!child) {
+            if (!create) {
+                return NULL;
+            }
+            child = MEM_CALLOC_EXTRAM(1, sizeof(esp_rmaker_mqtt_trie_node_t));
+            if (!child) {
+                return NULL;
+            }
+            child->c = *suffix;
+            child->sibling = node->child;
+            node->child = child;
+        }
+        node = child;
+    }
+    return node;
+}
+
+/* Clears the handler for the suffix and frees the nodes which do not lead to any handler thereafter.
+ * Returns true if the given node itself can be freed.
+ */
+static bool esp_rmaker_mqtt_trie_remove(esp_rmaker_mqtt_trie_node_t *node, const char *suffix)
+{
+    if (*suffix == '\0') {
+        node->cb = NULL;
+        node->priv_data = NULL;
+    } else {
+        esp_rmaker_mqtt_trie_node_t **child_ptr = &node->child;
+        while (*child_ptr && ((*child_ptr)->c != *suffix)) {
+            child_ptr = &(*child_ptr)->sibling;
+        }
+        if (*child_ptr && esp_rmaker_mqtt_trie_remove(*child_ptr, suffix + 1)) {
+            esp_rmaker_mqtt_trie_node_t *child = *child_ptr;
+            *child_ptr = child->sibling;
+            free(child);
+        }
+    }
+    return !node->cb && !node->child;
+}
+
+static void esp_rmaker_mqtt_trie_free(esp_rmaker_mqtt_trie_node_t *node)
+{
+    while (node) {
+        esp_rmaker_mqtt_trie_node_t *sibling = node->sibling;
+        esp_rmaker_mqtt_trie_free(node->child);
+        free(node);
+        node = sibling;
+    }
+}
+
+/* Handler for the wildcard subscription. The lookup takes time proportional to the topic length,
+ * irrespective of the number of handlers registered.
+ */
+static void esp_rmaker_mqtt_dispatch(const char *topic, void *payload, size_t payload_len, void *priv_data)
+{
+    if (!mqtt_sub_wildcard || (strncmp(topic, mqtt_sub_wildcard, mqtt_sub_prefix_len) != 0)) {
+        return;
+    }
+    esp_rmaker_mqtt_subscribe_cb_t cb = NULL;
+    void *cb_priv_data = NULL;
+    xSemaphoreTake(mqtt_sub_lock, portMAX_DELAY);
+    esp_rmaker_mqtt_trie_node_t *node = esp_rmaker_mqtt_trie_find(topic + mqtt_sub_prefix_len, false);
+    if (node) {
+        cb = node->cb;
+        cb_priv_data = node->priv_data;
+    }
+    xSemaphoreGive(mqtt_sub_lock);
+    /* The handler is invoked without holding the lock, so that it can subscribe/unsubscribe if required */
+    if (cb) {
+        cb(topic, payload, payload_len, cb_priv_data);
+    } else {
+        ESP_LOGD(TAG, "No handler for message on %s.", topic);
+    }
+}
+
+static esp_err_t esp_rmaker_mqtt_dispatcher_add(const char *suffix, esp_rmaker_mqtt_subscribe_cb_t cb, void *priv_data)
+{
+    esp_err_t err = ESP_OK;
+    xSemaphoreTake(mqtt_sub_lock, portMAX_DELAY);
+    esp_rmaker_mqtt_trie_node_t *node = esp_rmaker_mqtt_trie_find(suffix, true);
+    if (!node) {
+        ESP_LOGE(TAG, "Failed to allocate memory for subscription to %s.", suffix);
+        /* Freeing the nodes which may have got created partially */
+        esp_rmaker_mqtt_trie_remove(&mqtt_sub_trie, suffix);
+        xSemaphoreGive(mqtt_sub_lock);
+        return ESP_ERR_NO_MEM;
+    }
+    bool is_new = (node->cb == NULL);
+    node->cb = cb;
+    node->priv_data = priv_data;
+    if (is_new && (mqtt_sub_count++ == 0)) {
+        /* A single subscription with the broker serves all the topics */
+        err = g_mqtt_config.subscribe(mqtt_sub_wildcard, esp_rmaker_mqtt_dispatch, RMAKER_MQTT_QOS1, NULL);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to subscribe to %s. Error %d", mqtt_sub_wildcard, err);
+            esp_rmaker_mqtt_trie_remove(&mqtt_sub_trie, suffix);
+            mqtt_sub_count = 0;
+        }
+    }
+    xSemaphoreGive(mqtt_sub_lock);
+    return err;
+}
+
+static esp_err_t esp_rmaker_mqtt_dispatcher_remove(const char *suffix)
+{
+    if (!mqtt_sub_lock) {
+        return ESP_OK;
+    }
+    esp_err_t err = ESP_OK;
+    xSemaphoreTake(mqtt_sub_lock, portMAX_DELAY);
+    esp_rmaker_mqtt_trie_node_t *node = esp_rmaker_mqtt_trie_find(suffix, false);
+    if (node && node->cb) {
+        esp_rmaker_mqtt_trie_remove(&mqtt_sub_trie, suffix);
+        if (--mqtt_sub_count == 0) {
+            err = g_mqtt_config.unsubscribe(mqtt_sub_wildcard);
+        }
+    }
+    xSemaphoreGive(mqtt_sub_lock);
+    return err;
+}
+
+/* The lock is created upfront, rather than on the first subscription, since subscriptions
+ * may be made concurrently from different tasks.
+ */
+static esp_err_t esp_rmaker_mqtt_dispatcher_init(void)
+{
+    if (mqtt_sub_lock) {
+        return ESP_OK;
+    }
+    mqtt_sub_lock = xSemaphoreCreateMutex();
+    if (!mqtt_sub_lock) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+static void esp_rmaker_mqtt_dispatcher_deinit(void)
+{
+    esp_rmaker_mqtt_trie_free(mqtt_sub_trie.child);
+    memset(&mqtt_sub_trie, 0, sizeof(mqtt_sub_trie));
+    mqtt_sub_count = 0;
+    if (mqtt_sub_wildcard) {
+        free(mqtt_sub_wildcard);
+        mqtt_sub_wildcard = NULL;
+    }
+    if (mqtt_sub_lock) {
+        vSemaphoreDelete(mqtt_sub_lock);
+        mqtt_sub_lock = NULL;
+    }
+}
+#endif /* CONFIG_ESP_RMAKER_MQTT_SUBSCRIBE_DISPATCHER */
+
 esp_rmaker_mqtt_conn_params_t *esp_rmaker_mqtt_get_conn_params(void)
 {
     if (g_mqtt_config.get_conn_params) {
@@ -50,6 +809,16 @@ esp_err_t esp_rmaker_mqtt_init(esp_rmaker_mqtt_conn_params_t *conn_params)
             if (esp_rmaker_mqtt_budgeting_init() != ESP_OK) {
                 ESP_LOGE(TAG, "Failied to initialise MQTT Budgeting.");
             }
+#ifdef CONFIG_ESP_RMAKER_MQTT_OFFLINE_QUEUE
+            if (esp_rmaker_mqtt_queue_init() != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to initialise MQTT offline queue.");
+            }
+#endif /* CONFIG_ESP_RMAKER_MQTT_OFFLINE_QUEUE */
+#ifdef CONFIG_ESP_RMAKER_MQTT_SUBSCRIBE_DISPATCHER
+            if (esp_rmaker_mqtt_dispatcher_init() != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to initialise MQTT subscribe dispatcher.");
+            }
+#endif /* CONFIG_ESP_RMAKER_MQTT_SUBSCRIBE_DISPATCHER */
         }
         return err;
     }
@@ -60,6 +829,12 @@ esp_err_t esp_rmaker_mqtt_init(esp_rmaker_mqtt_conn_params_t *conn_params)
 void esp_rmaker_mqtt_deinit(void)
 {
     esp_rmaker_mqtt_budgeting_deinit();
+#ifdef CONFIG_ESP_RMAKER_MQTT_SUBSCRIBE_DISPATCHER
+    esp_rmaker_mqtt_dispatcher_deinit();
+#endif /* CONFIG_ESP_RMAKER_MQTT_SUBSCRIBE_DISPATCHER */
+#ifdef CONFIG_ESP_RMAKER_MQTT_OFFLINE_QUEUE
+    esp_rmaker_mqtt_queue_deinit();
+#endif /* CONFIG_ESP_RMAKER_MQTT_OFFLINE_QUEUE */
     if (g_mqtt_config.deinit) {
         return g_mqtt_config.deinit();
     }
@@ -93,6 +868,12 @@ esp_err_t esp_rmaker_mqtt_disconnect(void)
 esp_err_t esp_rmaker_mqtt_subscribe(const char *topic, esp_rmaker_mqtt_subscribe_cb_t cb, uint8_t qos, void *priv_data)
 {
     if (g_mqtt_config.subscribe) {
+#ifdef CONFIG_ESP_RMAKER_MQTT_SUBSCRIBE_DISPATCHER
+        const char *suffix = esp_rmaker_mqtt_dispatcher_get_suffix(topic);
+        if (suffix) {
+            return esp_rmaker_mqtt_dispatcher_add(suffix, cb, priv_data);
+        }
+#endif /* CONFIG_ESP_RMAKER_MQTT_SUBSCRIBE_DISPATCHER */
         return g_mqtt_config.subscribe(topic, cb, qos, priv_data);
     }
     ESP_LOGW(TAG, "esp_rmaker_mqtt_subscribe not registered");
@@ -102,6 +883,12 @@ esp_err_t esp_rmaker_mqtt_subscribe(const char *topic, esp_rmaker_mqtt_subscribe
 esp_err_t esp_rmaker_mqtt_unsubscribe(const char *topic)
 {
     if (g_mqtt_config.unsubscribe) {
+#ifdef CONFIG_ESP_RMAKER_MQTT_SUBSCRIBE_DISPATCHER
+        const char *suffix = esp_rmaker_mqtt_dispatcher_get_suffix(topic);
+        if (suffix) {
+            return esp_rmaker_mqtt_dispatcher_remove(suffix);
+        }
+#endif /* CONFIG_ESP_RMAKER_MQTT_SUBSCRIBE_DISPATCHER */
         return g_mqtt_config.unsubscribe(topic);
     }
     ESP_LOGW(TAG, "esp_rmaker_mqtt_unsubscribe not registered");
@@ -110,26 +897,138 @@ esp_err_t esp_rmaker_mqtt_unsubscribe(const char *topic)
 
 esp_err_t esp_rmaker_mqtt_publish(const char *topic, void *data, size_t data_len, uint8_t qos, int *msg_id)
 {
-    if (esp_rmaker_mqtt_is_budget_available() != true) {
+    if (!topic) {
+        ESP_LOGE(TAG, "MQTT topic cannot be NULL.");
+        return ESP_ERR_INVALID_ARG;
+    }
+#ifdef CONFIG_ESP_RMAKER_MQTT_OFFLINE_QUEUE
+    /* Messages for which the caller tracks the message id, and QoS 0 messages, are not queued */
+    bool can_queue = mqtt_queue_lock && g_mqtt_config.publish && (qos > 0) && !msg_id;
+    /* If messages are already queued, this one should go after them, so that an older
+     * params report does not overwrite the newer values. The queue is checked under its lock,
+     * since a replay may be emptying it concurrently.
+     */
+    if (can_queue) {
+        esp_err_t err = esp_rmaker_mqtt_queue_add(topic, data, data_len, qos, true);
+        if (err != ESP_ERR_NOT_FOUND) {
+            esp_rmaker_mqtt_queue_schedule_replay();
+            return err;
+        }
+    }
+#endif /* CONFIG_ESP_RMAKER_MQTT_OFFLINE_QUEUE */
+    /* The budget is reserved before publishing, so that concurrent publishes cannot overdraw it */
+    esp_rmaker_mqtt_budget_class_t budget_class = esp_rmaker_mqtt_get_budget_class(topic);
+    int reservation = esp_rmaker_mqtt_reserve_budget(budget_class);
+    if (reservation < 0) {
+#ifdef CONFIG_ESP_RMAKER_MQTT_OFFLINE_QUEUE
+        if (can_queue) {
+            ESP_LOGW(TAG, "Out of MQTT Budget. Queueing publish message.");
+            return esp_rmaker_mqtt_queue_add(topic, data, data_len, qos, false);
+        }
+#endif /* CONFIG_ESP_RMAKER_MQTT_OFFLINE_QUEUE */
         ESP_LOGE(TAG, "Out of MQTT Budget. Dropping publish message.");
         return ESP_FAIL;
     }
     if (g_mqtt_config.publish) {
         esp_err_t err = g_mqtt_config.publish(topic, data, data_len, qos, msg_id);
-        if (err == ESP_OK) {
-            esp_rmaker_mqtt_decrease_budget(1);
+        if (err != ESP_OK) {
+            esp_rmaker_mqtt_release_budget(budget_class, reservation);
         }
+#ifdef CONFIG_ESP_RMAKER_MQTT_OFFLINE_QUEUE
+        if ((err != ESP_OK) && can_queue) {
+            ESP_LOGW(TAG, "Failed to publish message. Queueing it.");
+            return esp_rmaker_mqtt_queue_add(topic, data, data_len, qos, false);
+        }
+#endif /* CONFIG_ESP_RMAKER_MQTT_OFFLINE_QUEUE */
         return err;
     }
+    esp_rmaker_mqtt_release_budget(budget_class, reservation);
     ESP_LOGW(TAG, "esp_rmaker_mqtt_publish not registered");
     return ESP_OK;
 }
 
-void esp_rmaker_create_mqtt_topic(char *buf, size_t buf_size, const char *topic_suffix, const char *rule)
+static int esp_rmaker_mqtt_format_topic(char *buf, size_t buf_size, const char *node_id,
+        const char *topic_suffix, const char *rule)
 {
 #ifdef CONFIG_ESP_RMAKER_MQTT_USE_BASIC_INGEST_TOPICS
-    snprintf(buf, buf_size, "$aws/rules/%s/node/%s/%s", rule, esp_rmaker_get_node_id(), topic_suffix);
+    return snprintf(buf, buf_size, "$aws/rules/%s/node/%s/%s", rule, node_id, topic_suffix);
 #else
-    snprintf(buf, buf_size, "node/%s/%s", esp_rmaker_get_node_id(), topic_suffix);
+    return snprintf(buf, buf_size, "node/%s/%s", node_id, topic_suffix);
 #endif
 }
+
+void esp_rmaker_create_mqtt_topic(char *buf, size_t buf_size, const char *topic_suffix, const char *rule)
+{
+    esp_rmaker_mqtt_format_topic(buf, buf_size, esp_rmaker_get_node_id(), topic_suffix, rule);
+}
+
+/* Indexed by esp_rmaker_mqtt_topic_id_t */
+static const struct {
+    const char *suffix;
+    const char *rule;
+} mqtt_topic_defs[ESP_RMAKER_MQTT_TOPIC_MAX] = {
+    [ESP_RMAKER_MQTT_TOPIC_NODE_CONFIG] = {NODE_CONFIG_TOPIC_SUFFIX, NODE_CONFIG_TOPIC_RULE},
+    [ESP_RMAKER_MQTT_TOPIC_PARAMS_LOCAL] = {NODE_PARAMS_LOCAL_TOPIC_SUFFIX, NODE_PARAMS_LOCAL_TOPIC_RULE},
+    [ESP_RMAKER_MQTT_TOPIC_PARAMS_LOCAL_INIT] = {NODE_PARAMS_LOCAL_INIT_TOPIC_SUFFIX, NODE_PARAMS_LOCAL_INIT_RULE},
+    [ESP_RMAKER_MQTT_TOPIC_PARAMS_ALERT] = {NODE_PARAMS_ALERT_TOPIC_SUFFIX, NODE_PARAMS_ALERT_TOPIC_RULE},
+    [ESP_RMAKER_MQTT_TOPIC_USER_MAPPING] = {USER_MAPPING_TOPIC_SUFFIX, USER_MAPPING_TOPIC_RULE},
+    [ESP_RMAKER_MQTT_TOPIC_OTAFETCH] = {OTAFETCH_TOPIC_SUFFIX, OTAFETCH_TOPIC_RULE},
+    [ESP_RMAKER_MQTT_TOPIC_OTASTATUS] = {OTASTATUS_TOPIC_SUFFIX, OTASTATUS_TOPIC_RULE},
+    [ESP_RMAKER_MQTT_TOPIC_TIME_SERIES_DATA] = {TIME_SERIES_DATA_TOPIC_SUFFIX, TIME_SERIES_DATA_TOPIC_RULE},
+    [ESP_RMAKER_MQTT_TOPIC_CMD_RESP] = {CMD_RESP_TOPIC_SUFFIX, CMD_RESP_TOPIC_RULE},
+    [ESP_RMAKER_MQTT_TOPIC_NODE_CONFIG_FINGERPRINT] = {NODE_CONFIG_FINGERPRINT_TOPIC_SUFFIX, NODE_CONFIG_FINGERPRINT_TOPIC_RULE},
+};
+
+/* All the topics are stored in a single allocation, which is not modified once generated */
+typedef struct {
+    const char *topics[ESP_RMAKER_MQTT_TOPIC_MAX];
+    char data[];
+} esp_rmaker_mqtt_topic_table_t;
+
+static esp_rmaker_mqtt_topic_table_t *mqtt_topic_table;
+
+/* This is expected to be called only when the node id is set or changed, which happens before
+ * MQTT is started, and so, the previous table is not in use anymore.
+ */
+esp_err_t esp_rmaker_mqtt_topics_build(const char *node_id)
+{
+    if (!node_id) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    size_t data_len = 0;
+    for (int i = 0; i < ESP_RMAKER_MQTT_TOPIC_MAX; i++) {
+        data_len += esp_rmaker_mqtt_format_topic(NULL, 0, node_id,
+                mqtt_topic_defs[i].suffix, mqtt_topic_defs[i].rule) + 1; /* +1 for NULL termination */
+    }
+    esp_rmaker_mqtt_topic_table_t *table = MEM_CALLOC_EXTRAM(1, sizeof(esp_rmaker_mqtt_topic_table_t) + data_len);
+    if (!table) {
+        ESP_LOGE(TAG, "Failed to allocate %d bytes for MQTT topics.", sizeof(esp_rmaker_mqtt_topic_table_t) + data_len);
+        return ESP_ERR_NO_MEM;
+    }
+    char *topic = table->data;
+    for (int i = 0; i < ESP_RMAKER_MQTT_TOPIC_MAX; i++) {
+        table->topics[i] = topic;
+        topic += esp_rmaker_mqtt_format_topic(topic, table->data + data_len - topic, node_id,
+                mqtt_topic_defs[i].suffix, mqtt_topic_defs[i].rule) + 1;
+    }
+    esp_rmaker_mqtt_topics_free();
+    mqtt_topic_table = table;
+    return ESP_OK;
+}
+
+void esp_rmaker_mqtt_topics_free(void)
+{
+    if (mqtt_topic_table) {
+        free(mqtt_topic_table);
+        mqtt_topic_table = NULL;
+    }
+}
+
+const char *esp_rmaker_mqtt_get_topic(esp_rmaker_mqtt_topic_id_t topic_id)
+{
+    if (!mqtt_topic_table || (topic_id >= ESP_RMAKER_MQTT_TOPIC_MAX)) {
+        ESP_LOGE(TAG, "MQTT topic %d not available.", topic_id);
+        return NULL;
+    }
+    return mqtt_topic_table->topics[topic_id];
+}
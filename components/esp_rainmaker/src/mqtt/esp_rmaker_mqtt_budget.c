@@ -9,134 +9,246 @@
 #include <esp_log.h>
 #include <esp_err.h>
 #include <stdbool.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include "esp_rmaker_mqtt_budget.h"
 static const char *TAG = "esp_rmaker_mqtt_budget";
 
 #ifdef CONFIG_ESP_RMAKER_MQTT_ENABLE_BUDGETING
 
 #include <freertos/FreeRTOS.h>
-#include <freertos/timers.h>
-#include <freertos/semphr.h>
+#include <freertos/task.h>
 
 #define DEFAULT_BUDGET              CONFIG_ESP_RMAKER_MQTT_DEFAULT_BUDGET
 #define MAX_BUDGET                  CONFIG_ESP_RMAKER_MQTT_MAX_BUDGET
 #define BUDGET_REVIVE_COUNT         CONFIG_ESP_RMAKER_MQTT_BUDGET_REVIVE_COUNT
 #define BUDGET_REVIVE_PERIOD        CONFIG_ESP_RMAKER_MQTT_BUDGET_REVIVE_PERIOD
+#define BUDGET_REVIVE_TICKS         pdMS_TO_TICKS(BUDGET_REVIVE_PERIOD * 1000)
 
-static int16_t mqtt_budget = DEFAULT_BUDGET;
-static TimerHandle_t mqtt_budget_timer;
-static SemaphoreHandle_t mqtt_budget_lock;
-#define SEMAPHORE_DELAY_MSEC         500
+#ifdef CONFIG_ESP_RMAKER_MQTT_BUDGET_CLASSES
+#define BUDGET_BUCKETS              ESP_RMAKER_MQTT_BUDGET_CLASS_MAX
+/* Indexed by esp_rmaker_mqtt_budget_class_t */
+static const int default_budget[BUDGET_BUCKETS] = {
+    CONFIG_ESP_RMAKER_MQTT_CONTROL_DEFAULT_BUDGET,
+    DEFAULT_BUDGET,
+    CONFIG_ESP_RMAKER_MQTT_TELEMETRY_DEFAULT_BUDGET,
+};
+static const int max_budget[BUDGET_BUCKETS] = {
+    CONFIG_ESP_RMAKER_MQTT_CONTROL_MAX_BUDGET,
+    MAX_BUDGET,
+    CONFIG_ESP_RMAKER_MQTT_TELEMETRY_MAX_BUDGET,
+};
+static atomic_int mqtt_budget[BUDGET_BUCKETS] = {
+    CONFIG_ESP_RMAKER_MQTT_CONTROL_DEFAULT_BUDGET,
+    DEFAULT_BUDGET,
+    CONFIG_ESP_RMAKER_MQTT_TELEMETRY_DEFAULT_BUDGET,
+};
+/* Buckets are in the order of priority and a class can use the budget of the lower priority ones */
+#define BUDGET_BUCKET(budget_class)  (budget_class)
+#else
+#define BUDGET_BUCKETS              1
+static const int max_budget[BUDGET_BUCKETS] = {MAX_BUDGET};
+static atomic_int mqtt_budget[BUDGET_BUCKETS] = {DEFAULT_BUDGET};
+#define BUDGET_BUCKET(budget_class)  0
+#endif /* CONFIG_ESP_RMAKER_MQTT_BUDGET_CLASSES */
+
+/* The budget is revived lazily, whenever it is accessed, based on the number of revive periods
+ * elapsed since mqtt_budget_revive_tick. This is advanced only in multiples of the revive period,
+ * so that the partially elapsed period is not lost.
+ */
+static atomic_uint mqtt_budget_revive_tick;
+static atomic_bool mqtt_budget_running;
+static bool mqtt_budget_initialised;
+
+static atomic_uint mqtt_budget_granted[ESP_RMAKER_MQTT_BUDGET_CLASS_MAX];
+static atomic_uint mqtt_budget_denied[ESP_RMAKER_MQTT_BUDGET_CLASS_MAX];
+
+/* Adds to the budget of all the buckets, capping each at its max */
+static void esp_rmaker_mqtt_budget_add(int budget)
+{
+    for (int i = 0; i < BUDGET_BUCKETS; i++) {
+        int cur = atomic_load(&mqtt_budget[i]);
+        int new_budget;
+        do {
+            new_budget = (cur + budget > max_budget[i]) ? max_budget[i] : cur + budget;
+            if (new_budget <= cur) {
+                break;
+            }
+        } while (!atomic_compare_exchange_weak(&mqtt_budget[i], &cur, new_budget));
+    }
+}
+
+/* Consumes up to the given budget from a bucket and returns the amount consumed */
+static int esp_rmaker_mqtt_budget_take(int bucket, int budget)
+{
+    int cur = atomic_load(&mqtt_budget[bucket]);
+    int consumed;
+    do {
+        consumed = (cur < budget) ? cur : budget;
+        if (consumed <= 0) {
+            return 0;
+        }
+    } while (!atomic_compare_exchange_weak(&mqtt_budget[bucket], &cur, cur - consumed));
+    return consumed;
+}
+
+static void esp_rmaker_mqtt_budget_revive(void)
+{
+    if (!atomic_load(&mqtt_budget_running)) {
+        return;
+    }
+    unsigned int last_tick = atomic_load(&mqtt_budget_revive_tick);
+    uint32_t periods = (uint32_t)(xTaskGetTickCount() - last_tick) / BUDGET_REVIVE_TICKS;
+    if (periods == 0) {
+        return;
+    }
+    /* Only the caller which succeeds in advancing the tick revives the budget, so that
+     * a period is never accounted for twice.
+     */
+    if (!atomic_compare_exchange_strong(&mqtt_budget_revive_tick, &last_tick,
+                last_tick + periods * BUDGET_REVIVE_TICKS)) {
+        return;
+    }
+    /* Capping the periods, since the budget cannot go beyond the max anyway */
+    if (periods > MAX_BUDGET) {
+        periods = MAX_BUDGET;
+    }
+    esp_rmaker_mqtt_budget_add(periods * BUDGET_REVIVE_COUNT);
+    ESP_LOGD(TAG, "MQTT budget revived for %"PRIu32" period(s).", periods);
+    esp_rmaker_mqtt_budget_revived();
+}
+
+bool esp_rmaker_mqtt_is_class_budget_available(esp_rmaker_mqtt_budget_class_t budget_class)
+{
+    if (budget_class >= ESP_RMAKER_MQTT_BUDGET_CLASS_MAX) {
+        return false;
+    }
+    esp_rmaker_mqtt_budget_revive();
+    for (int i = BUDGET_BUCKET(budget_class); i < BUDGET_BUCKETS; i++) {
+        if (atomic_load(&mqtt_budget[i]) > 0) {
+            return true;
+        }
+    }
+    return false;
+}
 
 bool esp_rmaker_mqtt_is_budget_available(void)
 {
-    if (mqtt_budget_lock == NULL) {
-        ESP_LOGW(TAG, "MQTT budgeting not started yet. Allowing publish.");
-        return true;
+    return esp_rmaker_mqtt_is_class_budget_available(ESP_RMAKER_MQTT_BUDGET_CLASS_STATE);
+}
+
+int esp_rmaker_mqtt_reserve_budget(esp_rmaker_mqtt_budget_class_t budget_class)
+{
+    if (budget_class >= ESP_RMAKER_MQTT_BUDGET_CLASS_MAX) {
+        return -1;
     }
-    if (xSemaphoreTake(mqtt_budget_lock, SEMAPHORE_DELAY_MSEC/portTICK_PERIOD_MS) != pdTRUE) {
-        ESP_LOGW(TAG, "Could not acquire MQTT budget lock. Allowing publish.");
-        return true;
+    esp_rmaker_mqtt_budget_revive();
+    /* Use the class' own budget first and then that of the lower priority classes */
+    for (int i = BUDGET_BUCKET(budget_class); i < BUDGET_BUCKETS; i++) {
+        if (esp_rmaker_mqtt_budget_take(i, 1)) {
+            atomic_fetch_add(&mqtt_budget_granted[budget_class], 1);
+            return i;
+        }
+    }
+    atomic_fetch_add(&mqtt_budget_denied[budget_class], 1);
+    return -1;
+}
+
+void esp_rmaker_mqtt_release_budget(esp_rmaker_mqtt_budget_class_t budget_class, int reservation)
+{
+    if ((reservation < 0) || (reservation >= BUDGET_BUCKETS) || (budget_class >= ESP_RMAKER_MQTT_BUDGET_CLASS_MAX)) {
+        return;
     }
-    int16_t budget = mqtt_budget;
-    xSemaphoreGive(mqtt_budget_lock);
-    return budget ? true : false;
+    atomic_fetch_add(&mqtt_budget[reservation], 1);
+    atomic_fetch_sub(&mqtt_budget_granted[budget_class], 1);
 }
 
 esp_err_t esp_rmaker_mqtt_increase_budget(uint8_t budget)
 {
-    if (mqtt_budget_lock == NULL) {
+    if (!mqtt_budget_initialised) {
         ESP_LOGW(TAG, "MQTT budgeting not started. Not increasing the budget.");
         return ESP_FAIL;
     }
-    if (xSemaphoreTake(mqtt_budget_lock, SEMAPHORE_DELAY_MSEC/portTICK_PERIOD_MS) != pdTRUE) {
-        ESP_LOGE(TAG, "Failed to increase MQTT budget.");
-        return ESP_FAIL;
-    }
-    mqtt_budget += budget;
-    if (mqtt_budget > MAX_BUDGET) {
-        mqtt_budget = MAX_BUDGET;
-    }
-    xSemaphoreGive(mqtt_budget_lock);
-    ESP_LOGD(TAG, "MQTT budget increased to %d", mqtt_budget);
+    esp_rmaker_mqtt_budget_add(budget);
+    ESP_LOGD(TAG, "MQTT budget increased by %d", budget);
     return ESP_OK;
 }
 
 esp_err_t esp_rmaker_mqtt_decrease_budget(uint8_t budget)
 {
-    if (mqtt_budget_lock == NULL) {
+    if (!mqtt_budget_initialised) {
         ESP_LOGW(TAG, "MQTT budgeting not started. Not decreasing the budget.");
         return ESP_FAIL;
     }
-    if (xSemaphoreTake(mqtt_budget_lock, SEMAPHORE_DELAY_MSEC/portTICK_PERIOD_MS) != pdTRUE) {
-        ESP_LOGE(TAG, "Failed to decrease MQTT budget.");
-        return ESP_FAIL;
-    }
-    mqtt_budget -= budget;
-    if (mqtt_budget < 0) {
-        mqtt_budget = 0;
+    for (int i = BUDGET_BUCKET(ESP_RMAKER_MQTT_BUDGET_CLASS_STATE); (i < BUDGET_BUCKETS) && budget; i++) {
+        budget -= esp_rmaker_mqtt_budget_take(i, budget);
     }
-    xSemaphoreGive(mqtt_budget_lock);
-    ESP_LOGD(TAG, "MQTT budget decreased to %d.", mqtt_budget);
+    ESP_LOGD(TAG, "MQTT budget decreased.");
     return ESP_OK;
 }
 
-static void esp_rmaker_mqtt_revive_budget(TimerHandle_t handle)
+esp_err_t esp_rmaker_mqtt_get_budget_stats(esp_rmaker_mqtt_budget_class_t budget_class,
+        esp_rmaker_mqtt_budget_stats_t *stats)
 {
-    esp_rmaker_mqtt_increase_budget(BUDGET_REVIVE_COUNT);
+    if ((budget_class >= ESP_RMAKER_MQTT_BUDGET_CLASS_MAX) || !stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_rmaker_mqtt_budget_revive();
+    stats->granted = atomic_load(&mqtt_budget_granted[budget_class]);
+    stats->denied = atomic_load(&mqtt_budget_denied[budget_class]);
+    stats->budget = atomic_load(&mqtt_budget[BUDGET_BUCKET(budget_class)]);
+    return ESP_OK;
 }
 
 esp_err_t esp_rmaker_mqtt_budgeting_start(void)
 {
-    if (mqtt_budget_timer) {
-        xTimerStart(mqtt_budget_timer, 0);
-        return ESP_OK;
+    if (!mqtt_budget_initialised) {
+        return ESP_FAIL;
     }
-    return ESP_FAIL;
+    /* The budget revives only while budgeting is running, so start counting the periods afresh */
+    if (!atomic_load(&mqtt_budget_running)) {
+        atomic_store(&mqtt_budget_revive_tick, xTaskGetTickCount());
+        atomic_store(&mqtt_budget_running, true);
+    }
+    return ESP_OK;
 }
 
 esp_err_t esp_rmaker_mqtt_budgeting_stop(void)
 {
-    if (mqtt_budget_timer) {
-        xTimerStop(mqtt_budget_timer, 100);
-        return ESP_OK;
+    if (!mqtt_budget_initialised) {
+        return ESP_FAIL;
     }
-    return ESP_FAIL;
+    /* Accounting for the periods elapsed till now, before stopping */
+    esp_rmaker_mqtt_budget_revive();
+    atomic_store(&mqtt_budget_running, false);
+    return ESP_OK;
 }
 
 esp_err_t esp_rmaker_mqtt_budgeting_deinit(void)
 {
-    if (mqtt_budget_timer) {
+    if (mqtt_budget_initialised) {
         esp_rmaker_mqtt_budgeting_stop();
-        xTimerDelete(mqtt_budget_timer, 100);
-        mqtt_budget_timer = NULL;
-    }
-    if (mqtt_budget_lock) {
-        vSemaphoreDelete(mqtt_budget_lock);
-        mqtt_budget_lock = NULL;
+        mqtt_budget_initialised = false;
     }
     return ESP_OK;
 }
 
 esp_err_t esp_rmaker_mqtt_budgeting_init(void)
 {
-    if (mqtt_budget_timer) {
+    if (mqtt_budget_initialised) {
         ESP_LOGI(TAG, "MQTT budgeting already initialised.");
         return ESP_OK;
     }
-
-    mqtt_budget_lock = xSemaphoreCreateMutex();
-    if (!mqtt_budget_lock) {
-        return ESP_FAIL;
-    }
-
-    mqtt_budget_timer = xTimerCreate("mqtt_budget_tm", (BUDGET_REVIVE_PERIOD * 1000) / portTICK_PERIOD_MS,
-                            pdTRUE, NULL, esp_rmaker_mqtt_revive_budget);
-    if (mqtt_budget_timer) {
-        ESP_LOGI(TAG, "MQTT Budgeting initialised. Default: %d, Max: %d, Revive count: %d, Revive period: %d",
-                DEFAULT_BUDGET, MAX_BUDGET, BUDGET_REVIVE_COUNT, BUDGET_REVIVE_PERIOD);
-        return ESP_OK;
-    }
-    return ESP_FAIL;
+    mqtt_budget_initialised = true;
+    ESP_LOGI(TAG, "MQTT Budgeting initialised. Default: %d, Max: %d, Revive count: %d, Revive period: %d",
+            DEFAULT_BUDGET, MAX_BUDGET, BUDGET_REVIVE_COUNT, BUDGET_REVIVE_PERIOD);
+#ifdef CONFIG_ESP_RMAKER_MQTT_BUDGET_CLASSES
+    ESP_LOGI(TAG, "Control budget Default: %d, Max: %d. Telemetry budget Default: %d, Max: %d",
+            default_budget[ESP_RMAKER_MQTT_BUDGET_CLASS_CONTROL], max_budget[ESP_RMAKER_MQTT_BUDGET_CLASS_CONTROL],
+            default_budget[ESP_RMAKER_MQTT_BUDGET_CLASS_TELEMETRY], max_budget[ESP_RMAKER_MQTT_BUDGET_CLASS_TELEMETRY]);
+#endif /* CONFIG_ESP_RMAKER_MQTT_BUDGET_CLASSES */
+    return ESP_OK;
 }
 
 #else /* ! CONFIG_ESP_RMAKER_MQTT_ENABLE_BUDGETING */
@@ -175,9 +287,43 @@ esp_err_t esp_rmaker_mqtt_decrease_budget(uint8_t budget)
     return ESP_OK;
 }
 
+static atomic_uint mqtt_budget_granted[ESP_RMAKER_MQTT_BUDGET_CLASS_MAX];
+
+int esp_rmaker_mqtt_reserve_budget(esp_rmaker_mqtt_budget_class_t budget_class)
+{
+    if (budget_class >= ESP_RMAKER_MQTT_BUDGET_CLASS_MAX) {
+        return -1;
+    }
+    atomic_fetch_add(&mqtt_budget_granted[budget_class], 1);
+    return 0;
+}
+
+void esp_rmaker_mqtt_release_budget(esp_rmaker_mqtt_budget_class_t budget_class, int reservation)
+{
+    if ((reservation == 0) && (budget_class < ESP_RMAKER_MQTT_BUDGET_CLASS_MAX)) {
+        atomic_fetch_sub(&mqtt_budget_granted[budget_class], 1);
+    }
+}
+
 bool esp_rmaker_mqtt_is_budget_available(void)
 {
     return true;
 }
 
+bool esp_rmaker_mqtt_is_class_budget_available(esp_rmaker_mqtt_budget_class_t budget_class)
+{
+    return true;
+}
+
+esp_err_t esp_rmaker_mqtt_get_budget_stats(esp_rmaker_mqtt_budget_class_t budget_class,
+        esp_rmaker_mqtt_budget_stats_t *stats)
+{
+    if ((budget_class >= ESP_RMAKER_MQTT_BUDGET_CLASS_MAX) || !stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(stats, 0, sizeof(*stats));
+    stats->granted = atomic_load(&mqtt_budget_granted[budget_class]);
+    return ESP_OK;
+}
+
 #endif /* ! CONFIG_ESP_RMAKER_MQTT_ENABLE_BUDGETING */
@@ -8,6 +8,7 @@
 
 #include <stdint.h>
 #include <esp_err.h>
+#include <esp_rmaker_mqtt.h>
 
 esp_err_t esp_rmaker_mqtt_budgeting_init(void);
 esp_err_t esp_rmaker_mqtt_budgeting_deinit(void);
@@ -15,3 +16,11 @@ esp_err_t esp_rmaker_mqtt_budgeting_stop(void);
 esp_err_t esp_rmaker_mqtt_budgeting_start(void);
 esp_err_t esp_rmaker_mqtt_increase_budget(uint8_t budget);
 esp_err_t esp_rmaker_mqtt_decrease_budget(uint8_t budget);
+/* Atomically reserves budget for a single message of the given class, updating the class' statistics.
+ * Returns the reservation (>= 0) to be passed to esp_rmaker_mqtt_release_budget() if the message could
+ * not be sent eventually, or -1 if the budget is exhausted.
+ */
+int esp_rmaker_mqtt_reserve_budget(esp_rmaker_mqtt_budget_class_t budget_class);
+void esp_rmaker_mqtt_release_budget(esp_rmaker_mqtt_budget_class_t budget_class, int reservation);
+/* Implemented by esp_rmaker_mqtt.c. Invoked when the budget is revived on access, so that queued messages can be sent */
+void esp_rmaker_mqtt_budget_revived(void);
@@ -0,0 +1,14 @@
+/*
+ * SPDX-FileCopyrightText: 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <esp_err.h>
+
+/* Sets the node_id for the node/<node_id>/# subscription of CONFIG_ESP_RMAKER_MQTT_SUBSCRIBE_DISPATCHER,
+ * instead of the one from esp_rmaker_get_node_id(). This is meant for tests, which do not initialise
+ * the node, and works only while no topic is subscribed to through the dispatcher.
+ */
+esp_err_t esp_rmaker_mqtt_dispatcher_set_node_id(const char *node_id);
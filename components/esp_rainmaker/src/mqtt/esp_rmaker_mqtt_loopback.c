@@ -0,0 +1,391 @@
+/*
+ * SPDX-FileCopyrightText: 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <sdkconfig.h>
+#include <string.h>
+#include <esp_log.h>
+#include <esp_event.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/timers.h>
+#include <esp_rmaker_common_events.h>
+#include <esp_rmaker_work_queue.h>
+#include <esp_rmaker_utils.h>
+#include <esp_rmaker_mqtt.h>
+#include <esp_rmaker_mqtt_loopback.h>
+
+#ifdef CONFIG_ESP_RMAKER_MQTT_LOOPBACK
+
+static const char *TAG = "esp_rmaker_mqtt_loopback";
+
+#define LOOPBACK_MAX_SUBSCRIPTIONS  CONFIG_ESP_RMAKER_MQTT_LOOPBACK_MAX_SUBSCRIPTIONS
+#define LOOPBACK_MAX_RECORDS        CONFIG_ESP_RMAKER_MQTT_LOOPBACK_RECORDS
+
+typedef struct {
+    char *topic;
+    esp_rmaker_mqtt_subscribe_cb_t cb;
+    void *priv_data;
+} esp_rmaker_mqtt_loopback_sub_t;
+
+/* A message to be delivered to the subscriptions. The topic and payload are in the same allocation. */
+typedef struct {
+    char *topic;
+    size_t data_len;
+    char data[];
+} esp_rmaker_mqtt_loopback_msg_t;
+
+typedef struct {
+    esp_rmaker_mqtt_loopback_msg_t *msg;
+    TimerHandle_t timer;
+    uint32_t remaining;
+    bool unlimited;
+} esp_rmaker_mqtt_loopback_injection_t;
+
+static SemaphoreHandle_t loopback_lock;
+static bool loopback_connected;
+static int loopback_msg_id;
+static esp_rmaker_mqtt_loopback_publish_cb_t loopback_publish_cb;
+static void *loopback_publish_cb_priv_data;
+static esp_rmaker_mqtt_loopback_sub_t loopback_subs[LOOPBACK_MAX_SUBSCRIPTIONS];
+static esp_rmaker_mqtt_loopback_record_t loopback_records[LOOPBACK_MAX_RECORDS];
+static size_t loopback_record_head;
+static size_t loopback_record_count;
+static esp_rmaker_mqtt_loopback_stats_t loopback_stats;
+static esp_rmaker_mqtt_loopback_injection_t loopback_injection;
+
+/* Matches the topic against an MQTT topic filter, which may have the + and # wildcards */
+static bool esp_rmaker_mqtt_loopback_topic_matches(const char *filter, const char *topic)
+{
+    while (*filter) {
+        if (*filter == '#') {
+            return true;
+        }
+        if (*filter == '+') {
+            while (*topic && (*topic != '/')) {
+                topic++;
+            }
+            filter++;
+            continue;
+        }
+        if (*filter != *topic) {
+            return false;
+        }
+        filter++;
+        topic++;
+    }
+    return (*topic == '\0');
+}
+
+static esp_rmaker_mqtt_loopback_msg_t *esp_rmaker_mqtt_loopback_msg_create(const char *topic, const void *data, size_t data_len)
+{
+    size_t topic_len = strlen(topic);
+    /* +1 for NULL termination of the payload and the topic */
+    esp_rmaker_mqtt_loopback_msg_t *msg = MEM_CALLOC_EXTRAM(1, sizeof(esp_rmaker_mqtt_loopback_msg_t) + data_len + 1 + topic_len + 1);
+    if (!msg) {
+        ESP_LOGE(TAG, "Failed to allocate memory for message on %s.", topic);
+        return NULL;
+    }
+    memcpy(msg->data, data, data_len);
+    msg->data_len = data_len;
+    msg->topic = msg->data + data_len + 1;
+    memcpy(msg->topic, topic, topic_len);
+    return msg;
+}
+
+static void esp_rmaker_mqtt_loopback_deliver(void *priv_data)
+{
+    esp_rmaker_mqtt_loopback_msg_t *msg = (esp_rmaker_mqtt_loopback_msg_t *)priv_data;
+    esp_rmaker_mqtt_loopback_sub_t matches[LOOPBACK_MAX_SUBSCRIPTIONS];
+    int match_count = 0;
+    xSemaphoreTake(loopback_lock, portMAX_DELAY);
+    for (int i = 0; i < LOOPBACK_MAX_SUBSCRIPTIONS; i++) {
+        if (loopback_subs[i].topic && esp_rmaker_mqtt_loopback_topic_matches(loopback_subs[i].topic, msg->topic)) {
+            matches[match_count++] = loopback_subs[i];
+        }
+    }
+    if (match_count) {
+        loopback_stats.delivered_count++;
+    } else {
+        loopback_stats.unmatched_count++;
+    }
+    xSemaphoreGive(loopback_lock);
+    /* The callbacks are invoked without holding the lock, so that they can publish/subscribe */
+    for (int i = 0; i < match_count; i++) {
+        matches[i].cb(msg->topic, msg->data, msg->data_len, matches[i].priv_data);
+    }
+    if (!match_count) {
+        ESP_LOGD(TAG, "No subscription for %s.", msg->topic);
+    }
+    free(msg);
+}
+
+/* Delivery is always asynchronous, through the work queue, like the messages received from a broker */
+static esp_err_t esp_rmaker_mqtt_loopback_queue_delivery(const char *topic, const void *data, size_t data_len)
+{
+    esp_rmaker_mqtt_loopback_msg_t *msg = esp_rmaker_mqtt_loopback_msg_create(topic, data, data_len);
+    if (!msg) {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t err = esp_rmaker_work_queue_add_task(esp_rmaker_mqtt_loopback_deliver, msg);
+    if (err != ESP_OK) {
+        free(msg);
+    }
+    return err;
+}
+
+static esp_rmaker_mqtt_conn_params_t *esp_rmaker_mqtt_loopback_get_conn_params(void)
+{
+    /* No credentials are required. This is freed by the caller. */
+    return MEM_CALLOC_EXTRAM(1, sizeof(esp_rmaker_mqtt_conn_params_t));
+}
+
+static esp_err_t esp_rmaker_mqtt_loopback_init(esp_rmaker_mqtt_conn_params_t *conn_params)
+{
+    if (!loopback_lock) {
+        loopback_lock = xSemaphoreCreateMutex();
+        if (!loopback_lock) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    return ESP_OK;
+}
+
+static void esp_rmaker_mqtt_loopback_deinit(void)
+{
+    esp_rmaker_mqtt_loopback_stop_injection();
+    for (int i = 0; i < LOOPBACK_MAX_SUBSCRIPTIONS; i++) {
+        if (loopback_subs[i].topic) {
+            free(loopback_subs[i].topic);
+        }
+    }
+    memset(loopback_subs, 0, sizeof(loopback_subs));
+    loopback_connected = false;
+}
+
+static esp_err_t esp_rmaker_mqtt_loopback_connect(void)
+{
+    loopback_connected = true;
+    ESP_LOGI(TAG, "Connected to loopback MQTT.");
+    return esp_event_post(RMAKER_COMMON_EVENT, RMAKER_MQTT_EVENT_CONNECTED, NULL, 0, portMAX_DELAY);
+}
+
+static esp_err_t esp_rmaker_mqtt_loopback_disconnect(void)
+{
+    loopback_connected = false;
+    return esp_event_post(RMAKER_COMMON_EVENT, RMAKER_MQTT_EVENT_DISCONNECTED, NULL, 0, portMAX_DELAY);
+}
+
+static esp_err_t esp_rmaker_mqtt_loopback_publish(const char *topic, void *data, size_t data_len, uint8_t qos, int *msg_id)
+{
+    if (!loopback_connected || !loopback_lock) {
+        return ESP_FAIL;
+    }
+    int64_t timestamp_us = esp_timer_get_time();
+    xSemaphoreTake(loopback_lock, portMAX_DELAY);
+    esp_rmaker_mqtt_loopback_record_t *record = &loopback_records[(loopback_record_head + loopback_record_count) % LOOPBACK_MAX_RECORDS];
+    if (loopback_record_count < LOOPBACK_MAX_RECORDS) {
+        loopback_record_count++;
+    } else {
+        /* Overwriting the oldest record */
+        loopback_record_head = (loopback_record_head + 1) % LOOPBACK_MAX_RECORDS;
+    }
+    record->timestamp_us = timestamp_us;
+    record->data_len = data_len;
+    record->qos = qos;
+    strlcpy(record->topic, topic, sizeof(record->topic));
+    loopback_stats.publish_count++;
+    loopback_stats.publish_bytes += data_len;
+    int id = ++loopback_msg_id;
+    bool has_subscriber = false;
+    for (int i = 0; i < LOOPBACK_MAX_SUBSCRIPTIONS; i++) {
+        if (loopback_subs[i].topic && esp_rmaker_mqtt_loopback_topic_matches(loopback_subs[i].topic, topic)) {
+            has_subscriber = true;
+            break;
+        }
+    }
+    xSemaphoreGive(loopback_lock);
+
+    if (loopback_publish_cb) {
+        loopback_publish_cb(topic, data, data_len, loopback_publish_cb_priv_data);
+    }
+    /* Like a broker, deliver the message to the node's own matching subscriptions, if any */
+    if (has_subscriber) {
+        esp_rmaker_mqtt_loopback_queue_delivery(topic, data, data_len);
+    }
+    if (msg_id) {
+        *msg_id = id;
+    }
+    if (qos > 0) {
+        esp_event_post(RMAKER_COMMON_EVENT, RMAKER_MQTT_EVENT_PUBLISHED, &id, sizeof(id), portMAX_DELAY);
+    }
+    return ESP_OK;
+}
+
+static esp_err_t esp_rmaker_mqtt_loopback_subscribe(const char *topic, esp_rmaker_mqtt_subscribe_cb_t cb, uint8_t qos, void *priv_data)
+{
+    if (!loopback_lock) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_err_t err = ESP_ERR_NO_MEM;
+    xSemaphoreTake(loopback_lock, portMAX_DELAY);
+    for (int i = 0; i < LOOPBACK_MAX_SUBSCRIPTIONS; i++) {
+        if (!loopback_subs[i].topic) {
+            loopback_subs[i].topic = strdup(topic);
+            if (loopback_subs[i].topic) {
+                loopback_subs[i].cb = cb;
+                loopback_subs[i].priv_data = priv_data;
+                err = ESP_OK;
+            }
+            break;
+        }
+    }
+    xSemaphoreGive(loopback_lock);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to subscribe to %s.", topic);
+    }
+    return err;
+}
+
+static esp_err_t esp_rmaker_mqtt_loopback_unsubscribe(const char *topic)
+{
+    if (!loopback_lock) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(loopback_lock, portMAX_DELAY);
+    for (int i = 0; i < LOOPBACK_MAX_SUBSCRIPTIONS; i++) {
+        if (loopback_subs[i].topic && (strcmp(loopback_subs[i].topic, topic) == 0)) {
+            free(loopback_subs[i].topic);
+            memset(&loopback_subs[i], 0, sizeof(loopback_subs[i]));
+        }
+    }
+    xSemaphoreGive(loopback_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_rmaker_mqtt_loopback_setup(esp_rmaker_mqtt_loopback_publish_cb_t publish_cb, void *priv_data)
+{
+    loopback_publish_cb = publish_cb;
+    loopback_publish_cb_priv_data = priv_data;
+    esp_rmaker_mqtt_config_t mqtt_config = {
+        .get_conn_params = esp_rmaker_mqtt_loopback_get_conn_params,
+        .init = esp_rmaker_mqtt_loopback_init,
+        .deinit = esp_rmaker_mqtt_loopback_deinit,
+        .connect = esp_rmaker_mqtt_loopback_connect,
+        .disconnect = esp_rmaker_mqtt_loopback_disconnect,
+        .publish = esp_rmaker_mqtt_loopback_publish,
+        .subscribe = esp_rmaker_mqtt_loopback_subscribe,
+        .unsubscribe = esp_rmaker_mqtt_loopback_unsubscribe,
+    };
+    return esp_rmaker_mqtt_setup(mqtt_config);
+}
+
+esp_err_t esp_rmaker_mqtt_loopback_inject(const char *topic, const void *data, size_t data_len)
+{
+    if (!topic || !data) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!loopback_connected) {
+        ESP_LOGE(TAG, "Loopback MQTT not connected.");
+        return ESP_ERR_INVALID_STATE;
+    }
+    return esp_rmaker_mqtt_loopback_queue_delivery(topic, data, data_len);
+}
+
+static void esp_rmaker_mqtt_loopback_injection_timer_cb(TimerHandle_t timer)
+{
+    esp_rmaker_mqtt_loopback_injection_t *injection = &loopback_injection;
+    if (!injection->msg) {
+        return;
+    }
+    esp_rmaker_mqtt_loopback_inject(injection->msg->topic, injection->msg->data, injection->msg->data_len);
+    if (!injection->unlimited && (--injection->remaining == 0)) {
+        xTimerStop(timer, 0);
+    }
+}
+
+esp_err_t esp_rmaker_mqtt_loopback_start_injection(const char *topic, const void *data, size_t data_len,
+        uint32_t period_ms, uint32_t count)
+{
+    if (!topic || !data || (pdMS_TO_TICKS(period_ms) == 0)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_rmaker_mqtt_loopback_stop_injection();
+    esp_rmaker_mqtt_loopback_injection_t *injection = &loopback_injection;
+    injection->msg = esp_rmaker_mqtt_loopback_msg_create(topic, data, data_len);
+    if (!injection->msg) {
+        return ESP_ERR_NO_MEM;
+    }
+    injection->remaining = count;
+    injection->unlimited = (count == 0);
+    injection->timer = xTimerCreate("mqtt_loopback_tm", pdMS_TO_TICKS(period_ms), pdTRUE, NULL,
+            esp_rmaker_mqtt_loopback_injection_timer_cb);
+    if (!injection->timer || (xTimerStart(injection->timer, 0) != pdPASS)) {
+        ESP_LOGE(TAG, "Failed to start the injection timer.");
+        esp_rmaker_mqtt_loopback_stop_injection();
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_rmaker_mqtt_loopback_stop_injection(void)
+{
+    esp_rmaker_mqtt_loopback_injection_t *injection = &loopback_injection;
+    if (injection->timer) {
+        xTimerStop(injection->timer, portMAX_DELAY);
+        xTimerDelete(injection->timer, portMAX_DELAY);
+        injection->timer = NULL;
+    }
+    if (injection->msg) {
+        free(injection->msg);
+        injection->msg = NULL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_rmaker_mqtt_loopback_get_stats(esp_rmaker_mqtt_loopback_stats_t *stats)
+{
+    if (!stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!loopback_lock) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    xSemaphoreTake(loopback_lock, portMAX_DELAY);
+    *stats = loopback_stats;
+    xSemaphoreGive(loopback_lock);
+    return ESP_OK;
+}
+
+size_t esp_rmaker_mqtt_loopback_get_records(esp_rmaker_mqtt_loopback_record_t *records, size_t max_records)
+{
+    if (!records || !loopback_lock) {
+        return 0;
+    }
+    xSemaphoreTake(loopback_lock, portMAX_DELAY);
+    /* Skipping the older records, if all do not fit */
+    size_t skip = (loopback_record_count > max_records) ? (loopback_record_count - max_records) : 0;
+    size_t count = loopback_record_count - skip;
+    for (size_t i = 0; i < count; i++) {
+        records[i] = loopback_records[(loopback_record_head + skip + i) % LOOPBACK_MAX_RECORDS];
+    }
+    xSemaphoreGive(loopback_lock);
+    return count;
+}
+
+void esp_rmaker_mqtt_loopback_reset(void)
+{
+    if (!loopback_lock) {
+        return;
+    }
+    xSemaphoreTake(loopback_lock, portMAX_DELAY);
+    loopback_record_head = 0;
+    loopback_record_count = 0;
+    memset(&loopback_stats, 0, sizeof(loopback_stats));
+    xSemaphoreGive(loopback_lock);
+}
+
+#endif /* CONFIG_ESP_RMAKER_MQTT_LOOPBACK */
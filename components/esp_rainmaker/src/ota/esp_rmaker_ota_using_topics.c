@@ -75,10 +75,8 @@ esp_err_t esp_rmaker_ota_report_status_using_topics(esp_rmaker_ota_handle_t ota_
     json_gen_end_object(&jstr);
     json_gen_str_end(&jstr);
 
-    char publish_topic[MQTT_TOPIC_BUFFER_SIZE];
-    esp_rmaker_create_mqtt_topic(publish_topic, sizeof(publish_topic), OTASTATUS_TOPIC_SUFFIX, OTASTATUS_TOPIC_RULE);
     ESP_LOGI(TAG, "%s",publish_payload);
-    esp_err_t err = esp_rmaker_mqtt_publish(publish_topic, publish_payload, strlen(publish_payload),
+    esp_err_t err = esp_rmaker_mqtt_publish(esp_rmaker_mqtt_get_topic(ESP_RMAKER_MQTT_TOPIC_OTASTATUS), publish_payload, strlen(publish_payload),
                         RMAKER_MQTT_QOS1, NULL);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "esp_rmaker_mqtt_publish_data returned error %d",err);
@@ -252,9 +250,7 @@ esp_err_t esp_rmaker_ota_fetch(void)
     json_gen_obj_set_string(&jstr, "fw_version", info->fw_version);
     json_gen_end_object(&jstr);
     json_gen_str_end(&jstr);
-    char publish_topic[MQTT_TOPIC_BUFFER_SIZE];
-    esp_rmaker_create_mqtt_topic(publish_topic, sizeof(publish_topic), OTAFETCH_TOPIC_SUFFIX, OTAFETCH_TOPIC_RULE);
-    esp_err_t err = esp_rmaker_mqtt_publish(publish_topic, publish_payload, strlen(publish_payload),
+    esp_err_t err = esp_rmaker_mqtt_publish(esp_rmaker_mqtt_get_topic(ESP_RMAKER_MQTT_TOPIC_OTAFETCH), publish_payload, strlen(publish_payload),
                         RMAKER_MQTT_QOS1, NULL);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "OTA Fetch Publish Error %d", err);
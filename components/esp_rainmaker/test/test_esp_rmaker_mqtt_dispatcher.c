@@ -0,0 +1,199 @@
+/*
+ * SPDX-FileCopyrightText: 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <sdkconfig.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <esp_event.h>
+#include <unity.h>
+#include <esp_rmaker_work_queue.h>
+#include <esp_rmaker_mqtt.h>
+#include <esp_rmaker_mqtt_loopback.h>
+#include "mqtt/esp_rmaker_mqtt_dispatcher.h"
+
+#if defined(CONFIG_ESP_RMAKER_MQTT_SUBSCRIBE_DISPATCHER) && defined(CONFIG_ESP_RMAKER_MQTT_LOOPBACK)
+
+#define TEST_NODE_ID        "test_node"
+#define TEST_NODE_TOPIC(s)  "node/" TEST_NODE_ID "/" s
+/* Outside the node prefix, so subscribed to with the loopback glue directly */
+#define TEST_SYNC_TOPIC     "test/sync"
+#define TEST_WAIT_MSEC      2000
+
+typedef struct {
+    uint32_t count;
+    char topic[ESP_RMAKER_MQTT_LOOPBACK_TOPIC_LEN];
+    char payload[32];
+} test_handler_t;
+
+/* Handlers for topics sharing prefixes, to check that the trie does not match partially */
+static test_handler_t test_remote;
+static test_handler_t test_remote_long;
+static test_handler_t test_to_node;
+static test_handler_t test_wildcard;
+static SemaphoreHandle_t test_sync_sem;
+
+static void test_handler_cb(const char *topic, void *payload, size_t payload_len, void *priv_data)
+{
+    test_handler_t *handler = (test_handler_t *)priv_data;
+    handler->count++;
+    strlcpy(handler->topic, topic, sizeof(handler->topic));
+    size_t len = (payload_len < sizeof(handler->payload)) ? payload_len : sizeof(handler->payload) - 1;
+    memcpy(handler->payload, payload, len);
+    handler->payload[len] = '\0';
+}
+
+static void test_sync_cb(const char *topic, void *payload, size_t payload_len, void *priv_data)
+{
+    xSemaphoreGive(test_sync_sem);
+}
+
+/* Messages are delivered in order through the work queue. So, once the sync message is received,
+ * all the messages injected before it have been dispatched.
+ */
+static void test_sync(void)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, esp_rmaker_mqtt_loopback_inject(TEST_SYNC_TOPIC, "", 0));
+    TEST_ASSERT_EQUAL(pdTRUE, xSemaphoreTake(test_sync_sem, pdMS_TO_TICKS(TEST_WAIT_MSEC)));
+}
+
+static void test_inject(const char *topic, const char *payload)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, esp_rmaker_mqtt_loopback_inject(topic, payload, strlen(payload)));
+}
+
+static void test_reset_handlers(void)
+{
+    memset(&test_remote, 0, sizeof(test_remote));
+    memset(&test_remote_long, 0, sizeof(test_remote_long));
+    memset(&test_to_node, 0, sizeof(test_to_node));
+    memset(&test_wildcard, 0, sizeof(test_wildcard));
+}
+
+static void test_setup(void)
+{
+    static bool setup_done;
+    if (setup_done) {
+        return;
+    }
+    esp_err_t err = esp_event_loop_create_default();
+    TEST_ASSERT(err == ESP_OK || err == ESP_ERR_INVALID_STATE);
+    test_sync_sem = xSemaphoreCreateBinary();
+    TEST_ASSERT_NOT_NULL(test_sync_sem);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_rmaker_work_queue_init());
+    TEST_ASSERT_EQUAL(ESP_OK, esp_rmaker_work_queue_start());
+    TEST_ASSERT_EQUAL(ESP_OK, esp_rmaker_mqtt_loopback_setup(NULL, NULL));
+    /* The loopback glue does not need any connection params */
+    TEST_ASSERT_EQUAL(ESP_OK, esp_rmaker_mqtt_init(NULL));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_rmaker_mqtt_dispatcher_set_node_id(TEST_NODE_ID));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_rmaker_mqtt_connect());
+    TEST_ASSERT_EQUAL(ESP_OK, esp_rmaker_mqtt_subscribe(TEST_SYNC_TOPIC, test_sync_cb, RMAKER_MQTT_QOS1, NULL));
+    setup_done = true;
+}
+
+TEST_CASE("MQTT dispatcher delivers to the handler of the exact topic", "[esp_rmaker_mqtt]")
+{
+    test_setup();
+    test_reset_handlers();
+    TEST_ASSERT_EQUAL(ESP_OK, esp_rmaker_mqtt_subscribe(TEST_NODE_TOPIC("params/remote"), test_handler_cb,
+                RMAKER_MQTT_QOS1, &test_remote));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_rmaker_mqtt_subscribe(TEST_NODE_TOPIC("params/remote/long"), test_handler_cb,
+                RMAKER_MQTT_QOS1, &test_remote_long));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_rmaker_mqtt_subscribe(TEST_NODE_TOPIC("to-node"), test_handler_cb,
+                RMAKER_MQTT_QOS1, &test_to_node));
+
+    test_inject(TEST_NODE_TOPIC("params/remote"), "remote");
+    test_inject(TEST_NODE_TOPIC("params/remote/long"), "long");
+    test_inject(TEST_NODE_TOPIC("to-node"), "to-node");
+    test_sync();
+    TEST_ASSERT_EQUAL(1, test_remote.count);
+    TEST_ASSERT_EQUAL_STRING(TEST_NODE_TOPIC("params/remote"), test_remote.topic);
+    TEST_ASSERT_EQUAL_STRING("remote", test_remote.payload);
+    TEST_ASSERT_EQUAL(1, test_remote_long.count);
+    TEST_ASSERT_EQUAL_STRING("long", test_remote_long.payload);
+    TEST_ASSERT_EQUAL(1, test_to_node.count);
+    TEST_ASSERT_EQUAL_STRING("to-node", test_to_node.payload);
+
+    /* Prefixes and extensions of the subscribed topics, and other nodes' topics, reach no handler */
+    test_inject(TEST_NODE_TOPIC("params"), "x");
+    test_inject(TEST_NODE_TOPIC("params/remot"), "x");
+    test_inject(TEST_NODE_TOPIC("params/remote/"), "x");
+    test_inject(TEST_NODE_TOPIC("to-node2"), "x");
+    test_inject("node/other_node/params/remote", "x");
+    test_sync();
+    TEST_ASSERT_EQUAL(1, test_remote.count);
+    TEST_ASSERT_EQUAL(1, test_remote_long.count);
+    TEST_ASSERT_EQUAL(1, test_to_node.count);
+
+    /* Re-subscribing replaces the handler */
+    TEST_ASSERT_EQUAL(ESP_OK, esp_rmaker_mqtt_subscribe(TEST_NODE_TOPIC("to-node"), test_handler_cb,
+                RMAKER_MQTT_QOS1, &test_remote));
+    test_inject(TEST_NODE_TOPIC("to-node"), "replaced");
+    test_sync();
+    TEST_ASSERT_EQUAL(2, test_remote.count);
+    TEST_ASSERT_EQUAL_STRING("replaced", test_remote.payload);
+    TEST_ASSERT_EQUAL(1, test_to_node.count);
+
+    TEST_ASSERT_EQUAL(ESP_OK, esp_rmaker_mqtt_unsubscribe(TEST_NODE_TOPIC("params/remote")));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_rmaker_mqtt_unsubscribe(TEST_NODE_TOPIC("params/remote/long")));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_rmaker_mqtt_unsubscribe(TEST_NODE_TOPIC("to-node")));
+}
+
+TEST_CASE("MQTT dispatcher shares a single subscription", "[esp_rmaker_mqtt]")
+{
+    test_setup();
+    test_reset_handlers();
+    esp_rmaker_mqtt_loopback_stats_t stats;
+    TEST_ASSERT_EQUAL(ESP_OK, esp_rmaker_mqtt_subscribe(TEST_NODE_TOPIC("params/remote"), test_handler_cb,
+                RMAKER_MQTT_QOS1, &test_remote));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_rmaker_mqtt_subscribe(TEST_NODE_TOPIC("to-node"), test_handler_cb,
+                RMAKER_MQTT_QOS1, &test_to_node));
+    /* Topics with wildcards of their own are subscribed to with the glue directly */
+    TEST_ASSERT_EQUAL(ESP_OK, esp_rmaker_mqtt_subscribe(TEST_NODE_TOPIC("+/wildcard"), test_handler_cb,
+                RMAKER_MQTT_QOS1, &test_wildcard));
+
+    /* Removing one of the handlers keeps the node/<node_id>/# subscription for the others */
+    TEST_ASSERT_EQUAL(ESP_OK, esp_rmaker_mqtt_unsubscribe(TEST_NODE_TOPIC("params/remote")));
+    test_inject(TEST_NODE_TOPIC("params/remote"), "x");
+    test_inject(TEST_NODE_TOPIC("to-node"), "to-node");
+    test_inject(TEST_NODE_TOPIC("a/wildcard"), "wildcard");
+    test_sync();
+    TEST_ASSERT_EQUAL(0, test_remote.count);
+    TEST_ASSERT_EQUAL(1, test_to_node.count);
+    TEST_ASSERT_EQUAL(1, test_wildcard.count);
+    TEST_ASSERT_EQUAL_STRING(TEST_NODE_TOPIC("a/wildcard"), test_wildcard.topic);
+
+    /* Removing the last handler removes the node/<node_id>/# subscription too */
+    TEST_ASSERT_EQUAL(ESP_OK, esp_rmaker_mqtt_unsubscribe(TEST_NODE_TOPIC("to-node")));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_rmaker_mqtt_unsubscribe(TEST_NODE_TOPIC("+/wildcard")));
+    test_sync();
+    TEST_ASSERT_EQUAL(ESP_OK, esp_rmaker_mqtt_loopback_get_stats(&stats));
+    uint32_t unmatched_count = stats.unmatched_count;
+    test_inject(TEST_NODE_TOPIC("to-node"), "x");
+    test_sync();
+    TEST_ASSERT_EQUAL(ESP_OK, esp_rmaker_mqtt_loopback_get_stats(&stats));
+    TEST_ASSERT_EQUAL(unmatched_count + 1, stats.unmatched_count);
+    TEST_ASSERT_EQUAL(1, test_to_node.count);
+}
+
+TEST_CASE("MQTT dispatcher ignores the node's own publishes", "[esp_rmaker_mqtt]")
+{
+    test_setup();
+    test_reset_handlers();
+    TEST_ASSERT_EQUAL(ESP_OK, esp_rmaker_mqtt_subscribe(TEST_NODE_TOPIC("params/remote"), test_handler_cb,
+                RMAKER_MQTT_QOS1, &test_remote));
+    /* Without the Basic Ingest Topics, the broker echoes these back on node/<node_id>/#.
+     * The loopback glue does the same, and the dispatcher should drop them.
+     */
+    char payload[] = "{\"Light\":{\"Power\":true}}";
+    TEST_ASSERT_EQUAL(ESP_OK, esp_rmaker_mqtt_publish(TEST_NODE_TOPIC("params/local"), payload, strlen(payload),
+                RMAKER_MQTT_QOS0, NULL));
+    test_sync();
+    TEST_ASSERT_EQUAL(0, test_remote.count);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_rmaker_mqtt_unsubscribe(TEST_NODE_TOPIC("params/remote")));
+}
+
+#endif /* CONFIG_ESP_RMAKER_MQTT_SUBSCRIBE_DISPATCHER && CONFIG_ESP_RMAKER_MQTT_LOOPBACK */
@@ -17,158 +17,219 @@
 #include <esp_log.h>
 #include <esp_sntp.h>
 #include <esp_rmaker_utils.h>
+#include <freertos/semphr.h>
 #include "esp_schedule_internal.h"
 
 static const char *TAG = "esp_schedule";
 
 #define SECONDS_TILL_2020 ((2020 - 1970) * 365 * 24 * 3600)
 #define SECONDS_IN_DAY (60 * 60 * 24)
+/* Maximum period, in seconds, for which the schedule timer is armed */
+#define ESP_SCHEDULE_TIMER_MAX_PERIOD (60 * 60)
+/* Ticks after which the timer callback runs again, if it could not get the schedule lock */
+#define ESP_SCHEDULE_LOCK_RETRY_TICKS (pdMS_TO_TICKS(10) + 1)
 
 static bool init_done = false;
 
-static int esp_schedule_get_no_of_days(esp_schedule_t *schedule, struct tm *current_time, struct tm *schedule_time)
+/* Days before the start of each month, in a non leap year */
+static const uint16_t days_before_month[12] = {0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334};
+
+static bool esp_schedule_is_leap_year(int year)
 {
-    /* for day, monday = 0, sunday = 6. */
-    int next_day = 0;
-    /* struct tm has tm_wday with sunday as 0. Whereas we have monday as 0. Converting struct tm to our format */
-    int today = ((current_time->tm_wday + 7 - 1) % 7);
+    return ((year % 4 == 0) && (year % 100 != 0)) || (year % 400 == 0);
+}
 
-    esp_schedule_days_t today_bit = 1 << today;
-    uint8_t repeat_days = schedule->trigger.day.repeat_days;
-    int current_seconds = (current_time->tm_hour * 60 + current_time->tm_min) * 60 + current_time->tm_sec;
-    int schedule_seconds = (schedule_time->tm_hour * 60 + schedule_time->tm_min) * 60;
+/* Days since 1970-01-01 for the given date. month starts from 0 and can be more than 11, and day can be more than
+ * the number of days in the month. These get normalised like in mktime().
+ */
+static int32_t esp_schedule_get_days_since_epoch(int year, int month, int day)
+{
+    year += month / 12;
+    month = month % 12;
+    int32_t prev_year = year - 1;
+    /* 477 is the number of leap days before 1970 */
+    int32_t days = (year - 1970) * 365 + (prev_year / 4 - prev_year / 100 + prev_year / 400) - 477;
+    days += days_before_month[month] + day - 1;
+    if ((month > 1) && esp_schedule_is_leap_year(year)) {
+        days++;
+    }
+    return days;
+}
 
-    /* Handling for one time schedule */
-    if (repeat_days == ESP_SCHEDULE_DAY_ONCE) {
-        if (schedule_seconds > current_seconds) {
-            /* The schedule is today and is yet to go off */
-            return 0;
+/* Local time as seconds since 1970-01-01 00:00:00, i.e. the timestamp as if the local time was UTC */
+static time_t esp_schedule_get_local_seconds(struct tm *local_time)
+{
+    return (time_t)esp_schedule_get_days_since_epoch(local_time->tm_year + 1900, local_time->tm_mon, local_time->tm_mday) * SECONDS_IN_DAY
+            + (local_time->tm_hour * 60 + local_time->tm_min) * 60 + local_time->tm_sec;
+}
+
+/* Offset of the local time from UTC, at the given UTC timestamp */
+static time_t esp_schedule_get_utc_offset(time_t utc)
+{
+    struct tm local_time;
+    localtime_r(&utc, &local_time);
+    return esp_schedule_get_local_seconds(&local_time) - utc;
+}
+
+/* Converts local seconds to UTC timestamp without mktime(). utc_offset is the offset of the local time from UTC
+ * at some time close to the target, which is then corrected using the offset at the target itself, so that DST
+ * changes in between are accounted. A local time which does not exist, since it is in the gap created by moving
+ * the clock forward for DST, is mapped to the first valid time after the gap, i.e. the time of the DST change.
+ */
+static time_t esp_schedule_local_to_utc(time_t local_seconds, time_t utc_offset)
+{
+    time_t utc = local_seconds - utc_offset;
+    time_t target_offset = esp_schedule_get_utc_offset(utc);
+    if (target_offset == utc_offset) {
+        return utc;
+    }
+    time_t corrected_utc = local_seconds - target_offset;
+    if (esp_schedule_get_utc_offset(corrected_utc) == target_offset) {
+        return corrected_utc;
+    }
+    /* The local time is in a gap. The DST change is between the two timestamps, with the local time being
+     * earlier than the target before it, and later after it. Search for the time of the change.
+     */
+    time_t before = (utc < corrected_utc) ? utc : corrected_utc;
+    time_t after = (utc < corrected_utc) ? corrected_utc : utc;
+    while ((after - before) > 1) {
+        time_t mid = before + (after - before) / 2;
+        if ((mid + esp_schedule_get_utc_offset(mid)) < local_seconds) {
+            before = mid;
         } else {
-            /* The schedule is tomorrow */
-            return 1;
+            after = mid;
         }
     }
+    return after;
+}
 
-    /* Handling for repeating schedules */
-    /* Check if it is today */
-    if ((repeat_days & today_bit)) {
-        if (schedule_seconds > current_seconds) {
-            /* The schedule is today and is yet to go off. */
-            return 0;
-        }
-    }
-    /* Check if it is this week or next week */
-    if ((repeat_days & (today_bit ^ 0xFF)) > today_bit) {
-        /* Next schedule is yet to come in this week */
-        next_day = ffs(repeat_days & (0xFF << (today + 1))) - 1;
-        return (next_day - today);
-    } else {
-        /* First scheduled day of the next week */
-        next_day = ffs(repeat_days) - 1;
-        if (next_day == today) {
-            /* Same day, next week */
-            return 7;
-        }
-        return (7 - today + next_day);
+static void esp_schedule_compile(esp_schedule_t *schedule)
+{
+    esp_schedule_compiled_t *compiled = &schedule->compiled;
+    uint8_t repeat_days = schedule->trigger.day.repeat_days & ESP_SCHEDULE_DAY_EVERYDAY;
+    /* For day, monday = 0, sunday = 6. struct tm has tm_wday with sunday as 0. Converting to the struct tm format */
+    compiled->wday_mask = ((repeat_days << 1) | (repeat_days >> 6)) & ESP_SCHEDULE_DAY_EVERYDAY;
+    compiled->day_seconds = (schedule->trigger.hours * 60 + schedule->trigger.minutes) * 60;
+    compiled->next_utc = 0;
+    compiled->valid = true;
+}
+
+static int esp_schedule_get_no_of_days(esp_schedule_t *schedule, struct tm *current_time, int current_seconds)
+{
+    bool passed_today = (schedule->compiled.day_seconds <= current_seconds);
+
+    /* Handling for one time schedule */
+    if (schedule->trigger.day.repeat_days == ESP_SCHEDULE_DAY_ONCE) {
+        /* Either today, or tomorrow if the time has already passed */
+        return passed_today ? 1 : 0;
     }
 
-    ESP_LOGE(TAG, "No of days could not be found. This should not happen.");
-    return 0;
+    /* Rotate the days so that today is bit 0 */
+    uint8_t wday_mask = schedule->compiled.wday_mask;
+    int today = current_time->tm_wday;
+    uint8_t days = ((wday_mask >> today) | (wday_mask << (7 - today))) & ESP_SCHEDULE_DAY_EVERYDAY;
+    if (passed_today) {
+        days &= ~1;
+    }
+    if (days == 0) {
+        /* Same day, next week */
+        return 7;
+    }
+    return ffs(days) - 1;
 }
 
-static uint8_t esp_schedule_get_next_month(esp_schedule_t *schedule, struct tm *current_time, struct tm *schedule_time)
+/* Returns the month of the next schedule, starting from 0 for January of the year set in *next_year.
+ * This can be more than 11 if the schedule is in the following year.
+ */
+static int esp_schedule_get_next_month(esp_schedule_t *schedule, struct tm *current_time, int current_seconds, int *next_year)
 {
-    int current_seconds = (current_time->tm_hour * 60 + current_time->tm_min) * 60 + current_time->tm_sec;
-    int schedule_seconds = (schedule_time->tm_hour * 60 + schedule_time->tm_min) * 60;
-    /* +1 is because struct tm has months starting from 0, whereas we have them starting from 1 */
-    uint8_t current_month = current_time->tm_mon + 1;
-    /* -1 because month_bit starts from 0b1. So for January, it should be 1 << 0. And current_month starts from 1. */
-    uint16_t current_month_bit = 1 << (current_month - 1);
-    uint8_t next_schedule_month = 0;
+    int current_year = current_time->tm_year + 1900;
+    int current_month = current_time->tm_mon;
     uint16_t repeat_months = schedule->trigger.date.repeat_months;
+    bool upcoming_this_month = (schedule->trigger.date.day > current_time->tm_mday) ||
+            ((schedule->trigger.date.day == current_time->tm_mday) && (schedule->compiled.day_seconds > current_seconds));
+
+    *next_year = (schedule->trigger.date.year > current_year) ? schedule->trigger.date.year : current_year;
 
     /* Check if month is not specified */
     if (repeat_months == ESP_SCHEDULE_MONTH_ONCE) {
-        if (schedule->trigger.date.day == current_time->tm_mday) {
-            /* The schedule day is same. Check if time has already passed */
-            if (schedule_seconds > current_seconds) {
-                /* The schedule is today and is yet to go off */
-                return current_month;
-            } else {
-                /* Today's time has passed */
-                return (current_month + 1);
-            }
-        } else if (schedule->trigger.date.day > current_time->tm_mday) {
-            /* The day is yet to come in this month */
-            return current_month;
-        } else {
-            /* The day has passed in the current month */
-            return (current_month + 1);
-        }
+        return upcoming_this_month ? current_month : (current_month + 1);
     }
 
     /* Check if schedule is not this year itself, it is in future. */
-    if (schedule->trigger.date.year > (current_time->tm_year + 1900)) {
-        /* Find first schedule month of next year */
-        next_schedule_month = ffs(repeat_months);
-        /* Year will be handled by the caller. So no need to add any additional months */
-        return next_schedule_month;
+    if (schedule->trigger.date.year > current_year) {
+        /* First schedule month of that year */
+        return ffs(repeat_months) - 1;
     }
 
     /* Check if schedule is this month and is yet to come */
-    if (current_month_bit & repeat_months) {
-        if (schedule->trigger.date.day == current_time->tm_mday) {
-            /* The schedule day is same. Check if time has already passed */
-            if (schedule_seconds > current_seconds) {
-                /* The schedule is today and is yet to go off */
-                return current_month;
-            }
-        }
-        if (schedule->trigger.date.day > current_time->tm_mday) {
-            /* The day is yet to come in this month */
-            return current_month;
-        }
+    if (upcoming_this_month && (repeat_months & (1 << current_month))) {
+        return current_month;
     }
 
-    /* Check if schedule is this year */
-    if ((repeat_months & (current_month_bit ^ 0xFFFF)) > current_month_bit) {
-        /* Next schedule month is yet to come in this year */
-        next_schedule_month = ffs(repeat_months & (0xFFFF << (current_month)));
-        return next_schedule_month;
+    /* Check if schedule is later this year */
+    uint16_t later_months = repeat_months & (0xFFFF << (current_month + 1));
+    if (later_months) {
+        return ffs(later_months) - 1;
     }
 
     /* Check if schedule is for this year and does not repeat */
     if (!schedule->trigger.date.repeat_every_year) {
-        if (schedule->trigger.date.year <= (current_time->tm_year + 1900)) {
-            ESP_LOGE(TAG, "Schedule does not repeat next year, but get_next_month has been called.");
-            return 0;
-        }
+        ESP_LOGE(TAG, "Schedule does not repeat next year, but get_next_month has been called. Setting it to next month.");
+        return current_month + 1;
     }
 
-    /* Schedule is not this year */
-    /* Find first schedule month of next year */
-    next_schedule_month = ffs(repeat_months);
-    /* +12 because the schedule is next year */
-    return (next_schedule_month + 12);
+    /* First schedule month of next year */
+    return ffs(repeat_months) - 1 + 12;
 }
 
-static uint16_t esp_schedule_get_next_year(esp_schedule_t *schedule, struct tm *current_time, struct tm *schedule_time)
+time_t esp_schedule_get_next_time(esp_schedule_t *schedule, time_t now)
 {
-    uint16_t current_year = current_time->tm_year + 1900;
-    uint16_t schedule_year = schedule->trigger.date.year;
-    if (schedule_year > current_year) {
-        return schedule_year;
+    struct tm current_time;
+
+    if (!schedule->compiled.valid) {
+        esp_schedule_compile(schedule);
     }
-    /* If the schedule is set to repeat_every_year, we return the current year */
-    /* If the schedule has already passed in this year, we still return current year, as the additional months will be handled in get_next_month */
-    return current_year;
+    /* The next schedule time should be after the last time the schedule was triggered, even if the system time
+     * has gone back since then. Else, the same schedule would get triggered again.
+     */
+    if (now < schedule->compiled.triggered_utc) {
+        now = schedule->compiled.triggered_utc;
+    }
+    /* The next schedule time computed earlier is valid till it passes, unless the schedule gets changed */
+    if ((schedule->compiled.next_utc > now) && (schedule->compiled.next_utc == schedule->trigger.next_scheduled_time_utc)) {
+        return schedule->compiled.next_utc;
+    }
+
+    localtime_r(&now, &current_time);
+    int current_seconds = (current_time.tm_hour * 60 + current_time.tm_min) * 60 + current_time.tm_sec;
+    int year = current_time.tm_year + 1900;
+    int month = current_time.tm_mon;
+    int day = current_time.tm_mday;
+
+    /* Adjust schedule day */
+    if (schedule->trigger.type == ESP_SCHEDULE_TYPE_DAYS_OF_WEEK) {
+        day += esp_schedule_get_no_of_days(schedule, &current_time, current_seconds);
+    } else if (schedule->trigger.type == ESP_SCHEDULE_TYPE_DATE) {
+        month = esp_schedule_get_next_month(schedule, &current_time, current_seconds, &year);
+        day = schedule->trigger.date.day;
+    }
+
+    /* Convert the local schedule time to UTC. This also takes care of any DST change till then. */
+    time_t current_local_seconds = esp_schedule_get_local_seconds(&current_time);
+    time_t schedule_local_seconds = (time_t)esp_schedule_get_days_since_epoch(year, month, day) * SECONDS_IN_DAY
+            + schedule->compiled.day_seconds;
+    time_t next_scheduled_time = esp_schedule_local_to_utc(schedule_local_seconds, current_local_seconds - now);
+
+    /* For one time schedules to check for expiry after a reboot. If NVS is enabled, this should be stored in NVS. */
+    schedule->trigger.next_scheduled_time_utc = next_scheduled_time;
+    schedule->compiled.next_utc = next_scheduled_time;
+    return next_scheduled_time;
 }
 
 static uint32_t esp_schedule_get_next_schedule_time_diff(esp_schedule_t *schedule)
 {
-    struct tm current_time, schedule_time;
     time_t now;
-    char time_str[64];
     int32_t time_diff;
 
     /* Get current time */
@@ -180,73 +241,21 @@ static uint32_t esp_schedule_get_next_schedule_time_diff(esp_schedule_t *schedul
         /* If next scheduled time is already set, just compute the difference
          * between current time and next scheduled time and return that diff.
          */
-        time_t target;
         if (schedule->trigger.next_scheduled_time_utc > 0) {
-            target = (time_t)schedule->trigger.next_scheduled_time_utc;
-            time_diff = difftime(target, now);
+            time_diff = schedule->trigger.next_scheduled_time_utc - now;
         } else {
-            target = now + (time_t)schedule->trigger.relative_seconds;
+            schedule->trigger.next_scheduled_time_utc = now + (time_t)schedule->trigger.relative_seconds;
             time_diff = schedule->trigger.relative_seconds;
         }
-        localtime_r(&target, &schedule_time);
-        schedule->trigger.next_scheduled_time_utc = mktime(&schedule_time);
-        /* Print schedule time */
-        memset(time_str, 0, sizeof(time_str));
-        strftime(time_str, sizeof(time_str), "%c %z[%Z]", &schedule_time);
-        ESP_LOGI(TAG, "Schedule %s will be active on: %s. DST: %s", schedule->name, time_str, schedule_time.tm_isdst ? "Yes" : "No");
+        ESP_LOGI(TAG, "Schedule %s will be active on: %lld (UTC timestamp)", schedule->name,
+                (long long)schedule->trigger.next_scheduled_time_utc);
         return time_diff;
     }
-    localtime_r(&now, &current_time);
-
-    /* Get schedule time */
-    localtime_r(&now, &schedule_time);
-    schedule_time.tm_sec = 0;
-    schedule_time.tm_min = schedule->trigger.minutes;
-    schedule_time.tm_hour = schedule->trigger.hours;
-    mktime(&schedule_time);
-
-    /* Adjust schedule day */
-    if (schedule->trigger.type == ESP_SCHEDULE_TYPE_DAYS_OF_WEEK) {
-        int no_of_days = 0;
-        no_of_days = esp_schedule_get_no_of_days(schedule, &current_time, &schedule_time);
-        schedule_time.tm_sec += no_of_days * SECONDS_IN_DAY;
-    }
-    if (schedule->trigger.type == ESP_SCHEDULE_TYPE_DATE) {
-        schedule_time.tm_mday = schedule->trigger.date.day;
-        schedule_time.tm_mon = esp_schedule_get_next_month(schedule, &current_time, &schedule_time) - 1;
-        schedule_time.tm_year = esp_schedule_get_next_year(schedule, &current_time, &schedule_time) - 1900;
-        if (schedule_time.tm_mon < 0) {
-            ESP_LOGE(TAG, "Invalid month found: %d. Setting it to next month.", schedule_time.tm_mon);
-            schedule_time.tm_mon = current_time.tm_mon + 1;
-        }
-        if (schedule_time.tm_mon >= 12) {
-            schedule_time.tm_year += schedule_time.tm_mon / 12;
-            schedule_time.tm_mon = schedule_time.tm_mon % 12;
-        }
-    }
-    mktime(&schedule_time);
-
-    /* Adjust time according to DST */
-    time_t dst_adjust = 0;
-    if (!current_time.tm_isdst && schedule_time.tm_isdst) {
-        dst_adjust = -3600;
-    } else if (current_time.tm_isdst && !schedule_time.tm_isdst ) {
-        dst_adjust = 3600;
-    }
-    ESP_LOGD(TAG, "DST adjust seconds: %lld", (long long) dst_adjust);
-    schedule_time.tm_sec += dst_adjust;
-    mktime(&schedule_time);
-
-    /* Print schedule time */
-    memset(time_str, 0, sizeof(time_str));
-    strftime(time_str, sizeof(time_str), "%c %z[%Z]", &schedule_time);
-    ESP_LOGI(TAG, "Schedule %s will be active on: %s. DST: %s", schedule->name, time_str, schedule_time.tm_isdst ? "Yes" : "No");
 
-    /* Calculate difference */
-    time_diff = difftime((mktime(&schedule_time)), mktime(&current_time));
-
-    /* For one time schedules to check for expiry after a reboot. If NVS is enabled, this should be stored in NVS. */
-    schedule->trigger.next_scheduled_time_utc = mktime(&schedule_time);
+    time_t next_scheduled_time = esp_schedule_get_next_time(schedule, now);
+    time_diff = next_scheduled_time - now;
+    ESP_LOGI(TAG, "Schedule %s will be active on: %lld (UTC timestamp), in %"PRIi32" seconds", schedule->name,
+            (long long)next_scheduled_time, time_diff);
 
     return time_diff;
 }
@@ -306,12 +315,177 @@ static bool esp_schedule_is_expired(esp_schedule_t *schedule)
     return false;
 }
 
+/* All the enabled schedules are kept in a binary min-heap ordered by their next trigger time, and a single
+ * timer is armed for the earliest one. So, adding, editing or removing a schedule is O(log n) and the
+ * number of schedules does not affect the number of timers.
+ */
+static esp_schedule_t **schedule_heap;
+static size_t schedule_heap_count;
+static size_t schedule_heap_capacity;
+static TimerHandle_t schedule_timer;
+static SemaphoreHandle_t schedule_lock;
+/* Incremented whenever the timer period is computed, to detect the timer getting armed concurrently */
+static uint32_t schedule_timer_gen;
+/* Incremented for every run of the timer callback, so that a schedule gets triggered at most once in a run */
+static uint32_t schedule_timer_cb_run;
+
+static bool esp_schedule_heap_less(size_t a, size_t b)
+{
+    return schedule_heap[a]->trigger.next_scheduled_time_utc < schedule_heap[b]->trigger.next_scheduled_time_utc;
+}
+
+static void esp_schedule_heap_set(size_t pos, esp_schedule_t *schedule)
+{
+    schedule_heap[pos] = schedule;
+    schedule->heap_pos = pos + 1;
+}
+
+static void esp_schedule_heap_swap(size_t a, size_t b)
+{
+    esp_schedule_t *schedule = schedule_heap[a];
+    esp_schedule_heap_set(a, schedule_heap[b]);
+    esp_schedule_heap_set(b, schedule);
+}
+
+static void esp_schedule_heap_sift_up(size_t pos)
+{
+    while (pos > 0) {
+        size_t parent = (pos - 1) / 2;
+        if (!esp_schedule_heap_less(pos, parent)) {
+            break;
+        }
+        esp_schedule_heap_swap(pos, parent);
+        pos = parent;
+    }
+}
+
+static void esp_schedule_heap_sift_down(size_t pos)
+{
+    while (true) {
+        size_t smallest = pos;
+        size_t left = 2 * pos + 1;
+        size_t right = left + 1;
+        if ((left < schedule_heap_count) && esp_schedule_heap_less(left, smallest)) {
+            smallest = left;
+        }
+        if ((right < schedule_heap_count) && esp_schedule_heap_less(right, smallest)) {
+            smallest = right;
+        }
+        if (smallest == pos) {
+            break;
+        }
+        esp_schedule_heap_swap(pos, smallest);
+        pos = smallest;
+    }
+}
+
+/* Adds the schedule to the heap, or just moves it as per its new trigger time, if it is already there */
+static esp_err_t esp_schedule_heap_add(esp_schedule_t *schedule)
+{
+    if (schedule->heap_pos) {
+        esp_schedule_heap_sift_up(schedule->heap_pos - 1);
+        esp_schedule_heap_sift_down(schedule->heap_pos - 1);
+        return ESP_OK;
+    }
+    if (schedule_heap_count == schedule_heap_capacity) {
+        size_t capacity = schedule_heap_capacity ? schedule_heap_capacity * 2 : 8;
+        esp_schedule_t **heap = MEM_REALLOC_EXTRAM(schedule_heap, capacity * sizeof(esp_schedule_t *));
+        if (!heap) {
+            ESP_LOGE(TAG, "Failed to allocate memory for %u schedules", (unsigned int)capacity);
+            return ESP_ERR_NO_MEM;
+        }
+        schedule_heap = heap;
+        schedule_heap_capacity = capacity;
+    }
+    esp_schedule_heap_set(schedule_heap_count++, schedule);
+    esp_schedule_heap_sift_up(schedule_heap_count - 1);
+    return ESP_OK;
+}
+
+static void esp_schedule_heap_remove(esp_schedule_t *schedule)
+{
+    if (!schedule->heap_pos) {
+        return;
+    }
+    size_t pos = schedule->heap_pos - 1;
+    schedule->heap_pos = 0;
+    if (pos == --schedule_heap_count) {
+        return;
+    }
+    esp_schedule_t *last = schedule_heap[schedule_heap_count];
+    esp_schedule_heap_set(pos, last);
+    esp_schedule_heap_sift_up(pos);
+    esp_schedule_heap_sift_down(last->heap_pos - 1);
+}
+
+/* Returns the period for which the timer is to be armed for the earliest schedule, or 0 if there are
+ * no enabled schedules. Should be called with schedule_lock held.
+ */
+static TickType_t esp_schedule_get_timer_period(void)
+{
+    if (schedule_heap_count == 0) {
+        return 0;
+    }
+    time_t now = 0;
+    time(&now);
+    time_t diff = schedule_heap[0]->trigger.next_scheduled_time_utc - now;
+    if (diff < 1) {
+        diff = 1;
+    } else if (diff > ESP_SCHEDULE_TIMER_MAX_PERIOD) {
+        /* The timer is re-armed periodically, so that corrections in the system time also get accounted */
+        diff = ESP_SCHEDULE_TIMER_MAX_PERIOD;
+    }
+    return (diff * 1000) / portTICK_PERIOD_MS;
+}
+
+/* Makes the timer callback run again shortly, when it could not get schedule_lock */
+static void esp_schedule_retry_timer(void)
+{
+    xTimerChangePeriod(schedule_timer, ESP_SCHEDULE_LOCK_RETRY_TICKS, 0);
+}
+
+/* Arms the timer for the earliest schedule and releases schedule_lock, which should be held by the caller.
+ * The timer commands are issued after releasing the lock, since they can block till the timer task processes
+ * them, while the timer task itself may be running the callback, which needs the lock. If the timer got armed
+ * by another task in the meantime, it is armed again, so that the period for the latest earliest schedule applies.
+ * wait should be 0 when called from the timer callback, since it must not block.
+ */
+static void esp_schedule_arm_timer_and_unlock(TickType_t wait)
+{
+    uint32_t gen;
+    do {
+        gen = ++schedule_timer_gen;
+        TickType_t period = esp_schedule_get_timer_period();
+        xSemaphoreGive(schedule_lock);
+        if (period) {
+            xTimerChangePeriod(schedule_timer, period, wait);
+        } else {
+            xTimerStop(schedule_timer, wait);
+        }
+        if (xSemaphoreTake(schedule_lock, wait) != pdTRUE) {
+            /* Only in the timer callback. The timer gets armed afresh when it runs again */
+            esp_schedule_retry_timer();
+            return;
+        }
+    } while (gen != schedule_timer_gen);
+    xSemaphoreGive(schedule_lock);
+}
+
 static void esp_schedule_stop_timer(esp_schedule_t *schedule)
 {
-    xTimerStop(schedule->timer, portMAX_DELAY);
+    xSemaphoreTake(schedule_lock, portMAX_DELAY);
+    if (schedule->heap_pos) {
+        bool earliest = (schedule->heap_pos == 1);
+        esp_schedule_heap_remove(schedule);
+        if (earliest) {
+            esp_schedule_arm_timer_and_unlock(portMAX_DELAY);
+            return;
+        }
+    }
+    xSemaphoreGive(schedule_lock);
 }
 
-static void esp_schedule_start_timer(esp_schedule_t *schedule)
+static void __esp_schedule_start_timer(esp_schedule_t *schedule, TickType_t wait)
 {
     time_t current_time = 0;
     time(&current_time);
@@ -327,31 +501,64 @@ static void esp_schedule_start_timer(esp_schedule_t *schedule)
         schedule->timestamp_cb((esp_schedule_handle_t)schedule, schedule->trigger.next_scheduled_time_utc, schedule->priv_data);
     }
 
-    xTimerStop(schedule->timer, portMAX_DELAY);
-    xTimerChangePeriod(schedule->timer, (schedule->next_scheduled_time_diff * 1000) / portTICK_PERIOD_MS, portMAX_DELAY);
+    /* This waits for the lock even in the timer callback, so that the schedule does not get lost. That is
+     * safe, since the lock is never held while issuing timer commands or invoking the schedule callbacks.
+     */
+    xSemaphoreTake(schedule_lock, portMAX_DELAY);
+    if ((esp_schedule_heap_add(schedule) == ESP_OK) && (schedule->heap_pos == 1)) {
+        esp_schedule_arm_timer_and_unlock(wait);
+        return;
+    }
+    xSemaphoreGive(schedule_lock);
+}
+
+static void esp_schedule_start_timer(esp_schedule_t *schedule)
+{
+    __esp_schedule_start_timer(schedule, portMAX_DELAY);
 }
 
 static void esp_schedule_common_timer_cb(TimerHandle_t timer)
 {
-    void *priv_data = pvTimerGetTimerID(timer);
-    if (priv_data == NULL) {
-        return;
-    }
-    esp_schedule_t *schedule = (esp_schedule_t *)priv_data;
-    ESP_LOGI(TAG, "Schedule %s triggered", schedule->name);
-    if (schedule->trigger_cb) {
-        schedule->trigger_cb((esp_schedule_handle_t)schedule, schedule->priv_data);
-    }
-    if (esp_schedule_is_expired(schedule)) {
-        /* Not deleting the schedule here. Just not starting it again. */
-        return;
+    time_t now = 0;
+    time(&now);
+    uint32_t run = ++schedule_timer_cb_run;
+    while (true) {
+        /* The timer task is not blocked waiting for the lock, since that would hold up all the other timers.
+         * The callback is run again shortly instead.
+         */
+        if (xSemaphoreTake(schedule_lock, 0) != pdTRUE) {
+            esp_schedule_retry_timer();
+            break;
+        }
+        /* A schedule which got started again for a time that has already passed is left for the next run,
+         * for which the timer gets armed for the minimum period, instead of triggering it again right away.
+         */
+        if ((schedule_heap_count == 0) || (schedule_heap[0]->trigger.next_scheduled_time_utc > now) ||
+                (schedule_heap[0]->compiled.triggered_run == run)) {
+            esp_schedule_arm_timer_and_unlock(0);
+            break;
+        }
+        esp_schedule_t *schedule = schedule_heap[0];
+        esp_schedule_heap_remove(schedule);
+        schedule->compiled.triggered_run = run;
+        xSemaphoreGive(schedule_lock);
+
+        ESP_LOGI(TAG, "Schedule %s triggered", schedule->name);
+        schedule->compiled.triggered_utc = schedule->trigger.next_scheduled_time_utc;
+        if (schedule->trigger_cb) {
+            schedule->trigger_cb((esp_schedule_handle_t)schedule, schedule->priv_data);
+        }
+        if (esp_schedule_is_expired(schedule)) {
+            /* Not deleting the schedule here. Just not starting it again. */
+            continue;
+        }
+        __esp_schedule_start_timer(schedule, 0);
     }
-    esp_schedule_start_timer(schedule);
 }
 
 static void esp_schedule_delete_timer(esp_schedule_t *schedule)
 {
-    xTimerDelete(schedule->timer, portMAX_DELAY);
+    esp_schedule_stop_timer(schedule);
 }
 
 static void esp_schedule_create_timer(esp_schedule_t *schedule)
@@ -360,9 +567,7 @@ static void esp_schedule_create_timer(esp_schedule_t *schedule)
         /* This is just used for calculating next_scheduled_time_utc for ESP_SCHEDULE_DAY_ONCE (in case of ESP_SCHEDULE_TYPE_DAYS_OF_WEEK) or for ESP_SCHEDULE_MONTH_ONCE (in case of ESP_SCHEDULE_TYPE_DATE), and only used when NVS is enabled. And if NVS is enabled, time will already be synced and the time will be correctly calculated. */
         schedule->next_scheduled_time_diff = esp_schedule_get_next_schedule_time_diff(schedule);
     }
-
-    /* Temporarily setting the timer for 1 (anything greater than 0) tick. This will get changed when xTimerChangePeriod() is called. */
-    schedule->timer = xTimerCreate("schedule", 1, pdFALSE, (void *)schedule, esp_schedule_common_timer_cb);
+    schedule->heap_pos = 0;
 }
 
 esp_err_t esp_schedule_get(esp_schedule_handle_t handle, esp_schedule_config_t *schedule_config)
@@ -439,6 +644,9 @@ static esp_err_t esp_schedule_set(esp_schedule_t *schedule, esp_schedule_config_
         }
     }
 
+    /* The compiled trigger gets re-created when required */
+    schedule->compiled.valid = false;
+
     schedule->trigger_cb = schedule_config->trigger_cb;
     schedule->timestamp_cb = schedule_config->timestamp_cb;
     schedule->priv_data = schedule_config->priv_data;
@@ -457,11 +665,21 @@ esp_err_t esp_schedule_edit(esp_schedule_handle_t handle, esp_schedule_config_t
         return ESP_FAIL;
     }
 
+    /* The schedule's trigger time is the key in the heap of enabled schedules.
+     * So, an enabled schedule is taken out of the heap while editing, and started again.
+     */
+    bool enabled = (schedule->heap_pos != 0);
+    if (enabled) {
+        esp_schedule_stop_timer(schedule);
+    }
     /* Editing a schedule with relative time should also reset it. */
     if (schedule->trigger.type == ESP_SCHEDULE_TYPE_RELATIVE) {
         schedule->trigger.next_scheduled_time_utc = 0;
     }
     esp_schedule_set(schedule, schedule_config);
+    if (enabled) {
+        esp_schedule_start_timer(schedule);
+    }
     ESP_LOGD(TAG, "Schedule %s edited", schedule->name);
     return ESP_OK;
 }
@@ -473,10 +691,7 @@ esp_err_t esp_schedule_delete(esp_schedule_handle_t handle)
     }
     esp_schedule_t *schedule = (esp_schedule_t *)handle;
     ESP_LOGI(TAG, "Deleting schedule %s", schedule->name);
-    if (schedule->timer) {
-        esp_schedule_stop_timer(schedule);
-        esp_schedule_delete_timer(schedule);
-    }
+    esp_schedule_delete_timer(schedule);
     esp_schedule_nvs_remove(schedule);
     free(schedule);
     return ESP_OK;
@@ -524,6 +739,16 @@ esp_schedule_handle_t *esp_schedule_init(bool enable_nvs, char *nvs_partition, u
     }
 #endif
 
+    if (!schedule_lock) {
+        schedule_lock = xSemaphoreCreateMutex();
+        /* Temporarily setting the timer for 1 (anything greater than 0) tick. This will get changed when xTimerChangePeriod() is called. */
+        schedule_timer = xTimerCreate("schedule", 1, pdFALSE, NULL, esp_schedule_common_timer_cb);
+        if (!schedule_lock || !schedule_timer) {
+            ESP_LOGE(TAG, "Failed to create schedule timer");
+            return NULL;
+        }
+    }
+
     if (!enable_nvs) {
         return NULL;
     }
@@ -548,7 +773,7 @@ esp_schedule_handle_t *esp_schedule_init(bool enable_nvs, char *nvs_partition, u
     for (size_t handle_count = 0; handle_count < *schedule_count; handle_count++) {
         schedule = (esp_schedule_t *)handle_list[handle_count];
         schedule->trigger_cb = NULL;
-        schedule->timer = NULL;
+        schedule->heap_pos = 0;
         /* Check for ONCE and expired schedules and delete them. */
         if (esp_schedule_is_expired(schedule)) {
             /* This schedule has already expired. */
@@ -14,22 +14,53 @@
 
 #pragma once
 
+#include <stdint.h>
+#include <stddef.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/timers.h>
 #include <esp_schedule.h>
 
+/* Trigger of a schedule compiled for computing the next schedule time quickly */
+typedef struct {
+    bool valid;
+    /* repeat_days with sunday as bit 0, like tm_wday of struct tm */
+    uint8_t wday_mask;
+    /* Schedule time as seconds since local midnight */
+    int32_t day_seconds;
+    /* Next schedule time computed last. Reused till it passes. */
+    time_t next_utc;
+    /* Schedule time at which the schedule was last triggered. The next schedule time is always after this. */
+    time_t triggered_utc;
+    /* Run of the timer callback in which the schedule was last triggered */
+    uint32_t triggered_run;
+} esp_schedule_compiled_t;
+
+/* Note that the schedules are stored in NVS as is, till the compiled trigger (ESP_SCHEDULE_NVS_BLOB_SIZE).
+ * So, the layout of this structure before that should not be changed.
+ */
 typedef struct esp_schedule {
     char name[MAX_SCHEDULE_NAME_LEN + 1];
     esp_schedule_trigger_t trigger;
     uint32_t next_scheduled_time_diff;
-    TimerHandle_t timer;
+    /* Index + 1 of the schedule in the heap of enabled schedules. 0 if not in the heap.
+     * This takes the place of the per schedule timer handle used earlier.
+     */
+    uintptr_t heap_pos;
     esp_schedule_trigger_cb_t trigger_cb;
     esp_schedule_timestamp_cb_t timestamp_cb;
     void *priv_data;
+    /* Not stored in NVS */
+    esp_schedule_compiled_t compiled;
 } esp_schedule_t;
 
+#define ESP_SCHEDULE_NVS_BLOB_SIZE offsetof(esp_schedule_t, compiled)
+
 esp_err_t esp_schedule_nvs_add(esp_schedule_t *schedule);
 esp_err_t esp_schedule_nvs_remove(esp_schedule_t *schedule);
 esp_schedule_handle_t *esp_schedule_nvs_get_all(uint8_t *schedule_count);
 bool esp_schedule_nvs_is_enabled(void);
+/* Next schedule time after now, for the schedules other than ESP_SCHEDULE_TYPE_RELATIVE. This does not depend on
+ * the system time, so that it can be tested for any time.
+ */
+time_t esp_schedule_get_next_time(esp_schedule_t *schedule, time_t now);
 esp_err_t esp_schedule_nvs_init(char *nvs_partition);
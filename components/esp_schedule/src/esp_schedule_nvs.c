@@ -54,7 +54,7 @@ esp_err_t esp_schedule_nvs_add(esp_schedule_t *schedule)
         ESP_LOGI(TAG, "Updating the existing schedule %s", schedule->name);
     }
 
-    err = nvs_set_blob(nvs_handle, schedule->name, schedule, sizeof(esp_schedule_t));
+    err = nvs_set_blob(nvs_handle, schedule->name, schedule, ESP_SCHEDULE_NVS_BLOB_SIZE);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "NVS set failed with error %d", err);
         nvs_close(nvs_handle);
@@ -191,7 +191,14 @@ static esp_schedule_handle_t esp_schedule_nvs_get(char *nvs_key)
         nvs_close(nvs_handle);
         return NULL;
     }
-    esp_schedule_t *schedule = (esp_schedule_t *)malloc(buf_size);
+    /* Older firmware stored the whole structure, including the padding at the end */
+    if (buf_size > sizeof(esp_schedule_t)) {
+        ESP_LOGE(TAG, "Invalid size %d of schedule %s in NVS", (int)buf_size, nvs_key);
+        nvs_close(nvs_handle);
+        return NULL;
+    }
+    /* calloc so that the fields not stored in NVS are cleared */
+    esp_schedule_t *schedule = (esp_schedule_t *)calloc(1, sizeof(esp_schedule_t));
     if (schedule == NULL) {
         ESP_LOGE(TAG, "Could not allocate handle");
         nvs_close(nvs_handle);
@@ -204,6 +211,8 @@ static esp_schedule_handle_t esp_schedule_nvs_get(char *nvs_key)
         free(schedule);
         return NULL;
     }
+    /* The padding stored by older firmware may overlap the fields not stored in NVS */
+    memset(&schedule->compiled, 0, sizeof(schedule->compiled));
     nvs_close(nvs_handle);
     ESP_LOGI(TAG, "Schedule %s found in NVS", schedule->name);
     return (esp_schedule_handle_t) schedule;
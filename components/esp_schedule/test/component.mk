@@ -0,0 +1,3 @@
+COMPONENT_PRIV_INCLUDEDIRS := ../src
+
+COMPONENT_ADD_LDFLAGS = -Wl,--whole-archive -l$(COMPONENT_NAME) -Wl,--no-whole-archive
@@ -0,0 +1,326 @@
+/*
+ * SPDX-FileCopyrightText: 2026 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unity.h>
+#include "esp_schedule_internal.h"
+
+#define SECONDS_IN_DAY (60 * 60 * 24)
+/* Schedule times are checked from 2021 till 2035, so that they are within the range of a 32 bit time_t */
+#define TEST_TIME_START 1609459200
+#define TEST_TIME_END 2051222400
+#define TEST_CASES_PER_TZ 1000
+
+/* Time zones with DST changes forwards and backwards, in both hemispheres, and by 30 minutes */
+static const char *test_time_zones[] = {
+    "UTC0",
+    "IST-5:30",
+    "EST5EDT,M3.2.0,M11.1.0",
+    "CET-1CEST,M3.5.0,M10.5.0/3",
+    "AEST-10AEDT,M10.1.0,M4.1.0/3",
+    "LHST-10:30LHDT-11,M10.1.0,M4.1.0",
+};
+
+/* xorshift32 with a fixed seed, so that the test cases are the same in every run */
+static uint32_t test_rand_state;
+
+static uint32_t test_rand(uint32_t range)
+{
+    test_rand_state ^= test_rand_state << 13;
+    test_rand_state ^= test_rand_state >> 17;
+    test_rand_state ^= test_rand_state << 5;
+    return test_rand_state % range;
+}
+
+/* Local time as seconds since 1970-01-01 00:00:00, i.e. the timestamp as if the local time was UTC */
+static time_t test_get_local_seconds(time_t utc)
+{
+    struct tm local_time;
+    localtime_r(&utc, &local_time);
+    int year = local_time.tm_year + 1900 - (local_time.tm_mon < 2);
+    int era = (year >= 0 ? year : year - 399) / 400;
+    int year_of_era = year - era * 400;
+    int day_of_year = (153 * (local_time.tm_mon + (local_time.tm_mon < 2 ? 10 : -2)) + 2) / 5 + local_time.tm_mday - 1;
+    int day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    time_t days = (time_t)era * 146097 + day_of_era - 719468;
+    return days * SECONDS_IN_DAY + (local_time.tm_hour * 60 + local_time.tm_min) * 60 + local_time.tm_sec;
+}
+
+static time_t test_get_utc_offset(time_t utc)
+{
+    return test_get_local_seconds(utc) - utc;
+}
+
+/* Returns the time of the first DST change after the given time, or 0 if there is none within a year */
+static time_t test_get_next_dst_change(time_t from)
+{
+    time_t offset = test_get_utc_offset(from);
+    time_t before = from;
+    time_t after = from;
+    for (int i = 0; i < 370; i++) {
+        after += SECONDS_IN_DAY;
+        if (test_get_utc_offset(after) != offset) {
+            break;
+        }
+        before = after;
+    }
+    if (test_get_utc_offset(after) == offset) {
+        return 0;
+    }
+    while ((after - before) > 1) {
+        time_t mid = before + (after - before) / 2;
+        if (test_get_utc_offset(mid) == offset) {
+            before = mid;
+        } else {
+            after = mid;
+        }
+    }
+    return after;
+}
+
+/* The implementation using mktime(), which was used before esp_schedule_get_next_time(), as the reference.
+ * This does not handle the times around DST changes correctly, so it is compared only away from them.
+ */
+static int ref_get_no_of_days(esp_schedule_t *schedule, struct tm *current_time, struct tm *schedule_time)
+{
+    int next_day = 0;
+    int today = ((current_time->tm_wday + 7 - 1) % 7);
+    esp_schedule_days_t today_bit = 1 << today;
+    uint8_t repeat_days = schedule->trigger.day.repeat_days;
+    int current_seconds = (current_time->tm_hour * 60 + current_time->tm_min) * 60 + current_time->tm_sec;
+    int schedule_seconds = (schedule_time->tm_hour * 60 + schedule_time->tm_min) * 60;
+
+    if (repeat_days == ESP_SCHEDULE_DAY_ONCE) {
+        return (schedule_seconds > current_seconds) ? 0 : 1;
+    }
+    if ((repeat_days & today_bit) && (schedule_seconds > current_seconds)) {
+        return 0;
+    }
+    if ((repeat_days & (today_bit ^ 0xFF)) > today_bit) {
+        next_day = ffs(repeat_days & (0xFF << (today + 1))) - 1;
+        return (next_day - today);
+    }
+    next_day = ffs(repeat_days) - 1;
+    if (next_day == today) {
+        return 7;
+    }
+    return (7 - today + next_day);
+}
+
+static uint8_t ref_get_next_month(esp_schedule_t *schedule, struct tm *current_time, struct tm *schedule_time)
+{
+    int current_seconds = (current_time->tm_hour * 60 + current_time->tm_min) * 60 + current_time->tm_sec;
+    int schedule_seconds = (schedule_time->tm_hour * 60 + schedule_time->tm_min) * 60;
+    uint8_t current_month = current_time->tm_mon + 1;
+    uint16_t current_month_bit = 1 << (current_month - 1);
+    uint16_t repeat_months = schedule->trigger.date.repeat_months;
+
+    if (repeat_months == ESP_SCHEDULE_MONTH_ONCE) {
+        if (schedule->trigger.date.day == current_time->tm_mday) {
+            return (schedule_seconds > current_seconds) ? current_month : (current_month + 1);
+        } else if (schedule->trigger.date.day > current_time->tm_mday) {
+            return current_month;
+        }
+        return (current_month + 1);
+    }
+    if (schedule->trigger.date.year > (current_time->tm_year + 1900)) {
+        return ffs(repeat_months);
+    }
+    if (current_month_bit & repeat_months) {
+        if ((schedule->trigger.date.day == current_time->tm_mday) && (schedule_seconds > current_seconds)) {
+            return current_month;
+        }
+        if (schedule->trigger.date.day > current_time->tm_mday) {
+            return current_month;
+        }
+    }
+    if ((repeat_months & (current_month_bit ^ 0xFFFF)) > current_month_bit) {
+        return ffs(repeat_months & (0xFFFF << (current_month)));
+    }
+    return (ffs(repeat_months) + 12);
+}
+
+static time_t ref_get_next_time(esp_schedule_t *schedule, time_t now)
+{
+    struct tm current_time, schedule_time;
+    localtime_r(&now, &current_time);
+    localtime_r(&now, &schedule_time);
+    schedule_time.tm_sec = 0;
+    schedule_time.tm_min = schedule->trigger.minutes;
+    schedule_time.tm_hour = schedule->trigger.hours;
+    mktime(&schedule_time);
+
+    if (schedule->trigger.type == ESP_SCHEDULE_TYPE_DAYS_OF_WEEK) {
+        schedule_time.tm_sec += ref_get_no_of_days(schedule, &current_time, &schedule_time) * SECONDS_IN_DAY;
+    }
+    if (schedule->trigger.type == ESP_SCHEDULE_TYPE_DATE) {
+        int current_year = current_time.tm_year + 1900;
+        schedule_time.tm_mday = schedule->trigger.date.day;
+        schedule_time.tm_mon = ref_get_next_month(schedule, &current_time, &schedule_time) - 1;
+        schedule_time.tm_year = ((schedule->trigger.date.year > current_year) ? schedule->trigger.date.year : current_year) - 1900;
+        if (schedule_time.tm_mon >= 12) {
+            schedule_time.tm_year += schedule_time.tm_mon / 12;
+            schedule_time.tm_mon = schedule_time.tm_mon % 12;
+        }
+    }
+    mktime(&schedule_time);
+
+    if (!current_time.tm_isdst && schedule_time.tm_isdst) {
+        schedule_time.tm_sec -= 3600;
+    } else if (current_time.tm_isdst && !schedule_time.tm_isdst) {
+        schedule_time.tm_sec += 3600;
+    }
+    return mktime(&schedule_time);
+}
+
+/* Whether the schedule is due on the given local day, given as days since 1970-01-01 */
+static bool test_is_schedule_day(esp_schedule_t *schedule, time_t local_day)
+{
+    time_t local_seconds = local_day * SECONDS_IN_DAY;
+    struct tm date;
+    gmtime_r(&local_seconds, &date);
+    if (schedule->trigger.type == ESP_SCHEDULE_TYPE_DAYS_OF_WEEK) {
+        if (schedule->trigger.day.repeat_days == ESP_SCHEDULE_DAY_ONCE) {
+            return true;
+        }
+        /* Monday is bit 0 */
+        return schedule->trigger.day.repeat_days & (1 << ((date.tm_wday + 6) % 7));
+    }
+    if (date.tm_mday != schedule->trigger.date.day) {
+        return false;
+    }
+    if (schedule->trigger.date.repeat_months == ESP_SCHEDULE_MONTH_ONCE) {
+        return true;
+    }
+    return (schedule->trigger.date.repeat_months & (1 << date.tm_mon)) &&
+            ((date.tm_year + 1900) >= schedule->trigger.date.year);
+}
+
+/* Checks that next is the first time after now at which the schedule is due. Returns whether next is away from
+ * any DST change, so that it can be compared with the reference implementation.
+ */
+static bool test_check_next_time(esp_schedule_t *schedule, time_t now, time_t next)
+{
+    char msg[128];
+    snprintf(msg, sizeof(msg), "TZ %s, now %lld, hours %d, minutes %d, next %lld", getenv("TZ"), (long long)now,
+            schedule->trigger.hours, schedule->trigger.minutes, (long long)next);
+    TEST_ASSERT_GREATER_THAN_MESSAGE(now, next, msg);
+
+    time_t day_seconds = (schedule->trigger.hours * 60 + schedule->trigger.minutes) * 60;
+    time_t next_local = test_get_local_seconds(next);
+    time_t next_day = next_local / SECONDS_IN_DAY;
+    time_t schedule_local = next_day * SECONDS_IN_DAY + day_seconds;
+    if (next_local != schedule_local) {
+        /* The schedule time does not exist on that day, since it is in a DST gap. It should be at the end of the gap. */
+        TEST_ASSERT_LESS_THAN_MESSAGE(schedule_local, test_get_local_seconds(next - 1), msg);
+        TEST_ASSERT_GREATER_THAN_MESSAGE(schedule_local, next_local, msg);
+    }
+
+    /* The schedule should be due on that day, and not on any day before that, after now */
+    TEST_ASSERT_TRUE_MESSAGE(test_is_schedule_day(schedule, next_day), msg);
+    time_t now_local = test_get_local_seconds(now);
+    time_t now_day = now_local / SECONDS_IN_DAY;
+    for (time_t day = now_day; day < next_day; day++) {
+        if ((day == now_day) && ((now_local % SECONDS_IN_DAY) >= day_seconds)) {
+            continue;
+        }
+        TEST_ASSERT_FALSE_MESSAGE(test_is_schedule_day(schedule, day), msg);
+    }
+
+    time_t offset = test_get_utc_offset(now);
+    return (test_get_utc_offset(next) == offset) && (test_get_utc_offset(next - 3 * 3600) == offset) &&
+            (test_get_utc_offset(next + 3 * 3600) == offset);
+}
+
+static void test_init_random_schedule(esp_schedule_t *schedule, time_t now, time_t dst_change)
+{
+    memset(schedule, 0, sizeof(esp_schedule_t));
+    if (dst_change) {
+        /* Around the local time of the DST change, so that it is in the gap or the repeated hour */
+        time_t local_seconds = test_get_local_seconds(dst_change) + (time_t)test_rand(3 * 3600) - 90 * 60;
+        local_seconds %= SECONDS_IN_DAY;
+        schedule->trigger.hours = local_seconds / 3600;
+        schedule->trigger.minutes = (local_seconds / 60) % 60;
+    } else {
+        schedule->trigger.hours = test_rand(24);
+        schedule->trigger.minutes = test_rand(60);
+    }
+    if (test_rand(2)) {
+        schedule->trigger.type = ESP_SCHEDULE_TYPE_DAYS_OF_WEEK;
+        schedule->trigger.day.repeat_days = test_rand(4) ? test_rand(ESP_SCHEDULE_DAY_EVERYDAY + 1) : ESP_SCHEDULE_DAY_ONCE;
+        return;
+    }
+    struct tm current_time;
+    localtime_r(&now, &current_time);
+    schedule->trigger.type = ESP_SCHEDULE_TYPE_DATE;
+    schedule->trigger.date.day = 1 + test_rand(28);
+    schedule->trigger.date.year = current_time.tm_year + 1900;
+    if (test_rand(4)) {
+        schedule->trigger.date.repeat_months = 1 + test_rand(0xFFF);
+        schedule->trigger.date.repeat_every_year = test_rand(2);
+        if (!schedule->trigger.date.repeat_every_year || test_rand(4) == 0) {
+            /* The schedule should not have expired */
+            schedule->trigger.date.year++;
+        }
+    }
+}
+
+TEST_CASE("Next schedule time is correct across DST changes", "[esp_schedule]")
+{
+    char *tz = getenv("TZ");
+    char *saved_tz = tz ? strdup(tz) : NULL;
+    test_rand_state = 0x5eed1234;
+    int compared = 0;
+    esp_schedule_t schedule;
+
+    for (int i = 0; i < sizeof(test_time_zones) / sizeof(test_time_zones[0]); i++) {
+        setenv("TZ", test_time_zones[i], 1);
+        tzset();
+        for (int j = 0; j < TEST_CASES_PER_TZ; j++) {
+            time_t now = TEST_TIME_START + test_rand(TEST_TIME_END - TEST_TIME_START);
+            time_t dst_change = 0;
+            if (j % 2) {
+                /* Around a DST change, if there is any */
+                dst_change = test_get_next_dst_change(now);
+                if (dst_change) {
+                    now = dst_change + (time_t)test_rand(4 * SECONDS_IN_DAY) - 2 * SECONDS_IN_DAY;
+                }
+            }
+            test_init_random_schedule(&schedule, now, dst_change);
+            time_t next = esp_schedule_get_next_time(&schedule, now);
+            if (test_check_next_time(&schedule, now, next)) {
+                TEST_ASSERT_EQUAL(ref_get_next_time(&schedule, now), next);
+                compared++;
+            }
+            /* Trigger the repeating schedules a few times. The next time should always be after the last trigger,
+             * even if the time goes back a bit after that.
+             */
+            bool repeating = (schedule.trigger.type == ESP_SCHEDULE_TYPE_DAYS_OF_WEEK) ?
+                    (schedule.trigger.day.repeat_days != ESP_SCHEDULE_DAY_ONCE) :
+                    (schedule.trigger.date.repeat_months && schedule.trigger.date.repeat_every_year);
+            for (int k = 0; repeating && (k < 4); k++) {
+                schedule.compiled.triggered_utc = next;
+                now = next - test_rand(120);
+                time_t triggered = next;
+                next = esp_schedule_get_next_time(&schedule, now);
+                test_check_next_time(&schedule, triggered, next);
+            }
+        }
+    }
+    /* Most of the cases should have been compared with the reference */
+    TEST_ASSERT_GREATER_THAN(TEST_CASES_PER_TZ, compared);
+
+    if (saved_tz) {
+        setenv("TZ", saved_tz, 1);
+        free(saved_tz);
+    } else {
+        unsetenv("TZ");
+    }
+    tzset();
+}